@@ -0,0 +1,157 @@
+#include "batch.h"
+#include "core.h"
+#include <utils/flog.h>
+#include <filesystem>
+#include <signal_path/signal_path.h>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+
+// Longest time each stream of the DSP chain may take to process what's left in it after the source has ended
+#define BATCH_DRAIN_TIMEOUT std::chrono::milliseconds(10000)
+
+// Interval at which progress is logged
+#define BATCH_REPORT_INTERVAL   std::chrono::seconds(10)
+
+namespace batch {
+    dsp::stream<dsp::complex_t> dummyStream;
+
+    std::mutex endMtx;
+    std::condition_variable endCnd;
+    bool ended = false;
+    uint64_t processedSamples = 0;
+
+    float* acquireFFTBuffer(void* ctx) {
+        // Nobody looks at the FFT in batch mode, returning NULL makes the front end skip the conversion
+        return NULL;
+    }
+
+    void releaseFFTBuffer(void* ctx) {}
+
+    std::string toFixed(double val, int decimals) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+        return buf;
+    }
+
+    bool loadModule(std::string path) {
+        std::string fn = std::filesystem::path(path).filename().string();
+        if (std::filesystem::path(path).extension().generic_string() != SDRPP_MOD_EXTENTSION) { return false; }
+        if (!std::filesystem::is_regular_file(path)) { return false; }
+
+        // Audio and network sinks would pace or block the processing, streams fall back to the null sink without them
+        if (fn.find("_sink") != std::string::npos) { return false; }
+
+        flog::info("Loading {0}", path);
+        core::moduleManager.loadModule(path);
+        return true;
+    }
+
+    int main() {
+        flog::info("=====| BATCH MODE |=====");
+
+        std::string path = core::args["batch"].s();
+        if (!std::filesystem::is_regular_file(path)) {
+            flog::error("Batch input '{0}' does not exist or isn't a file", path);
+            return -1;
+        }
+
+        // Init the IQ front end without buffering so that the source is only throttled by the DSP
+        sigpath::iqFrontEnd.init(&dummyStream, 8000000, false, 1, false, 1024, 20.0, IQFrontEnd::FFTWindow::NUTTALL, acquireFFTBuffer, releaseFFTBuffer, NULL);
+        sigpath::iqFrontEnd.start();
+
+        // Load config
+        core::configManager.acquire();
+        std::string modulesDir = core::configManager.conf["modulesDirectory"];
+        std::vector<std::string> modules = core::configManager.conf["modules"];
+        auto modList = core::configManager.conf["moduleInstances"].items();
+        core::configManager.release();
+        modulesDir = std::filesystem::absolute(modulesDir).string();
+
+        flog::info("Loading modules");
+        if (std::filesystem::is_directory(modulesDir)) {
+            for (const auto& file : std::filesystem::directory_iterator(modulesDir)) {
+                loadModule(file.path().generic_string());
+            }
+        }
+        else {
+            flog::warn("Module directory {0} does not exist, not loading modules from directory", modulesDir);
+        }
+        for (auto const& apath : modules) {
+            loadModule(std::filesystem::absolute(apath).generic_string());
+        }
+
+        // Create module instances
+        for (auto const& [name, _module] : modList) {
+            std::string mod = _module["module"];
+            bool enabled = _module["enabled"];
+            if (core::moduleManager.modules.find(mod) == core::moduleManager.modules.end()) { continue; }
+            flog::info("Initializing {0} ({1})", name, mod);
+            core::moduleManager.createInstance(name, mod);
+            if (!enabled) { core::moduleManager.disableInstance(name); }
+        }
+        core::moduleManager.doPostInitAll();
+
+        // The file source opens the batch input by itself when it sees the argument
+        auto sources = sigpath::sourceManager.getSourceNames();
+        if (std::find(sources.begin(), sources.end(), "File") == sources.end()) {
+            flog::error("The file source module is required for batch mode but isn't loaded");
+            return -1;
+        }
+        sigpath::sourceManager.selectSource("File");
+
+        flog::info("Processing {0}", path);
+        auto startTime = std::chrono::steady_clock::now();
+        sigpath::iqFrontEnd.flushInputBuffer();
+        sigpath::sourceManager.start();
+
+        {
+            std::unique_lock<std::mutex> lck(endMtx);
+            while (!endCnd.wait_for(lck, BATCH_REPORT_INTERVAL, []() { return ended; })) {
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+                flog::info("Still processing, {0}s elapsed", toFixed(elapsed, 0));
+            }
+        }
+
+        // Stop the source and let the blocks still in flight reach the modules before ending them
+        sigpath::sourceManager.stop();
+        if (!sigpath::iqFrontEnd.waitIdle(BATCH_DRAIN_TIMEOUT)) {
+            flog::warn("The DSP chain didn't finish processing the end of the input, the output may be truncated");
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        // Delete the instances first so that they close their outputs, eg. the recorder finishing its files
+        std::vector<std::string> instanceNames;
+        for (auto& [name, inst] : core::moduleManager.instances) {
+            instanceNames.push_back(name);
+        }
+        for (const auto& name : instanceNames) {
+            core::moduleManager.deleteInstance(name);
+        }
+        for (auto& [name, mod] : core::moduleManager.modules) {
+            mod.end();
+        }
+        sigpath::iqFrontEnd.stop();
+
+        if (!processedSamples) {
+            flog::error("No samples were processed");
+            return -1;
+        }
+
+        // Report throughput
+        double sampleRate = sigpath::iqFrontEnd.getSampleRate();
+        double duration = (double)processedSamples / sampleRate;
+        flog::info("Processed {0} samples ({1}s of signal) in {2}s", processedSamples, toFixed(duration, 1), toFixed(elapsed, 2));
+        flog::info("Throughput: {0} MS/s ({1}x real time)", toFixed((double)processedSamples / elapsed / 1e6, 2), toFixed(duration / elapsed, 1));
+
+        return 0;
+    }
+
+    void inputEnded(uint64_t sampleCount) {
+        std::lock_guard<std::mutex> lck(endMtx);
+        ended = true;
+        processedSamples = sampleCount;
+        endCnd.notify_all();
+    }
+}
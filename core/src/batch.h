@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+namespace batch {
+    int main();
+
+    // Called by the source once the whole input has been pushed through the signal path
+    void inputEnded(uint64_t sampleCount);
+}
@@ -14,6 +14,7 @@ void CommandArgsParser::defineAll() {
 #endif
 
         define('a', "addr", "Server mode address", "0.0.0.0");
+        define('b', "batch", "Process an IQ file as fast as possible without GUI then exit", "");
         define('h', "help", "Show help");
         define('p', "port", "Server mode port", 5259);
         define('r', "root", "Root directory, where all config files are stored", std::filesystem::absolute(root).string());
@@ -1,4 +1,5 @@
 #include <server.h>
+#include <batch.h>
 #include "imgui.h"
 #include <stdio.h>
 #include <gui/main_window.h>
@@ -38,7 +39,10 @@ namespace core {
     ModuleComManager modComManager;
     CommandArgsParser args;
 
-    void setInputSampleRate(double samplerate) {
+    static void setMainSampleRate(double samplerate) {
+        // Lets the source statistics tell how long a block lasts
+        sigpath::sourceManager.setSampleRate(samplerate);
+
         // Forward this to the server
         if (args["server"].b()) { server::setInputSampleRate(samplerate); return; }
         
@@ -55,6 +59,17 @@ namespace core {
         // Debug logs
         flog::info("New DSP samplerate: {0} (source samplerate is {1})", effectiveSr, samplerate);
     }
+
+    void setInputSampleRate(double samplerate) {
+        // Secondary sources only update their own front end
+        if (sigpath::sourceManager.routeSampleRate(samplerate)) { return; }
+        setMainSampleRate(samplerate);
+    }
+
+    void setInputSampleRate(double samplerate, std::string sourceName) {
+        if (sigpath::sourceManager.routeSampleRate(sourceName, samplerate)) { return; }
+        setMainSampleRate(samplerate);
+    }
 };
 
 // main
@@ -78,10 +93,11 @@ int sdrpp_main(int argc, char* argv[]) {
     }
 
     bool serverMode = (bool)core::args["server"];
+    bool batchMode = !core::args["batch"].s().empty();
 
 #ifdef _WIN32
-    // Free console if the user hasn't asked for a console and not in server mode
-    if (!core::args["con"].b() && !serverMode) { FreeConsole(); }
+    // Free console if the user hasn't asked for a console and not in server or batch mode
+    if (!core::args["con"].b() && !serverMode && !batchMode) { FreeConsole(); }
 
     // Set error mode to avoid abnoxious popups
     SetErrorMode(SEM_NOOPENFILEERRORBOX | SEM_NOGPFAULTERRORBOX | SEM_FAILCRITICALERRORS);
@@ -230,6 +246,8 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["decimationPower"] = 0;
     defConfig["iqCorrection"] = false;
     defConfig["invertIQ"] = false;
+    defConfig["iqBufferLatency"] = 200;
+    defConfig["secondarySources"] = json::object();
 
     defConfig["streams"]["Radio"]["muted"] = false;
     defConfig["streams"]["Radio"]["sink"] = "Audio";
@@ -331,6 +349,7 @@ int sdrpp_main(int argc, char* argv[]) {
     core::configManager.release(true);
 
     if (serverMode) { return server::main(); }
+    if (batchMode) { return batch::main(); }
 
     core::configManager.acquire();
     std::string resDir = core::configManager.conf["resourcesDirectory"];
@@ -11,6 +11,9 @@ namespace core {
     SDRPP_EXPORT CommandArgsParser args;
 
     void setInputSampleRate(double samplerate);
+
+    // For sources that announce their samplerate from their own threads, routed by the name they registered with
+    void setInputSampleRate(double samplerate, std::string sourceName);
 };
 
 int sdrpp_main(int argc, char* argv[]);
\ No newline at end of file
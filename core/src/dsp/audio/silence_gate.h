@@ -0,0 +1,103 @@
+#pragma once
+#include "../buffer/history.h"
+#include <volk/volk.h>
+#include <math.h>
+#include <algorithm>
+
+// Length of the windows the level is measured over
+#define SILENCE_GATE_WINDOW         0.01
+// The gate closes this far below the level that opens it
+#define SILENCE_GATE_HYSTERESIS     6.0f
+
+namespace dsp::audio {
+    // Passes audio through only while it isn't silent. The RMS level is measured over fixed windows that
+    // don't depend on how the audio is split into buffers. The gate opens as soon as a window is above the
+    // threshold, including that whole window, and closes once the level has stayed below the threshold minus
+    // the hysteresis for the hang time. This is not a block since it decides what a sink writes.
+    class SilenceGate {
+    public:
+        SilenceGate() {}
+
+        void init(double samplerate, int channels, float threshold, double hangTime) {
+            _channels = channels;
+            _samplerate = samplerate;
+            windowLen = std::max<int>(samplerate * SILENCE_GATE_WINDOW, 1);
+            pending.setCapacity(windowLen * channels);
+            setThreshold(threshold);
+            setHangTime(hangTime);
+            reset();
+        }
+
+        // Threshold in dBFS RMS
+        void setThreshold(float threshold) {
+            openLevel = powf(10.0f, threshold / 20.0f);
+            closeLevel = powf(10.0f, (threshold - SILENCE_GATE_HYSTERESIS) / 20.0f);
+        }
+
+        void setHangTime(double hangTime) {
+            hangLen = std::max<double>(hangTime, 0.0) * _samplerate;
+        }
+
+        void reset() {
+            open = false;
+            hang = 0;
+            winFill = 0;
+            sumSq = 0.0f;
+            pending.clear();
+        }
+
+        bool isOpen() { return open; }
+
+        // Hand the parts of the buffer that pass the gate to write(data, count), count being in frames
+        template <class Func>
+        void process(const float* in, int count, Func write) {
+            while (count > 0) {
+                int n = std::min<int>(count, windowLen - winFill);
+                int vals = n * _channels;
+
+                float sq;
+                volk_32f_x2_dot_prod_32f(&sq, in, in, vals);
+                sumSq += sq;
+
+                // While closed, the window is held back until its level is known
+                if (open) { write(in, n); }
+                else { pending.push(in, vals); }
+
+                winFill += n;
+                in += vals;
+                count -= n;
+                if (winFill < windowLen) { continue; }
+
+                float rms = sqrtf(sumSq / (float)(windowLen * _channels));
+                if (!open && rms >= openLevel) {
+                    open = true;
+                    hang = 0;
+                    pending.pop(pending.getSize(), [&](const float* data, int len) { write(data, len / _channels); });
+                }
+                else if (open && rms < closeLevel) {
+                    hang += windowLen;
+                    if (hang >= hangLen) { open = false; }
+                }
+                else if (open) {
+                    hang = 0;
+                }
+                pending.clear();
+                winFill = 0;
+                sumSq = 0.0f;
+            }
+        }
+
+    private:
+        dsp::buffer::History<float> pending;
+        int _channels = 1;
+        int windowLen = 1;
+        double _samplerate = 48000.0;
+        float openLevel = 0.0f;
+        float closeLevel = 0.0f;
+        int64_t hangLen = 0;
+        int64_t hang = 0;
+        int winFill = 0;
+        float sumSq = 0.0f;
+        bool open = false;
+    };
+}
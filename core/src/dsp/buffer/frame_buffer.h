@@ -1,10 +1,26 @@
 #pragma once
 #include "../block.h"
-#define TEST_BUFFER_SIZE 32
+#include <atomic>
 
-// IMPORTANT: THIS IS TRASH AND MUST BE REWRITTEN IN THE FUTURE
+// Most frames that can be waiting at once
+#define FRAME_BUFFER_MAX_FRAMES         1024
+
+// Frames of at least this many samples are exchanged with the streams, shorter ones are copied into the sample
+// ring so that a mostly empty stream buffer isn't held for each of them
+#define FRAME_BUFFER_EXCHANGE_MIN       (STREAM_BUFFER_SIZE / 2)
+
+// Most memory the buffers of the queue may take, the latency target is limited by it at high samplerates
+#define FRAME_BUFFER_MAX_BYTES          (64 * 1024 * 1024)
+
+#define FRAME_BUFFER_DEFAULT_LATENCY    200.0
 
 namespace dsp::buffer {
+    // Absorbs the jitter between a source and the DSP. Frames are queued until the amount of signal waiting
+    // reaches the latency target, anything beyond that is dropped and counted. The queue is made of single
+    // producer, single consumer rings: one of frames waiting to be pushed, one of free stream buffers going back
+    // to the input side and one of samples. Long frames are exchanged with the input and output streams instead
+    // of being copied, short ones are copied into the sample ring. All of the memory is allocated when the
+    // latency or samplerate changes, sized from the target and capped at FRAME_BUFFER_MAX_BYTES.
     template <class T>
     class SampleFrameBuffer : public block {
         using base_type = block;
@@ -16,21 +32,18 @@ namespace dsp::buffer {
         ~SampleFrameBuffer() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            for (int i = 0; i < TEST_BUFFER_SIZE; i++) {
-                buffer::free(buffers[i]);
-            }
+
+            // Stream buffers held by the streams now belong to them, only free the ones in the pool
+            for (uint64_t i = freeRead; i < freeWrite; i++) { buffer::free(freeBufs[i % FRAME_BUFFER_MAX_FRAMES]); }
+            if (ring) { buffer::free(ring); }
         }
 
         void init(stream<T>* in) {
             _in = in;
-
-            for (int i = 0; i < TEST_BUFFER_SIZE; i++) {
-                buffers[i] = buffer::alloc<T>(STREAM_BUFFER_SIZE);
-            }
-
             base_type::registerInput(in);
             base_type::registerOutput(&out);
             base_type::_block_init = true;
+            resize();
         }
 
         void setInput(stream<T>* in) {
@@ -43,63 +56,260 @@ namespace dsp::buffer {
             base_type::tempStart();
         }
 
+        // Pass buffers straight through without queuing them, the queue's memory is freed meanwhile
+        void setBypass(bool bypass) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _bypass = bypass;
+            resize();
+            base_type::tempStart();
+        }
+
+        // Maximum amount of signal that can be waiting, in milliseconds
+        void setLatency(double ms) {
+            _latency = ms;
+            updateTarget();
+        }
+
+        void setSampleRate(double sampleRate) {
+            _sampleRate = sampleRate;
+            updateTarget();
+        }
+
+        // Discard everything that is waiting, eg. after a retune. Frames queued after the call are kept.
         void flush() {
-            std::unique_lock lck(bufMtx);
-            readCur = writeCur;
+            flushUntil = frameWrite.load();
+        }
+
+        // Wait until every buffer written to the input has been pushed to the output and read from it
+        bool waitIdle(std::chrono::milliseconds timeout) {
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            if (!_in->waitIdle(timeout)) { return false; }
+            while (frameAvailable()) {
+                if (std::chrono::steady_clock::now() >= deadline) { return false; }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return out.waitIdle(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()));
+        }
+
+        // Amount of signal waiting relative to the latency target
+        float getFill() {
+            int64_t target = targetSamples;
+            return target ? (float)queuedSamples.load() / (float)target : 0.0f;
+        }
+
+        double getLatency() { return _latency; }
+        uint64_t getOverflows() { return overflows; }
+
+        // Longest latency the queue can hold at the last frame size, below the target when the memory cap or
+        // the number of frames limits it
+        double getMaxLatency() {
+            int64_t count = lastCount;
+            int64_t samples = (count >= FRAME_BUFFER_EXCHANGE_MIN) ? poolSize * count : std::min<int64_t>(ringSize, FRAME_BUFFER_MAX_FRAMES * count);
+            return (double)samples * 1000.0 / _sampleRate;
         }
 
         int run() {
-            // Wait for data
             int count = _in->read();
             if (count < 0) { return -1; }
 
-            if (bypass) {
-                memcpy(out.writeBuf, _in->readBuf, count * sizeof(T));
+            // Stamp the buffer with the host clock if the source didn't describe it itself
+            StreamMeta meta = _in->readMeta;
+            if (!meta.valid) { meta = clock.stamp(count); }
+
+            if (_bypass) {
+                if (_in->getBufferSize() == STREAM_BUFFER_SIZE) { std::swap(_in->readBuf, out.writeBuf); }
+                else { memcpy(out.writeBuf, _in->readBuf, count * sizeof(T)); }
+                out.writeMeta = meta;
                 _in->flush();
                 if (!out.swap(count)) { return -1; }
                 return count;
             }
 
-            // Push it on the ring buffer
-            {
-                std::lock_guard<std::mutex> lck(bufMtx);
-                memcpy(buffers[writeCur], _in->readBuf, count * sizeof(T));
-                sizes[writeCur] = count;
-                writeCur++;
-                writeCur = ((writeCur) % TEST_BUFFER_SIZE);
+            // Always accept a frame into an empty queue, even if it alone is longer than the target
+            lastCount = count;
+            int64_t queued = queuedSamples.load();
+            uint64_t w = frameWrite.load(std::memory_order_relaxed);
+            bool full = (queued && queued + count > targetSamples) || (w - frameRead.load(std::memory_order_acquire) >= FRAME_BUFFER_MAX_FRAMES);
+            if (full || !(count >= FRAME_BUFFER_EXCHANGE_MIN ? queueExchanged(w, count) : queueCopied(w, count))) {
+                overflows++;
+                _in->flush();
+                return count;
             }
-            cnd.notify_all();
             _in->flush();
+
+            // Queue the frame
+            Frame& frame = frames[w % FRAME_BUFFER_MAX_FRAMES];
+            frame.count = count;
+            frame.meta = meta;
+            queuedSamples += count;
+            frameWrite.store(w + 1, std::memory_order_release);
+
+            // Take the lock so that the notification can't slip between the worker's check and its wait
+            { std::lock_guard<std::mutex> lck(workerMtx); }
+            workerCnd.notify_one();
             return count;
         }
 
         void worker() {
             while (true) {
-                // Wait for data
-                std::unique_lock lck(bufMtx);
-                cnd.wait(lck, [this]() { return (((writeCur - readCur + TEST_BUFFER_SIZE) % TEST_BUFFER_SIZE) > 0) || stopWorker; });
-                if (stopWorker) { break; }
-
-                // Write one to output buffer and unlock in preparation to swap buffers
-                int count = sizes[readCur];
-                memcpy(out.writeBuf, buffers[readCur], count * sizeof(T));
-                readCur++;
-                readCur = ((readCur) % TEST_BUFFER_SIZE);
-                lck.unlock();
-
-                // Swap
+                {
+                    std::unique_lock<std::mutex> lck(workerMtx);
+                    workerCnd.wait(lck, [this]() { return frameAvailable() || stopWorker; });
+                    if (stopWorker) { break; }
+                }
+
+                uint64_t r = frameRead.load(std::memory_order_relaxed);
+                Frame& frame = frames[r % FRAME_BUFFER_MAX_FRAMES];
+                int count = frame.count;
+                if (r < flushUntil) {
+                    release(frame);
+                    queuedSamples -= count;
+                    frameRead.store(r + 1, std::memory_order_release);
+                    continue;
+                }
+
+                // Hand an exchanged frame's buffer to the output stream and take its empty one back into the pool,
+                // copy a short frame out of the sample ring
+                out.writeMeta = frame.meta;
+                if (frame.buf) { std::swap(out.writeBuf, frame.buf); }
+                else { copyFromRing(out.writeBuf, frame.offset, count); }
+                release(frame);
+                queuedSamples -= count;
+                frameRead.store(r + 1, std::memory_order_release);
+
                 if (!out.swap(count)) { break; }
             }
         }
 
         stream<T> out;
 
-        int writeCur = 0;
-        int readCur = 0;
-
-        bool bypass = false;
+        // Used to stamp the buffers of sources that don't provide their own metadata
+        StreamClock clock;
 
     private:
+        struct Frame {
+            // Exchanged stream buffer, or NULL if the samples are in the ring from offset on
+            T* buf;
+            uint64_t offset;
+            int count;
+            StreamMeta meta;
+        };
+
+        void updateTarget() {
+            int64_t target = std::max<int64_t>(_latency * _sampleRate / 1000.0, 1);
+            if (target == targetSamples) { return; }
+            targetSamples = target;
+            if (!base_type::_block_init) { return; }
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            resize();
+            base_type::tempStart();
+        }
+
+        // Size the pool and the sample ring from the target. Only called with the block stopped, when the queue is
+        // empty and every pool buffer is back in the free ring.
+        void resize() {
+            int64_t target = _bypass ? 0 : targetSamples.load();
+            int64_t budget = FRAME_BUFFER_MAX_BYTES / sizeof(T);
+
+            // Enough stream buffers for the target in frames of the shortest exchanged size, taking at most half of
+            // the memory. One more than the target is allowed for the frame being pushed.
+            int64_t pool = 0;
+            if (target) {
+                pool = std::clamp<int64_t>(target / FRAME_BUFFER_EXCHANGE_MIN + 1, 1, (budget / 2) / STREAM_BUFFER_SIZE);
+            }
+            while (poolSize < pool) {
+                returnBuffer(buffer::alloc<T>(STREAM_BUFFER_SIZE));
+                poolSize++;
+            }
+            while (poolSize > pool) {
+                buffer::free(takeBuffer());
+                poolSize--;
+            }
+
+            // The ring takes the rest, it must hold the target plus the longest copied frame
+            int64_t size = target ? std::min<int64_t>(target + FRAME_BUFFER_EXCHANGE_MIN, budget - pool * STREAM_BUFFER_SIZE) : 0;
+            if (size != ringSize) {
+                if (ring) { buffer::free(ring); }
+                ring = size ? buffer::alloc<T>(size) : NULL;
+                ringSize = size;
+            }
+            ringWrite = 0;
+            ringRead = 0;
+        }
+
+        inline bool frameAvailable() {
+            return frameWrite.load(std::memory_order_acquire) != frameRead.load(std::memory_order_relaxed);
+        }
+
+        // Input side: exchange the input's buffer with a free one from the pool
+        bool queueExchanged(uint64_t w, int count) {
+            uint64_t r = freeRead.load(std::memory_order_relaxed);
+            if (r == freeWrite.load(std::memory_order_acquire)) { return false; }
+            T* buf = takeBuffer();
+            if (_in->getBufferSize() == STREAM_BUFFER_SIZE) { std::swap(_in->readBuf, buf); }
+            else { memcpy(buf, _in->readBuf, count * sizeof(T)); }
+            frames[w % FRAME_BUFFER_MAX_FRAMES].buf = buf;
+            return true;
+        }
+
+        // Input side: copy the input into the sample ring
+        bool queueCopied(uint64_t w, int count) {
+            uint64_t rw = ringWrite.load(std::memory_order_relaxed);
+            if (rw + count - ringRead.load(std::memory_order_acquire) > (uint64_t)ringSize) { return false; }
+            int64_t start = rw % ringSize;
+            int64_t first = std::min<int64_t>(count, ringSize - start);
+            memcpy(&ring[start], _in->readBuf, first * sizeof(T));
+            memcpy(ring, &_in->readBuf[first], (count - first) * sizeof(T));
+            ringWrite.store(rw + count, std::memory_order_release);
+            Frame& frame = frames[w % FRAME_BUFFER_MAX_FRAMES];
+            frame.buf = NULL;
+            frame.offset = rw;
+            return true;
+        }
+
+        // Output side
+        void copyFromRing(T* dst, uint64_t offset, int count) {
+            int64_t start = offset % ringSize;
+            int64_t first = std::min<int64_t>(count, ringSize - start);
+            memcpy(dst, &ring[start], first * sizeof(T));
+            memcpy(&dst[first], ring, (count - first) * sizeof(T));
+        }
+
+        // Output side: give the frame's memory back to the input side
+        void release(Frame& frame) {
+            if (frame.buf) { returnBuffer(frame.buf); }
+            else { ringRead.store(frame.offset + frame.count, std::memory_order_release); }
+        }
+
+        // Input side, or either when stopped: take a free buffer, the caller checks there is one
+        T* takeBuffer() {
+            uint64_t r = freeRead.load(std::memory_order_relaxed);
+            T* buf = freeBufs[r % FRAME_BUFFER_MAX_FRAMES];
+            freeRead.store(r + 1, std::memory_order_release);
+            return buf;
+        }
+
+        // Output side, or either when stopped: give a buffer back to the input side
+        void returnBuffer(T* buf) {
+            uint64_t w = freeWrite.load(std::memory_order_relaxed);
+            freeBufs[w % FRAME_BUFFER_MAX_FRAMES] = buf;
+            freeWrite.store(w + 1, std::memory_order_release);
+        }
+
+        // Output side: return all waiting frames to the pool
+        void drain() {
+            while (frameAvailable()) {
+                uint64_t r = frameRead.load(std::memory_order_relaxed);
+                Frame& frame = frames[r % FRAME_BUFFER_MAX_FRAMES];
+                release(frame);
+                queuedSamples -= frame.count;
+                frameRead.store(r + 1, std::memory_order_release);
+            }
+        }
+
         void doStart() {
             base_type::workerThread = std::thread(&SampleFrameBuffer<T>::workerLoop, this);
             readWorkerThread = std::thread(&SampleFrameBuffer<T>::worker, this);
@@ -108,25 +318,54 @@ namespace dsp::buffer {
         void doStop() {
             _in->stopReader();
             out.stopWriter();
-            stopWorker = true;
-            cnd.notify_all();
+            {
+                std::lock_guard<std::mutex> lck(workerMtx);
+                stopWorker = true;
+            }
+            workerCnd.notify_all();
 
             if (base_type::workerThread.joinable()) { base_type::workerThread.join(); }
             if (readWorkerThread.joinable()) { readWorkerThread.join(); }
 
+            // Both sides are stopped, whatever was waiting is stale by the time the block restarts
+            drain();
+
             _in->clearReadStop();
             out.clearWriteStop();
             stopWorker = false;
         }
 
         stream<T>* _in;
+        bool _bypass = false;
 
-        std::thread readWorkerThread;
-        std::mutex bufMtx;
-        std::condition_variable cnd;
-        T* buffers[TEST_BUFFER_SIZE];
-        int sizes[TEST_BUFFER_SIZE];
+        double _latency = FRAME_BUFFER_DEFAULT_LATENCY;
+        double _sampleRate = 1000000.0;
+        std::atomic<int64_t> targetSamples = FRAME_BUFFER_DEFAULT_LATENCY * 1000.0;
+        std::atomic<int64_t> queuedSamples = 0;
+        std::atomic<uint64_t> overflows = 0;
+        std::atomic<uint64_t> flushUntil = 0;
+        std::atomic<int> lastCount = 0;
 
+        // Frames waiting to be pushed, written by the input side
+        Frame frames[FRAME_BUFFER_MAX_FRAMES];
+        std::atomic<uint64_t> frameWrite = 0;
+        std::atomic<uint64_t> frameRead = 0;
+
+        // Free stream buffers, written by the output side
+        T* freeBufs[FRAME_BUFFER_MAX_FRAMES];
+        std::atomic<uint64_t> freeWrite = 0;
+        std::atomic<uint64_t> freeRead = 0;
+        int64_t poolSize = 0;
+
+        // Samples of the copied frames, written by the input side
+        T* ring = NULL;
+        int64_t ringSize = 0;
+        std::atomic<uint64_t> ringWrite = 0;
+        std::atomic<uint64_t> ringRead = 0;
+
+        std::thread readWorkerThread;
+        std::mutex workerMtx;
+        std::condition_variable workerCnd;
         bool stopWorker = false;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "buffer.h"
+#include <algorithm>
+#include <string.h>
+
+namespace dsp::buffer {
+    // Keeps the last samples pushed into it, overwriting the oldest once full. The memory is allocated
+    // once by setCapacity() so that pushing never allocates. Not thread safe, the owner must lock.
+    template <class T>
+    class History {
+    public:
+        History() {}
+
+        History(int capacity) { setCapacity(capacity); }
+
+        ~History() {
+            if (buf) { buffer::free(buf); }
+        }
+
+        // Change the number of samples kept, the current content is discarded
+        void setCapacity(int capacity) {
+            if (buf) { buffer::free(buf); }
+            buf = NULL;
+            _capacity = std::max<int>(capacity, 0);
+            if (_capacity) { buf = buffer::alloc<T>(_capacity); }
+            clear();
+        }
+
+        int getCapacity() { return _capacity; }
+
+        int getSize() { return size; }
+
+        void clear() {
+            head = 0;
+            size = 0;
+        }
+
+        void push(const T* data, int count) {
+            if (!_capacity || count <= 0) { return; }
+
+            // Only the end of a block longer than the whole history can be kept
+            if (count > _capacity) {
+                data += count - _capacity;
+                count = _capacity;
+            }
+
+            // Copy in at most two parts to wrap around
+            int first = std::min<int>(count, _capacity - head);
+            memcpy(&buf[head], data, first * sizeof(T));
+            memcpy(buf, &data[first], (count - first) * sizeof(T));
+            head = (head + count) % _capacity;
+            size = std::min<int>(size + count, _capacity);
+        }
+
+        // Hand at most count of the oldest samples to handler(data, count), in up to two parts, and remove them
+        template <class Func>
+        void pop(int count, Func handler) {
+            count = std::min<int>(count, size);
+            if (count <= 0) { return; }
+            int tail = (head - size + _capacity) % _capacity;
+            int first = std::min<int>(count, _capacity - tail);
+            handler(&buf[tail], first);
+            if (count - first) { handler(buf, count - first); }
+            size -= count;
+        }
+
+    private:
+        T* buf = NULL;
+        int _capacity = 0;
+        int head = 0;
+        int size = 0;
+    };
+}
@@ -43,6 +43,8 @@ namespace dsp::buffer {
             }
 
             for (int i = 0; i < count; i++) {
+                // The output buffer is described by the input sample it starts with
+                if (!read) { out.writeMeta = _in->readMeta.at(i); }
                 out.writeBuf[read++] = _in->readBuf[i];
                 if (read >= samples) {
                     read = 0;
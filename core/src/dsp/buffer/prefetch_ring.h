@@ -0,0 +1,164 @@
+#pragma once
+#include "buffer.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string.h>
+#include <stdint.h>
+
+// Waiting longer than this for data while streaming counts as an underrun
+#define PREFETCH_RING_UNDERRUN_TIME std::chrono::milliseconds(100)
+
+namespace dsp::buffer {
+    // Single producer, single consumer ring of variable length records. It is used to decouple the thread
+    // reading a socket from the thread converting and pushing the samples into the DSP, so that a stall
+    // downstream doesn't stop the socket from being read. The writer never blocks: if a record doesn't fit
+    // it is dropped and counted as an overrun. The reader blocks until a record is available.
+    class PrefetchRing {
+    public:
+        PrefetchRing() {}
+
+        PrefetchRing(int size) { init(size); }
+
+        ~PrefetchRing() {
+            if (!_init) { return; }
+            buffer::free(buf);
+        }
+
+        void init(int size) {
+            this->size = size;
+            buf = buffer::alloc<uint8_t>(size);
+            _init = true;
+        }
+
+        // Write a record, returns false if it was dropped because the ring is full
+        bool write(const uint8_t* data, int len) {
+            return write(NULL, 0, data, len);
+        }
+
+        // Write a record made of a header and a body without having to concatenate them first
+        bool write(const void* hdr, int hdrLen, const uint8_t* body, int bodyLen) {
+            uint32_t len = hdrLen + bodyLen;
+            uint64_t wpos = writePos.load(std::memory_order_relaxed);
+            uint64_t rpos = readPos.load(std::memory_order_acquire);
+            if (sizeof(uint32_t) + len > size - (wpos - rpos)) {
+                overruns++;
+                return false;
+            }
+
+            copyIn(wpos, (const uint8_t*)&len, sizeof(uint32_t));
+            copyIn(wpos + sizeof(uint32_t), (const uint8_t*)hdr, hdrLen);
+            copyIn(wpos + sizeof(uint32_t) + hdrLen, body, bodyLen);
+            writePos.store(wpos + sizeof(uint32_t) + len, std::memory_order_release);
+
+            // Take the lock so that the notification can't slip between the reader's check and its wait
+            { std::lock_guard<std::mutex> lck(mtx); }
+            cnd.notify_one();
+            return true;
+        }
+
+        // Read the next record, blocking until one is available. Returns the record size or -1 if stopped.
+        // Records longer than maxLen are truncated.
+        int read(uint8_t* data, int maxLen) {
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                if (!readable()) {
+                    auto start = std::chrono::steady_clock::now();
+                    cnd.wait(lck, [this]() { return readable() || _stopReader; });
+                    if (_stopReader) { return -1; }
+                    if (streaming && std::chrono::steady_clock::now() - start > PREFETCH_RING_UNDERRUN_TIME) { underruns++; }
+                }
+                else if (_stopReader) {
+                    return -1;
+                }
+                streaming = true;
+            }
+            return take(data, maxLen);
+        }
+
+        // Read the next record without blocking, eg. to drain the ring once the reader was stopped. Returns the
+        // record size or -1 if the ring is empty.
+        int tryRead(uint8_t* data, int maxLen) {
+            if (!readable()) { return -1; }
+            return take(data, maxLen);
+        }
+
+        void stopReader() {
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                _stopReader = true;
+            }
+            cnd.notify_all();
+        }
+
+        void clearReadStop() {
+            std::lock_guard<std::mutex> lck(mtx);
+            _stopReader = false;
+        }
+
+        // Call when the stream is paused on purpose so that the gap isn't counted as an underrun
+        void pause() {
+            std::lock_guard<std::mutex> lck(mtx);
+            streaming = false;
+        }
+
+        float getFill() {
+            return (float)(writePos.load() - readPos.load()) / (float)size;
+        }
+
+        uint64_t getOverruns() { return overruns; }
+        uint64_t getUnderruns() { return underruns; }
+
+        void clearStats() {
+            overruns = 0;
+            underruns = 0;
+        }
+
+    private:
+        bool readable() {
+            return writePos.load(std::memory_order_acquire) != readPos.load(std::memory_order_relaxed);
+        }
+
+        int take(uint8_t* data, int maxLen) {
+            uint64_t rpos = readPos.load(std::memory_order_relaxed);
+            uint32_t len;
+            copyOut(rpos, (uint8_t*)&len, sizeof(uint32_t));
+            copyOut(rpos + sizeof(uint32_t), data, std::min<int>(len, maxLen));
+            readPos.store(rpos + sizeof(uint32_t) + len, std::memory_order_release);
+            return std::min<int>(len, maxLen);
+        }
+
+        void copyIn(uint64_t pos, const uint8_t* data, int len) {
+            if (!len) { return; }
+            int offset = pos % size;
+            int first = std::min<int>(len, size - offset);
+            memcpy(&buf[offset], data, first);
+            if (first < len) { memcpy(buf, &data[first], len - first); }
+        }
+
+        void copyOut(uint64_t pos, uint8_t* data, int len) {
+            if (!len) { return; }
+            int offset = pos % size;
+            int first = std::min<int>(len, size - offset);
+            memcpy(data, &buf[offset], first);
+            if (first < len) { memcpy(&data[first], buf, len - first); }
+        }
+
+        bool _init = false;
+        uint8_t* buf;
+        uint64_t size = 0;
+
+        // Monotonic positions, only the writer moves writePos and only the reader moves readPos
+        std::atomic<uint64_t> writePos = 0;
+        std::atomic<uint64_t> readPos = 0;
+
+        std::mutex mtx;
+        std::condition_variable cnd;
+        bool _stopReader = false;
+        bool streaming = false;
+
+        std::atomic<uint64_t> overruns = 0;
+        std::atomic<uint64_t> underruns = 0;
+    };
+}
@@ -159,6 +159,15 @@ namespace dsp {
             running = false;
         }
 
+        // Wait until every enabled block has processed what it was given and its output has been read
+        bool waitIdle(std::chrono::milliseconds timeout) {
+            for (auto& ln : links) {
+                if (!states[ln]) { continue; }
+                if (!ln->out.waitIdle(timeout)) { return false; }
+            }
+            return true;
+        }
+
         stream<T>* out;
 
     private:
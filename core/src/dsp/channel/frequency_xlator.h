@@ -20,6 +20,7 @@ namespace dsp::channel {
 
         void init(stream<complex_t>* in, double offset, double samplerate) {
             init(in, math::hzToRads(offset, samplerate));
+            base_type::out.setMetaOffset(-offset);
         }
 
         void setOffset(double offset) {
@@ -30,6 +31,7 @@ namespace dsp::channel {
 
         void setOffset(double offset, double samplerate) {
             setOffset(math::hzToRads(offset, samplerate));
+            base_type::out.setMetaOffset(-offset);
         }
 
         void reset() {
@@ -29,6 +29,8 @@ namespace dsp::channel {
             generateTaps();
             filter.init(NULL, ftaps);
 
+            base_type::out.setMetaRatio(_outSamplerate / _inSamplerate);
+            base_type::out.setMetaOffset(_offset);
             base_type::init(in);
         }
 
@@ -39,6 +41,7 @@ namespace dsp::channel {
             _inSamplerate = inSamplerate;
             xlator.setOffset(-_offset, _inSamplerate);
             resamp.setInSamplerate(_inSamplerate);
+            base_type::out.setMetaRatio(_outSamplerate / _inSamplerate);
             base_type::tempStart();
         }
 
@@ -50,6 +53,7 @@ namespace dsp::channel {
             _bandwidth = bandwidth;
             filterNeeded = (_bandwidth != _outSamplerate);
             resamp.setOutSamplerate(_outSamplerate);
+            base_type::out.setMetaRatio(_outSamplerate / _inSamplerate);
             if (filterNeeded) {
                 generateTaps();
                 filter.setTaps(ftaps);
@@ -74,6 +78,7 @@ namespace dsp::channel {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _offset = offset;
             xlator.setOffset(-_offset, _inSamplerate);
+            base_type::out.setMetaOffset(_offset);
         }
 
         void reset() {
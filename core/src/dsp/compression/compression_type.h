@@ -0,0 +1,10 @@
+#pragma once
+
+namespace dsp::compression {
+    // Lossless filter applied to the samples to make them easier to compress by a general purpose compressor
+    enum CompressionType {
+        COMPRESSION_TYPE_NONE,
+        COMPRESSION_TYPE_SHUFFLE,
+        COMPRESSION_TYPE_DELTA_SHUFFLE
+    };
+}
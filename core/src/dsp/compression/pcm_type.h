@@ -1,9 +1,18 @@
 #pragma once
 
+// Number of complex samples sharing a single exponent in block floating point mode
+#define PCM_BFP_BLOCK_SIZE  256
+
+// Range of the block exponents. Below the minimum the 128 * 2^-exp scale of the mantissas would overflow
+// a float, blocks with smaller peaks are encoded at the minimum exponent and come out as zero.
+#define PCM_BFP_MIN_EXPONENT    -120
+#define PCM_BFP_MAX_EXPONENT    127
+
 namespace dsp::compression {
     enum PCMType {
         PCM_TYPE_I8,
         PCM_TYPE_I16,
-        PCM_TYPE_F32
+        PCM_TYPE_F32,
+        PCM_TYPE_BFP_I8
     };
-}
\ No newline at end of file
+}
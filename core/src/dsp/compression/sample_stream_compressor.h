@@ -1,6 +1,9 @@
 #pragma once
+#include <math.h>
 #include "../processor.h"
 #include "pcm_type.h"
+#include "compression_type.h"
+#include "shuffle.h"
 
 namespace dsp::compression {
     class SampleStreamCompressor : public Processor<complex_t, uint8_t> {
@@ -8,10 +11,18 @@ namespace dsp::compression {
     public:
         SampleStreamCompressor() {}
 
-        SampleStreamCompressor(stream<complex_t>* in, PCMType pcmType) { init(in, pcmType); }
+        SampleStreamCompressor(stream<complex_t>* in, PCMType pcmType, CompressionType compressionType = COMPRESSION_TYPE_NONE) { init(in, pcmType, compressionType); }
 
-        void init(stream<complex_t>* in, PCMType pcmType) {
+        ~SampleStreamCompressor() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(scratch);
+        }
+
+        void init(stream<complex_t>* in, PCMType pcmType, CompressionType compressionType = COMPRESSION_TYPE_NONE) {
             _pcmType = pcmType;
+            _compressionType = compressionType;
+            scratch = buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * 2);
             base_type::init(in);
         }
 
@@ -23,47 +34,120 @@ namespace dsp::compression {
             base_type::tempStart();
         }
 
-        inline static int process(int count, PCMType pcmType, const complex_t* in, uint8_t* out) {
+        // The requested type is an upper bound, delta coding is only used on buffers where it helps
+        void setCompressionType(CompressionType compressionType) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _compressionType = compressionType;
+            base_type::tempStart();
+        }
+
+        // The scratch buffer must be able to hold count * 2 int16 values if a compression type is used
+        inline static int process(int count, PCMType pcmType, CompressionType compType, const complex_t* in, uint8_t* out, int16_t* scratch) {
             uint16_t* compressionType = (uint16_t*)out;
             uint16_t* sampleType = (uint16_t*)&out[2];
             float* scaler = (float*)&out[4];
             void* dataBuf = &out[8];
 
             // Write options and leave blank space for compression
-            *compressionType = 0;
+            *compressionType = COMPRESSION_TYPE_NONE;
             *sampleType = pcmType;
 
             // If type is float32, no compression is needed
             if (pcmType == PCMType::PCM_TYPE_F32) {
                 *scaler = 0;
-                memcpy(dataBuf, in, count * sizeof(complex_t));
+                if (compType != COMPRESSION_TYPE_NONE) {
+                    *compressionType = COMPRESSION_TYPE_SHUFFLE;
+                    shuffle::encode32((const uint8_t*)in, (uint8_t*)dataBuf, count * 2);
+                }
+                else {
+                    memcpy(dataBuf, in, count * sizeof(complex_t));
+                }
                 return 8 + (count * sizeof(complex_t));
             }
 
+            // Block floating point stores one exponent per block followed by all the mantissas.
+            // The scaler field holds the sample count instead since it can't be inferred from the size.
+            if (pcmType == PCMType::PCM_TYPE_BFP_I8) {
+                int blockCount = (count + PCM_BFP_BLOCK_SIZE - 1) / PCM_BFP_BLOCK_SIZE;
+                int8_t* exponents = (int8_t*)dataBuf;
+                int8_t* mantissas = &exponents[blockCount];
+                *(uint32_t*)scaler = count;
+                for (int i = 0; i < blockCount; i++) {
+                    int offset = i * PCM_BFP_BLOCK_SIZE;
+                    int len = std::min<int>(PCM_BFP_BLOCK_SIZE, count - offset);
+                    int exp = blockExponent(findPeak(&in[offset], len));
+                    exponents[i] = exp;
+                    volk_32f_s32f_convert_8i(&mantissas[offset * 2], (const float*)&in[offset], ldexpf(128.0f, -exp), len * 2);
+                }
+                *compressionType = filter8(compType, mantissas, count * 2);
+                return 8 + blockCount + (count * sizeof(int8_t) * 2);
+            }
+
             // Find maximum value
-            uint32_t maxIdx;
-            volk_32f_index_max_32u(&maxIdx, (float*)in, count * 2);
-            float maxVal = ((float*)in)[maxIdx];
+            float maxVal = findPeak(in, count);
             *scaler = maxVal;
 
             // Convert to the right type and send it out (sign bit determines pcm type)
             if (pcmType == PCMType::PCM_TYPE_I8) {
                 volk_32f_s32f_convert_8i((int8_t*)dataBuf, (float*)in, 128.0f / maxVal, count * 2);
+                *compressionType = filter8(compType, (int8_t*)dataBuf, count * 2);
                 return 8 + (count * sizeof(int8_t) * 2);
             }
             else if (pcmType == PCMType::PCM_TYPE_I16) {
-                volk_32f_s32f_convert_16i((int16_t*)dataBuf, (float*)in, 32768.0f / maxVal, count * 2);
+                if (compType == COMPRESSION_TYPE_NONE) {
+                    volk_32f_s32f_convert_16i((int16_t*)dataBuf, (float*)in, 32768.0f / maxVal, count * 2);
+                    return 8 + (count * sizeof(int16_t) * 2);
+                }
+
+                // Byte planes can't be created in place, go through the scratch buffer
+                volk_32f_s32f_convert_16i(scratch, (float*)in, 32768.0f / maxVal, count * 2);
+                if (compType == COMPRESSION_TYPE_DELTA_SHUFFLE && shuffle::deltaImproves(scratch, count * 2)) {
+                    *compressionType = COMPRESSION_TYPE_DELTA_SHUFFLE;
+                    shuffle::encode16<true>(scratch, (uint8_t*)dataBuf, count * 2);
+                }
+                else {
+                    *compressionType = COMPRESSION_TYPE_SHUFFLE;
+                    shuffle::encode16<false>(scratch, (uint8_t*)dataBuf, count * 2);
+                }
                 return 8 + (count * sizeof(int16_t) * 2);
             }
 
             return count;
         }
 
+        // Byte sized values have no planes to split, only delta coding can be applied
+        inline static CompressionType filter8(CompressionType compType, int8_t* data, int count) {
+            if (compType != COMPRESSION_TYPE_DELTA_SHUFFLE || !shuffle::deltaImproves(data, count)) {
+                return COMPRESSION_TYPE_NONE;
+            }
+            shuffle::delta(data, count);
+            return COMPRESSION_TYPE_DELTA_SHUFFLE;
+        }
+
+        // Returns the largest amplitude in the buffer. The magnitude is used so that the scaler is
+        // always positive and bounds both components of every sample.
+        inline static float findPeak(const complex_t* in, int count) {
+            uint32_t maxIdx;
+            volk_32fc_index_max_32u(&maxIdx, (lv_32fc_t*)in, count);
+            complex_t peakSamp = in[maxIdx];
+            float peak = peakSamp.amplitude();
+            return (peak > 0.0f) ? peak : 1.0f;
+        }
+
+        // Returns the smallest power of two exponent above the peak, clamped so that the mantissa scale stays finite
+        inline static int blockExponent(float peak) {
+            int exp;
+            frexpf(peak, &exp);
+            return std::clamp<int>(exp, PCM_BFP_MIN_EXPONENT, PCM_BFP_MAX_EXPONENT);
+        }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, _pcmType, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount = process(count, _pcmType, _compressionType, base_type::_in->readBuf, base_type::out.writeBuf, scratch);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -75,5 +159,7 @@ namespace dsp::compression {
 
     protected:
         PCMType _pcmType;
+        CompressionType _compressionType;
+        int16_t* scratch;
     };
 }
\ No newline at end of file
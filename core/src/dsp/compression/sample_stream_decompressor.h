@@ -1,6 +1,9 @@
 #pragma once
+#include <math.h>
 #include "../processor.h"
 #include "pcm_type.h"
+#include "compression_type.h"
+#include "shuffle.h"
 
 namespace dsp::compression {
     class SampleStreamDecompressor : public Processor<uint8_t, complex_t> {
@@ -8,36 +11,91 @@ namespace dsp::compression {
     public:
         SampleStreamDecompressor() {}
 
-        SampleStreamDecompressor(stream<uint8_t>* in) { base_type::init(in); }
+        SampleStreamDecompressor(stream<uint8_t>* in) { init(in); }
 
-        inline int process(int count, const uint8_t* in, complex_t* out) {
+        ~SampleStreamDecompressor() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(scratch);
+        }
+
+        void init(stream<uint8_t>* in) {
+            scratch = buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * 2);
+            base_type::init(in);
+        }
+
+        // The scratch buffer must be able to hold count int16 values if a compression type is used
+        inline static int process(int count, const uint8_t* in, complex_t* out, int16_t* scratch) {
+            // Too short to even hold the header
+            if (count < 8) { return 0; }
+            uint16_t compressionType = *(uint16_t*)in;
             uint16_t sampleType = *(uint16_t*)&in[2];
             float scaler = *(float*)&in[4];
             const void* dataBuf = &in[8];
 
             if (sampleType == PCMType::PCM_TYPE_F32) {
-                memcpy(out, dataBuf, count - 8);
+                if (compressionType != COMPRESSION_TYPE_NONE) {
+                    shuffle::decode32((const uint8_t*)dataBuf, (uint8_t*)out, ((count - 8) / sizeof(complex_t)) * 2);
+                }
+                else {
+                    memcpy(out, dataBuf, count - 8);
+                }
                 return (count - 8) / sizeof(complex_t);
             }
             else if (sampleType == PCMType::PCM_TYPE_I16) {
                 int outCount = (count - 8) / (sizeof(int16_t) * 2);
-                volk_16i_s32f_convert_32f((float*)out, (int16_t*)dataBuf, 32768.0f / scaler, outCount * 2);
+                const int16_t* samples = (const int16_t*)dataBuf;
+                if (compressionType == COMPRESSION_TYPE_DELTA_SHUFFLE) {
+                    shuffle::decode16<true>((const uint8_t*)dataBuf, scratch, outCount * 2);
+                    samples = scratch;
+                }
+                else if (compressionType == COMPRESSION_TYPE_SHUFFLE) {
+                    shuffle::decode16<false>((const uint8_t*)dataBuf, scratch, outCount * 2);
+                    samples = scratch;
+                }
+                volk_16i_s32f_convert_32f((float*)out, samples, 32768.0f / scaler, outCount * 2);
                 return outCount;
             }
             else if (sampleType == PCMType::PCM_TYPE_I8) {
                 int outCount = (count - 8) / (sizeof(int8_t) * 2);
-                volk_8i_s32f_convert_32f((float*)out, (int8_t*)dataBuf, 128.0f / scaler, outCount * 2);
+                const int8_t* samples = decode8(compressionType, (const int8_t*)dataBuf, outCount * 2, scratch);
+                volk_8i_s32f_convert_32f((float*)out, samples, 128.0f / scaler, outCount * 2);
+                return outCount;
+            }
+            else if (sampleType == PCMType::PCM_TYPE_BFP_I8) {
+                // Sample count is stored in place of the scaler. The packet may come from the network as is, so the
+                // count is checked against the size in 64 bits before anything is derived from it.
+                int64_t rawCount = *(uint32_t*)&in[4];
+                if (rawCount <= 0 || rawCount > (count - 8) / 2) { return 0; }
+                int outCount = rawCount;
+                int blockCount = (outCount + PCM_BFP_BLOCK_SIZE - 1) / PCM_BFP_BLOCK_SIZE;
+                if (8 + (int64_t)blockCount + ((int64_t)outCount * 2) > count) { return 0; }
+
+                const int8_t* exponents = (const int8_t*)dataBuf;
+                const int8_t* mantissas = decode8(compressionType, &exponents[blockCount], outCount * 2, scratch);
+                for (int i = 0; i < blockCount; i++) {
+                    int offset = i * PCM_BFP_BLOCK_SIZE;
+                    int len = std::min<int>(PCM_BFP_BLOCK_SIZE, outCount - offset);
+                    int exp = std::max<int>(exponents[i], PCM_BFP_MIN_EXPONENT);
+                    volk_8i_s32f_convert_32f((float*)&out[offset], &mantissas[offset * 2], ldexpf(128.0f, -exp), len * 2);
+                }
                 return outCount;
             }
             
             return 0;
         }
 
+        inline static const int8_t* decode8(uint16_t compressionType, const int8_t* in, int count, int16_t* scratch) {
+            if (compressionType != COMPRESSION_TYPE_DELTA_SHUFFLE) { return in; }
+            shuffle::undelta(in, (int8_t*)scratch, count);
+            return (const int8_t*)scratch;
+        }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf, scratch);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -46,5 +104,8 @@ namespace dsp::compression {
             }
             return outCount;
         }
+
+    protected:
+        int16_t* scratch;
     };
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+
+// Number of values inspected to decide if delta coding is worth it
+#define SHUFFLE_DELTA_PROBE_SIZE    4096
+
+namespace dsp::compression::shuffle {
+    // Map signed values to unsigned ones so that small magnitudes of either sign have a null upper byte
+    inline uint16_t zigzag(int16_t val) {
+        return ((uint16_t)val << 1) ^ (uint16_t)(val >> 15);
+    }
+
+    inline int16_t unzigzag(uint16_t val) {
+        return (int16_t)((val >> 1) ^ (uint16_t)(-(int16_t)(val & 1)));
+    }
+
+    // Check on the beginning of an interleaved IQ buffer if the per-channel delta is smaller than the raw values
+    template <class T>
+    inline bool deltaImproves(const T* in, int count) {
+        int len = std::min<int>(count, SHUFFLE_DELTA_PROBE_SIZE);
+        int64_t raw = 0;
+        int64_t diff = 0;
+        for (int i = 2; i < len; i++) {
+            raw += abs((int)in[i]);
+            diff += abs((int)in[i] - (int)in[i - 2]);
+        }
+        return diff < raw;
+    }
+
+    // Replace interleaved IQ values by their difference with the previous value of the same channel, in place
+    template <class T>
+    inline void delta(T* data, int count) {
+        for (int i = count - 1; i >= 2; i--) {
+            data[i] -= data[i - 2];
+        }
+    }
+
+    template <class T>
+    inline void undelta(const T* in, T* out, int count) {
+        T accI = 0;
+        T accQ = 0;
+        for (int i = 0; i < count; i += 2) {
+            accI += in[i];
+            accQ += in[i + 1];
+            out[i] = accI;
+            out[i + 1] = accQ;
+        }
+    }
+
+    // Zigzag code and split int16 values into a plane of low bytes followed by a plane of high bytes
+    template <bool DELTA>
+    inline void encode16(const int16_t* in, uint8_t* out, int count) {
+        uint8_t* lo = out;
+        uint8_t* hi = &out[count];
+        int16_t prevI = 0;
+        int16_t prevQ = 0;
+        for (int i = 0; i < count; i += 2) {
+            uint16_t zi = zigzag(in[i] - prevI);
+            uint16_t zq = zigzag(in[i + 1] - prevQ);
+            lo[i] = zi;
+            lo[i + 1] = zq;
+            hi[i] = zi >> 8;
+            hi[i + 1] = zq >> 8;
+            if constexpr (DELTA) {
+                prevI = in[i];
+                prevQ = in[i + 1];
+            }
+        }
+    }
+
+    template <bool DELTA>
+    inline void decode16(const uint8_t* in, int16_t* out, int count) {
+        // Kept separate from the delta pass so that the compiler can vectorise it
+        const uint8_t* lo = in;
+        const uint8_t* hi = &in[count];
+        for (int i = 0; i < count; i++) {
+            out[i] = unzigzag(lo[i] | (hi[i] << 8));
+        }
+        if constexpr (DELTA) { undelta(out, out, count); }
+    }
+
+    // Split 32bit values into four byte planes, sign and exponent bytes end up together
+    inline void encode32(const uint8_t* in, uint8_t* out, int count) {
+        for (int i = 0; i < count; i++) {
+            out[i] = in[4 * i];
+            out[count + i] = in[4 * i + 1];
+            out[2 * count + i] = in[4 * i + 2];
+            out[3 * count + i] = in[4 * i + 3];
+        }
+    }
+
+    inline void decode32(const uint8_t* in, uint8_t* out, int count) {
+        for (int i = 0; i < count; i++) {
+            out[4 * i] = in[i];
+            out[4 * i + 1] = in[count + i];
+            out[4 * i + 2] = in[2 * count + i];
+            out[4 * i + 3] = in[3 * count + i];
+        }
+    }
+}
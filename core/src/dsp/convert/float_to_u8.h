@@ -0,0 +1,20 @@
+#pragma once
+#include <volk/volk.h>
+#include <stdint.h>
+
+namespace dsp::convert {
+    // Converts values in the -1 to 1 range to unsigned 8bit centered on 128, as stored in 8bit WAV files.
+    // This is not a block since writers convert straight into their output buffer.
+    class FloatToU8 {
+    public:
+        inline static int process(int count, const float* in, uint8_t* out) {
+            // Volk has no unsigned conversion, but flipping the sign bit of a saturated signed conversion is the
+            // same as adding 128. The flip is a flat loop the compiler turns into SIMD.
+            volk_32f_s32f_convert_8i((int8_t*)out, in, 127.0f, count);
+            for (int i = 0; i < count; i++) {
+                out[i] ^= 0x80;
+            }
+            return count;
+        }
+    };
+}
@@ -149,8 +149,8 @@ namespace dsp::demod {
         double _samplerate;
         double _bandwidth;
 
-        loop::AGC<complex_t> carrierAgc;
-        loop::AGC<float> audioAgc;
+        loop::AGC<complex_t, true> carrierAgc;
+        loop::AGC<float, true> audioAgc;
         correction::DCBlocker<float> dcBlock;
         tap<float> lpfTaps;
         filter::FIR<float, float> lpf;
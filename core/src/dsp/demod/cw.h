@@ -84,7 +84,7 @@ namespace dsp::demod {
         double _samplerate;
 
         dsp::channel::FrequencyXlator xlator;
-        dsp::loop::AGC<float> agc;
+        dsp::loop::AGC<float, true> agc;
 
     };
 }
\ No newline at end of file
@@ -74,6 +74,14 @@ namespace dsp::demod {
             updateFilter(_lowPass, highPass);
         }
 
+        void setAccuracy(Quadrature::Accuracy accuracy) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            demod.setAccuracy(accuracy);
+            base_type::tempStart();
+        }
+
         void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
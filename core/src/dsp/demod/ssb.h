@@ -119,7 +119,7 @@ namespace dsp::demod {
         double _bandwidth;
         double _samplerate;
         channel::FrequencyXlator xlator;
-        loop::AGC<float> agc;
+        loop::AGC<float, true> agc;
 
     };
 };
\ No newline at end of file
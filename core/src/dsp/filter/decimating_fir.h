@@ -12,6 +12,7 @@ namespace dsp::filter {
 
         void init(stream<D>* in, tap<T>& taps, int decimation) {
             _decimation = decimation;
+            base_type::out.setMetaRatio(1.0 / (double)_decimation);
             base_type::init(in, taps);
         }
 
@@ -29,6 +30,7 @@ namespace dsp::filter {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _decimation = decimation;
+            base_type::out.setMetaRatio(1.0 / (double)_decimation);
             offset = 0;
             base_type::tempStart();
         }
@@ -1,8 +1,20 @@
 #pragma once
 #include "../processor.h"
 
+// Longest run of samples the block AGC updates the average amplitude over, and the number of SIMD lanes it
+// splits the runs in. The runs get shorter when the attack or decay is fast enough for the amplitude to move
+// by more than AGC_BLOCK_MAX_STEP of the difference over one.
+#define AGC_BLOCK_SIZE      32
+#define AGC_BLOCK_LANES     8
+#define AGC_BLOCK_MAX_STEP  0.05f
+
 namespace dsp::loop {
-    template <class T>
+    // With BLOCK set, the envelope, the gain and the output are computed over whole buffers with SIMD kernels.
+    // The average amplitude is then updated once per run of up to AGC_BLOCK_SIZE samples with the sum of the
+    // attack/decay steps of the run, the gain is ramped between runs and the look-ahead for clipping uses the
+    // peaks of the runs. This stays within a fraction of a dB of the per-sample AGC for the time constants used
+    // by the demodulators, and falls back to it for faster ones.
+    template <class T, bool BLOCK = false>
     class AGC : public Processor<T, T> {
         using base_type = Processor<T, T>;
     public:
@@ -10,6 +22,16 @@ namespace dsp::loop {
 
         AGC(stream<T>* in, double setPoint, double attack, double decay, double maxGain, double maxOutputAmp, double initGain = 1.0) { init(in, setPoint, attack, decay, maxGain, maxOutputAmp, initGain); }
 
+        ~AGC() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            if constexpr (BLOCK) {
+                buffer::free(env);
+                buffer::free(gains);
+                buffer::free(peaks);
+            }
+        }
+
         void init(stream<T>* in, double setPoint, double attack, double decay, double maxGain, double maxOutputAmp, double initGain = 1.0) {
             _setPoint = setPoint;
             _attack = attack;
@@ -20,6 +42,13 @@ namespace dsp::loop {
             _maxOutputAmp = maxOutputAmp;
             _initGain = initGain;
             amp = _setPoint / _initGain;
+            if constexpr (BLOCK) {
+                env = buffer::alloc<float>(STREAM_BUFFER_SIZE);
+                gains = buffer::alloc<float>(STREAM_BUFFER_SIZE);
+                peaks = buffer::alloc<float>(2 * (STREAM_BUFFER_SIZE / AGC_BLOCK_LANES + 1));
+                gain = std::min<float>(_setPoint / amp, _maxGain);
+                updateRunLength();
+            }
             base_type::init(in);
         }
 
@@ -34,6 +63,7 @@ namespace dsp::loop {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _attack = attack;
             _invAttack = 1.0f - _attack;
+            if constexpr (BLOCK) { updateRunLength(); }
         }
 
         void setDecay(double decay) {
@@ -41,6 +71,7 @@ namespace dsp::loop {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _decay = decay;
             _invDecay = 1.0f - _decay;
+            if constexpr (BLOCK) { updateRunLength(); }
         }
 
         void setMaxGain(double maxGain) {
@@ -65,9 +96,29 @@ namespace dsp::loop {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             amp = _setPoint / _initGain;
+            gain = std::min<float>(_setPoint / amp, _maxGain);
         }
 
         inline int process(int count, T* in, T* out) {
+            if constexpr (BLOCK) {
+                if (runLength) { return processBlock(count, in, out); }
+            }
+            return processSamples(count, in, out);
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+            base_type::_in->flush();
+            if (!base_type::out.swap(count)) { return -1; }
+            return count;
+        }
+
+    protected:
+        inline int processSamples(int count, T* in, T* out) {
             for (int i = 0; i < count; i++) {
                 // Get signal amplitude
                 float inAmp, gain;
@@ -109,18 +160,102 @@ namespace dsp::loop {
             return count;
         }
 
-        int run() {
-            int count = base_type::_in->read();
-            if (count < 0) { return -1; }
+        inline int processBlock(int count, T* in, T* out) {
+            if (count <= 0) { return count; }
 
-            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            // Get the envelope of the whole buffer before anything is written, the output can be the input
+            if constexpr (std::is_same_v<T, complex_t>) {
+                volk_32fc_magnitude_32f(env, (lv_32fc_t*)in, count);
+            }
+            if constexpr (std::is_same_v<T, float>) {
+                for (int i = 0; i < count; i++) { env[i] = fabsf(in[i]); }
+            }
 
-            base_type::_in->flush();
-            if (!base_type::out.swap(count)) { return -1; }
+            // Peak of each run, then the peak of everything from each run to the end for the look-ahead
+            int runs = (count + runLength - 1) / runLength;
+            float* ahead = &peaks[runs];
+            for (int k = 0; k < runs; k++) {
+                int start = k * runLength;
+                int n = std::min<int>(runLength, count - start);
+                peaks[k] = runPeak(&env[start], n);
+            }
+            ahead[runs - 1] = peaks[runs - 1];
+            for (int k = runs - 2; k >= 0; k--) { ahead[k] = std::max<float>(peaks[k], ahead[k + 1]); }
+
+            // Update the average amplitude once per run and ramp the gain from the previous run to this one
+            float lastGain = gain;
+            for (int k = 0; k < runs; k++) {
+                int start = k * runLength;
+                int n = std::min<int>(runLength, count - start);
+                amp += runStep(&env[start], n);
+                gain = std::min<float>(_setPoint / amp, _maxGain);
+
+                // If clipping is detected, hold the gain that fits the loudest sample to come in the buffer
+                if (peaks[k] * std::max<float>(gain, lastGain) > _maxOutputAmp) {
+                    amp = ahead[k];
+                    gain = std::min<float>(_setPoint / amp, _maxGain);
+                    for (int i = 0; i < n; i++) { gains[start + i] = gain; }
+                }
+                else {
+                    float slope = (gain - lastGain) / (float)n;
+                    for (int i = 0; i < n; i++) { gains[start + i] = lastGain + slope * (float)(i + 1); }
+                }
+                lastGain = gain;
+            }
+
+            // Scale output by gain
+            if constexpr (std::is_same_v<T, complex_t>) {
+                volk_32fc_32f_multiply_32fc((lv_32fc_t*)out, (lv_32fc_t*)in, gains, count);
+            }
+            if constexpr (std::is_same_v<T, float>) {
+                volk_32f_x2_multiply_32f(out, in, gains, count);
+            }
             return count;
         }
 
-    protected:
+        // Sum of the attack/decay steps of a run, with the average amplitude taken as constant over it. The lanes
+        // let the compiler vectorize the sum without reordering floating point additions itself.
+        inline float runStep(const float* e, int n) {
+            float lanes[AGC_BLOCK_LANES] = {};
+            int i = 0;
+            for (; i + AGC_BLOCK_LANES <= n; i += AGC_BLOCK_LANES) {
+                for (int l = 0; l < AGC_BLOCK_LANES; l++) {
+                    float d = e[i + l] - amp;
+                    float step = (d > 0.0f) ? d * _attack : d * _decay;
+                    lanes[l] += (e[i + l] != 0.0f) ? step : 0.0f;
+                }
+            }
+            float sum = 0.0f;
+            for (; i < n; i++) {
+                float d = e[i] - amp;
+                float step = (d > 0.0f) ? d * _attack : d * _decay;
+                sum += (e[i] != 0.0f) ? step : 0.0f;
+            }
+            for (int l = 0; l < AGC_BLOCK_LANES; l++) { sum += lanes[l]; }
+            return sum;
+        }
+
+        inline float runPeak(const float* e, int n) {
+            float lanes[AGC_BLOCK_LANES] = {};
+            int i = 0;
+            for (; i + AGC_BLOCK_LANES <= n; i += AGC_BLOCK_LANES) {
+                for (int l = 0; l < AGC_BLOCK_LANES; l++) { lanes[l] = (e[i + l] > lanes[l]) ? e[i + l] : lanes[l]; }
+            }
+            float peak = 0.0f;
+            for (; i < n; i++) { peak = std::max<float>(peak, e[i]); }
+            for (int l = 0; l < AGC_BLOCK_LANES; l++) { peak = std::max<float>(peak, lanes[l]); }
+            return peak;
+        }
+
+        // Longest run over which the average amplitude can be taken as constant, zero if even a run of one lane
+        // is too long and the per-sample AGC must be used
+        void updateRunLength() {
+            float fastest = std::max<float>(_attack, _decay);
+            int len = (fastest > 0.0f) ? (int)(AGC_BLOCK_MAX_STEP / fastest) : AGC_BLOCK_SIZE;
+            len = std::min<int>(len, AGC_BLOCK_SIZE) & ~(AGC_BLOCK_LANES - 1);
+            runLength = len;
+        }
+
         float _setPoint;
         float _attack;
         float _invAttack;
@@ -132,5 +267,11 @@ namespace dsp::loop {
 
         float amp = 1.0;
 
+        // Block processing state
+        float gain = 1.0f;
+        int runLength = 0;
+        float* env = NULL;
+        float* gains = NULL;
+        float* peaks = NULL;
     };
 }
\ No newline at end of file
@@ -32,6 +32,7 @@ namespace dsp::multirate {
             bufStart = &buffer[phases.tapsPerPhase - 1];
             buffer::clear<T>(buffer, phases.tapsPerPhase - 1);
 
+            base_type::out.setMetaRatio((double)_interp / (double)_decim);
             base_type::init(in);
         }
 
@@ -44,6 +45,7 @@ namespace dsp::multirate {
             _interp = interp;
             _decim = decim;
             _taps = taps;
+            base_type::out.setMetaRatio((double)_interp / (double)_decim);
 
             // Re-generate polyphase bank
             freePolyphaseBank(phases);
@@ -89,6 +89,8 @@ namespace dsp::multirate {
         }
 
         void reconfigure() {
+            base_type::out.setMetaRatio(1.0 / (double)_ratio);
+
             // Delete DDC FIRs and taps
             freeFirs();
 
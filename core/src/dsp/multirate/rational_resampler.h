@@ -118,6 +118,8 @@ namespace dsp::multirate {
         };
 
         void reconfigure() {
+            base_type::out.setMetaRatio(_outSamplerate / _inSamplerate);
+
             // Calculate highest power-of-two decimation for the power decimator 
             int predecPower = std::min<int>(floor(log2(_inSamplerate / _outSamplerate)), PowerDecimator<T>::getMaxRatio());
             int predecRatio = std::min<int>(1 << predecPower, PowerDecimator<T>::getMaxRatio());
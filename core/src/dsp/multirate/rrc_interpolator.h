@@ -73,6 +73,8 @@ namespace dsp::multirate {
 
     private:
         void genTaps() {
+            base_type::out.setMetaRatio(_samplerate / _symbolrate);
+
             // Free current taps if they exist
             taps::free(rrcTaps);
 
@@ -1,18 +1,53 @@
 #pragma once
 #include "../processor.h"
+#include <string.h>
+
+// Longest run of samples the average power is updated over, and the number of SIMD lanes it is split in
+#define NOISE_BLANKER_BLOCK_SIZE    32
+#define NOISE_BLANKER_BLOCK_LANES   8
+
+// Longest look-ahead and hang, in samples
+#define NOISE_BLANKER_MAX_WINDOW    64
+
+// Power, relative to the average, above which samples are clamped before entering the average. High enough
+// that clamping noise alone doesn't bias the average down.
+#define NOISE_BLANKER_AVG_CLAMP     16.0f
+
+// Level below which samples are scaled down to the average instead of blanked, since noise alone crosses
+// the threshold too often there (exp(-level^2) of the samples)
+#define NOISE_BLANKER_SOFT_LEVEL    3.0f
 
 namespace dsp::noise_reduction {
+    // Blanks impulses whose amplitude is more than level times the average. The comparison is done on the power
+    // so that no square root is needed, and the average power is updated once per run of samples from the sum of
+    // the run, with the impulses clamped so they don't raise it. Samples from lookAhead before an impulse to hang
+    // after it are zeroed, for which the output is delayed by lookAhead samples. At low levels the samples above
+    // the threshold are only scaled down to the average amplitude, so that noise alone still passes through.
     class NoiseBlanker : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
     public:
         NoiseBlanker() {}
 
-        NoiseBlanker(stream<complex_t>* in, double rate, double level) { init(in, rate, level); }
+        NoiseBlanker(stream<complex_t>* in, double rate, double level, int lookAhead = 1, int hang = 2) { init(in, rate, level, lookAhead, hang); }
 
-        void init(stream<complex_t>* in, double rate, double level) {
+        ~NoiseBlanker() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(work);
+            buffer::free(gains);
+            buffer::free(power);
+        }
+
+        void init(stream<complex_t>* in, double rate, double level, int lookAhead = 1, int hang = 2) {
             _rate = rate;
-            _invRate = 1.0f - _rate;
             _level = level;
+            _lookAhead = std::clamp<int>(lookAhead, 0, NOISE_BLANKER_MAX_WINDOW);
+            _hang = std::clamp<int>(hang, 0, NOISE_BLANKER_MAX_WINDOW);
+            runRate = runCoef(NOISE_BLANKER_BLOCK_SIZE);
+            work = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + NOISE_BLANKER_MAX_WINDOW);
+            gains = buffer::alloc<float>(STREAM_BUFFER_SIZE + NOISE_BLANKER_MAX_WINDOW);
+            power = buffer::alloc<float>(STREAM_BUFFER_SIZE);
+            clearWindow();
             base_type::init(in);
         }
 
@@ -20,7 +55,7 @@ namespace dsp::noise_reduction {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _rate = rate;
-            _invRate = 1.0f - _rate;
+            runRate = runCoef(NOISE_BLANKER_BLOCK_SIZE);
         }
 
         void setLevel(double level) {
@@ -29,30 +64,65 @@ namespace dsp::noise_reduction {
             _level = level;
         }
 
+        // Number of samples blanked before and after each impulse. Changing the look-ahead changes the delay.
+        void setWindow(int lookAhead, int hang) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _lookAhead = std::clamp<int>(lookAhead, 0, NOISE_BLANKER_MAX_WINDOW);
+            _hang = std::clamp<int>(hang, 0, NOISE_BLANKER_MAX_WINDOW);
+            clearWindow();
+            base_type::tempStart();
+        }
+
         void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            amp = 1.0f;
+            base_type::tempStop();
+            avgPower = 0.0f;
+            clearWindow();
+            base_type::tempStart();
         }
 
         inline int process(int count, complex_t* in, complex_t* out) {
-            for (int i = 0; i < count; i++) {
-                // Get signal amplitude
-                float inAmp = in[i].amplitude();
-
-                // Update average amplitude
-                float gain = 1.0f;
-                if (inAmp != 0.0f) {
-                    amp = (amp * _invRate) + (inAmp * _rate);
-                    float excess = inAmp / amp;
-                    if (excess > _level) {
-                        gain = 1.0f / excess;
+            // Append the samples to the ones held back for the look-ahead, they all start unblanked
+            memcpy(&work[_lookAhead], in, count * sizeof(complex_t));
+            for (int i = 0; i < count; i++) { gains[_lookAhead + i] = 1.0f; }
+            volk_32fc_magnitude_squared_32f(power, (lv_32fc_t*)in, count);
+
+            // Finish the hang of an impulse at the end of the previous buffer
+            int carried = std::min<int>(hangLeft, count);
+            for (int i = 0; i < carried; i++) { gains[_lookAhead + i] = 0.0f; }
+            hangLeft -= carried;
+
+            float level2 = _level * _level;
+            for (int start = 0; start < count; start += NOISE_BLANKER_BLOCK_SIZE) {
+                int n = std::min<int>(NOISE_BLANKER_BLOCK_SIZE, count - start);
+                const float* p = &power[start];
+
+                // Start from the average of the first run when there is no average yet
+                if (avgPower <= 0.0f) { avgPower = runSum(p, n, INFINITY) / (float)n; }
+
+                // Blank around the samples above the threshold, which is rare enough to do with a branch
+                float threshold = level2 * avgPower;
+                if (runPeak(p, n) > threshold) {
+                    for (int i = 0; i < n; i++) {
+                        if (p[i] <= threshold) { continue; }
+                        if (_level < NOISE_BLANKER_SOFT_LEVEL) { scale(start + i, p[i]); }
+                        else { blank(start + i, count); }
                     }
                 }
-                
-                // Scale output by gain
-                out[i] = in[i] * gain;
+
+                // Update the average with the impulses clamped well above the average
+                float coef = (n == NOISE_BLANKER_BLOCK_SIZE) ? runRate : runCoef(n);
+                float clamp = std::max<float>(threshold, NOISE_BLANKER_AVG_CLAMP * avgPower);
+                avgPower += coef * (runSum(p, n, clamp) / (float)n - avgPower);
             }
+
+            // Output the oldest samples and hold back the newest for the next look-ahead
+            volk_32fc_32f_multiply_32fc((lv_32fc_t*)out, (lv_32fc_t*)work, gains, count);
+            memmove(work, &work[count], _lookAhead * sizeof(complex_t));
+            memmove(gains, &gains[count], _lookAhead * sizeof(float));
             return count;
         }
 
@@ -68,11 +138,65 @@ namespace dsp::noise_reduction {
         }
 
     protected:
+        // Zero the window around the impulse at the given new sample, the part past the buffer is carried over
+        inline void blank(int i, int count) {
+            int end = std::min<int>(i + _lookAhead + _hang, _lookAhead + count - 1);
+            for (int j = i; j <= end; j++) { gains[j] = 0.0f; }
+            hangLeft = std::max<int>(hangLeft, i + _lookAhead + _hang - end);
+        }
+
+        // Scale the given new sample down to the average amplitude, unless it is already blanked
+        inline void scale(int i, float p) {
+            float& gain = gains[_lookAhead + i];
+            gain = std::min<float>(gain, sqrtf(avgPower / p));
+        }
+
+        // Sum of the powers of a run clamped to a maximum, in lanes so that the compiler vectorizes it
+        inline float runSum(const float* p, int n, float max) {
+            float lanes[NOISE_BLANKER_BLOCK_LANES] = {};
+            int i = 0;
+            for (; i + NOISE_BLANKER_BLOCK_LANES <= n; i += NOISE_BLANKER_BLOCK_LANES) {
+                for (int l = 0; l < NOISE_BLANKER_BLOCK_LANES; l++) { lanes[l] += (p[i + l] < max) ? p[i + l] : max; }
+            }
+            float sum = 0.0f;
+            for (; i < n; i++) { sum += (p[i] < max) ? p[i] : max; }
+            for (int l = 0; l < NOISE_BLANKER_BLOCK_LANES; l++) { sum += lanes[l]; }
+            return sum;
+        }
+
+        inline float runPeak(const float* p, int n) {
+            float lanes[NOISE_BLANKER_BLOCK_LANES] = {};
+            int i = 0;
+            for (; i + NOISE_BLANKER_BLOCK_LANES <= n; i += NOISE_BLANKER_BLOCK_LANES) {
+                for (int l = 0; l < NOISE_BLANKER_BLOCK_LANES; l++) { lanes[l] = (p[i + l] > lanes[l]) ? p[i + l] : lanes[l]; }
+            }
+            float peak = 0.0f;
+            for (; i < n; i++) { peak = std::max<float>(peak, p[i]); }
+            for (int l = 0; l < NOISE_BLANKER_BLOCK_LANES; l++) { peak = std::max<float>(peak, lanes[l]); }
+            return peak;
+        }
+
+        // Coefficient that moves the average over n samples as much as the per-sample rate would for a constant input
+        inline float runCoef(int n) {
+            return 1.0f - powf(1.0f - _rate, n);
+        }
+
+        void clearWindow() {
+            buffer::clear(work, _lookAhead);
+            for (int i = 0; i < _lookAhead; i++) { gains[i] = 1.0f; }
+            hangLeft = 0;
+        }
+
         float _rate;
-        float _invRate;
         float _level;
+        int _lookAhead;
+        int _hang;
+        float runRate;
 
-        float amp = 1.0;
-
+        float avgPower = 0.0f;
+        int hangLeft = 0;
+        complex_t* work;
+        float* gains;
+        float* power;
     };
-}
\ No newline at end of file
+}
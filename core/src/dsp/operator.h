@@ -13,6 +13,7 @@ namespace dsp {
         virtual void init(stream<A>* a, stream<B>* b) {
             _a = a;
             _b = b;
+            out.setMetaSource(_a);
             base_type::registerInput(_a);
             base_type::registerInput(_b);
             base_type::registerOutput(&out);
@@ -27,6 +28,7 @@ namespace dsp {
             base_type::unregisterInput(_b);
             _a = a;
             _b = b;
+            out.setMetaSource(_a);
             base_type::registerInput(_a);
             base_type::registerInput(_b);
             base_type::tempStart();
@@ -38,6 +40,7 @@ namespace dsp {
             base_type::tempStop();
             base_type::unregisterInput(_a);
             _a = a;
+            out.setMetaSource(_a);
             base_type::registerInput(_a);
             base_type::tempStart();
         }
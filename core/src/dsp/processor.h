@@ -49,6 +49,7 @@ namespace dsp {
 
         virtual void init(stream<I>* in) {
             _in = in;
+            out.setMetaSource(_in);
             registerInput(_in);
             registerOutput(&out);
             _block_init = true;
@@ -60,6 +61,7 @@ namespace dsp {
             tempStop();
             unregisterInput(_in);
             _in = in;
+            out.setMetaSource(_in);
             registerInput(_in);
             tempStart();
         }
@@ -49,6 +49,7 @@ namespace dsp::routing {
 
             for (const auto& stream : streams) {
                 memcpy(stream->writeBuf, base_type::_in->readBuf, count * sizeof(T));
+                stream->writeMeta = base_type::_in->readMeta;
                 if (!stream->swap(count)) {
                     base_type::_in->flush();
                     return -1;
@@ -29,6 +29,9 @@ namespace dsp {
 
         virtual int run() = 0;
 
+        // Metadata of the buffer being processed
+        const StreamMeta& getInputMeta() { return _in->readMeta; }
+
     protected:
         stream<T>* _in;
     };
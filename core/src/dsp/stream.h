@@ -2,8 +2,11 @@
 #include <string.h>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <volk/volk.h>
 #include "buffer/buffer.h"
+#include "stream_meta.h"
 
 // 1MSample buffer
 #define STREAM_BUFFER_SIZE 1000000
@@ -18,6 +21,35 @@ namespace dsp {
         virtual void clearWriteStop() {}
         virtual void stopReader() {}
         virtual void clearReadStop() {}
+        virtual bool waitIdle(std::chrono::milliseconds timeout) { return true; }
+
+        // Derive the metadata of each buffer swapped into this stream from the buffer last read from the
+        // source stream, scaling it by the samplerate ratio and frequency shift of the block in between.
+        // Both streams must be used by the same thread, which is the case for the input and output of a block.
+        void setMetaSource(untyped_stream* source) { metaSource = source; }
+        void setMetaRatio(double ratio) { metaRatio = ratio; }
+        void setMetaOffset(double offset) { metaOffset = offset; }
+
+        // Metadata attached to the buffer by the next swap(), only set by hand by writers without a meta source
+        StreamMeta writeMeta;
+
+        // Metadata of the buffer returned by the last read(), left untouched until the next read()
+        StreamMeta readMeta;
+
+    protected:
+        inline void deriveMeta() {
+            if (!metaSource) { return; }
+            writeMeta = metaSource->readMeta;
+            if (!writeMeta.valid) { return; }
+            double ratio = metaRatio;
+            writeMeta.sampleIndex = (uint64_t)((double)writeMeta.sampleIndex * ratio + 0.5);
+            writeMeta.sampleRate *= ratio;
+            writeMeta.frequency += metaOffset;
+        }
+
+        untyped_stream* metaSource = NULL;
+        std::atomic<double> metaRatio = 1.0;
+        std::atomic<double> metaOffset = 0.0;
     };
 
     template <class T>
@@ -37,9 +69,14 @@ namespace dsp {
             buffer::free(readBuf);
             writeBuf = buffer::alloc<T>(samples);
             readBuf = buffer::alloc<T>(samples);
+            bufferSize = samples;
         }
 
+        // Size of both buffers in samples. Buffers of the same size can be exchanged between streams.
+        int getBufferSize() { return bufferSize; }
+
         virtual inline bool swap(int size) {
+            deriveMeta();
             {
                 // Wait to either swap or stop
                 std::unique_lock<std::mutex> lck(swapMtx);
@@ -50,6 +87,7 @@ namespace dsp {
 
                 // Swap buffers
                 dataSize = size;
+                swapMeta = writeMeta;
                 T* temp = writeBuf;
                 writeBuf = readBuf;
                 readBuf = temp;
@@ -69,9 +107,16 @@ namespace dsp {
         virtual inline int read() {
             // Wait for data to be ready or to be stopped
             std::unique_lock<std::mutex> lck(rdyMtx);
+            if (!dataReady && !readerStop) {
+                readerWaiting = true;
+                idleCV.notify_all();
+            }
             rdyCV.wait(lck, [this] { return (dataReady || readerStop); });
+            readerWaiting = false;
+            if (readerStop) { return -1; }
 
-            return (readerStop ? -1 : dataSize);
+            readMeta = swapMeta;
+            return dataSize;
         }
 
         virtual inline void flush() {
@@ -114,11 +159,20 @@ namespace dsp {
             readerStop = false;
         }
 
+        // Wait until the reader has handled every buffer swapped in and is waiting for the next one. Once the
+        // writer stopped writing, this means that everything it wrote went through the reader.
+        // Returns false if that didn't happen before the timeout or if the reader was stopped.
+        virtual bool waitIdle(std::chrono::milliseconds timeout) {
+            std::unique_lock<std::mutex> lck(rdyMtx);
+            return idleCV.wait_for(lck, timeout, [this] { return (readerWaiting && !dataReady) || readerStop; }) && !readerStop;
+        }
+
         void free() {
             if (writeBuf) { buffer::free(writeBuf); }
             if (readBuf) { buffer::free(readBuf); }
             writeBuf = NULL;
             readBuf = NULL;
+            bufferSize = 0;
         }
 
         T* writeBuf;
@@ -131,11 +185,15 @@ namespace dsp {
 
         std::mutex rdyMtx;
         std::condition_variable rdyCV;
+        std::condition_variable idleCV;
         bool dataReady = false;
+        bool readerWaiting = false;
 
         bool readerStop = false;
         bool writerStop = false;
 
         int dataSize = 0;
+        int bufferSize = STREAM_BUFFER_SIZE;
+        StreamMeta swapMeta;
     };
 }
\ No newline at end of file
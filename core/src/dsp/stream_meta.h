@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+namespace dsp {
+    // Optional description of the first sample of a stream buffer. Sources fill it in, blocks carry it
+    // along and rescale it when they change the samplerate or shift the frequency.
+    struct StreamMeta {
+        bool valid = false;
+        bool hardwareTime = false;  // True if the time comes from the device rather than the host clock
+        uint32_t epoch = 0;         // Changes whenever the stream restarts or its samplerate changes
+        uint64_t sampleIndex = 0;   // Index of the first sample of the buffer since the start of the epoch
+        int64_t time = 0;           // Capture time of the first sample in ns since the unix epoch
+        double frequency = 0;       // Frequency at DC in Hz
+        double sampleRate = 0;
+
+        // Metadata as if the buffer started offset samples later
+        inline StreamMeta at(int offset) const {
+            StreamMeta meta = *this;
+            if (!valid || !offset) { return meta; }
+            meta.sampleIndex += offset;
+            if (sampleRate > 0) { meta.time += (int64_t)((double)offset * 1e9 / sampleRate); }
+            return meta;
+        }
+    };
+
+    // Keeps the running sample count of a source and stamps its buffers. The samplerate and frequency
+    // can be changed from any thread while another one stamps.
+    class StreamClock {
+    public:
+        // Start a new epoch, the sample index restarts from zero
+        void reset(double sampleRate) {
+            _sampleRate = sampleRate;
+            epoch++;
+        }
+
+        void setFrequency(double frequency) { _frequency = frequency; }
+
+        // Account for samples lost by the device so that the indices of the following buffers stay exact
+        void skip(uint64_t count) { index += count; }
+
+        // Stamp a buffer of count samples. Without a hardware timestamp the buffer is assumed to have just
+        // finished arriving, so the time of its first sample is the wall clock minus its duration.
+        StreamMeta stamp(int count, int64_t hardwareTime = -1) {
+            StreamMeta meta;
+            uint32_t ep = epoch;
+            if (ep != lastEpoch) {
+                lastEpoch = ep;
+                index = 0;
+            }
+
+            meta.valid = true;
+            meta.epoch = ep;
+            meta.sampleIndex = index;
+            meta.frequency = _frequency;
+            meta.sampleRate = _sampleRate;
+            if (hardwareTime >= 0) {
+                meta.hardwareTime = true;
+                meta.time = hardwareTime;
+            }
+            else {
+                int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                meta.time = (meta.sampleRate > 0) ? (now - (int64_t)((double)count * 1e9 / meta.sampleRate)) : now;
+            }
+
+            index += count;
+            return meta;
+        }
+
+    private:
+        std::atomic<double> _sampleRate = 0;
+        std::atomic<double> _frequency = 0;
+        std::atomic<uint32_t> epoch = 0;
+        uint32_t lastEpoch = 0;
+        uint64_t index = 0;
+    };
+}
@@ -257,7 +257,24 @@ void MainWindow::vfoAddedHandler(VFOManager::VFO* vfo, void* ctx) {
     sigpath::vfoManager.setCenterOffset(name, _this->initComplete ? newOffset : offset);
 }
 
+void MainWindow::postTask(std::function<void()> task) {
+    std::lock_guard<std::mutex> lck(taskMtx);
+    tasks.push_back(task);
+}
+
+void MainWindow::runTasks() {
+    // Run outside the lock so that a task can post another one
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard<std::mutex> lck(taskMtx);
+        pending.swap(tasks);
+    }
+    for (auto& task : pending) { task(); }
+}
+
 void MainWindow::draw() {
+    runTasks();
+
     ImGui::Begin("Main", NULL, WINDOW_FLAGS);
     ImVec4 textCol = ImGui::GetStyleColorVec4(ImGuiCol_Text);
 
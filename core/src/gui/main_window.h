@@ -7,6 +7,8 @@
 #include <string>
 #include <utils/event.h>
 #include <mutex>
+#include <functional>
+#include <vector>
 #include <gui/tuner.h>
 
 #define WINDOW_FLAGS ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoBackground
@@ -28,6 +30,10 @@ public:
     void setPlayState(bool _playing);
     bool isPlaying();
 
+    // Run a function on the GUI thread before the next frame, for module threads that need to tune or touch the UI
+    void postTask(std::function<void()> task);
+    void runTasks();
+
     bool lockWaterfallControls = false;
     bool playButtonLocked = false;
 
@@ -66,4 +72,7 @@ private:
     bool autostart = false;
 
     EventHandler<VFOManager::VFO*> vfoCreatedHandler;
+
+    std::mutex taskMtx;
+    std::vector<std::function<void()>> tasks;
 };
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <gui/main_window.h>
 #include <gui/style.h>
 #include <signal_path/signal_path.h>
+#include <inttypes.h>
+#include <chrono>
 
 namespace sourcemenu {
     int offsetMode = 0;
@@ -14,6 +16,7 @@ namespace sourcemenu {
     int decimationPower = 0;
     bool iqCorrection = false;
     bool invertIQ = false;
+    int bufferLatency = 200;
 
     EventHandler<std::string> sourceRegisteredHandler;
     EventHandler<std::string> sourceUnregisterHandler;
@@ -23,6 +26,10 @@ namespace sourcemenu {
     std::string sourceNamesTxt;
     std::string selectedSource;
 
+    // Secondary sources and their frequency, as saved in the config
+    std::map<std::string, double> secondaryFreqs;
+    int secondaryId = 0;
+
     enum {
         OFFSET_MODE_NONE,
         OFFSET_MODE_CUSTOM,
@@ -97,14 +104,40 @@ namespace sourcemenu {
             selectSource(sourceNames[0]);
             return;
         }
+
+        // A secondary source can only become the selected one once nothing uses it anymore
+        if (!sigpath::sourceManager.closeSecondary(name)) {
+            sourceId = std::distance(sourceNames.begin(), std::find(sourceNames.begin(), sourceNames.end(), selectedSource));
+            return;
+        }
+
         sourceId = std::distance(sourceNames.begin(), it);
         selectedSource = sourceNames[sourceId];
         sigpath::sourceManager.selectSource(sourceNames[sourceId]);
     }
 
+    void openSecondary(std::string name) {
+        if (!sigpath::sourceManager.openSecondary(name)) { return; }
+        if (secondaryFreqs.find(name) == secondaryFreqs.end()) { secondaryFreqs[name] = 100000000.0; }
+        sigpath::sourceManager.tuneSecondary(name, secondaryFreqs[name]);
+    }
+
+    void saveSecondaries() {
+        core::configManager.acquire();
+        core::configManager.conf["secondarySources"] = json::object();
+        for (auto const& [name, freq] : secondaryFreqs) {
+            core::configManager.conf["secondarySources"][name]["frequency"] = freq;
+        }
+        core::configManager.release(true);
+    }
+
     void onSourceRegistered(std::string name, void* ctx) {
         refreshSources();
 
+        if (secondaryFreqs.find(name) != secondaryFreqs.end() && name != selectedSource) {
+            openSecondary(name);
+        }
+
         if (selectedSource.empty()) {
             sourceId = 0;
             selectSource(sourceNames[0]);
@@ -145,13 +178,22 @@ namespace sourcemenu {
         decimationPower = core::configManager.conf["decimationPower"];
         iqCorrection = core::configManager.conf["iqCorrection"];
         invertIQ = core::configManager.conf["invertIQ"];
+        bufferLatency = core::configManager.conf["iqBufferLatency"];
+        for (auto [name, sec] : core::configManager.conf["secondarySources"].items()) {
+            secondaryFreqs[name] = sec["frequency"];
+        }
         sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
         sigpath::iqFrontEnd.setInvertIQ(invertIQ);
+        sigpath::iqFrontEnd.setBufferLatency(bufferLatency);
         updateOffset();
 
         refreshSources();
         selectSource(selected);
         sigpath::iqFrontEnd.setDecimation(1 << decimationPower);
+        for (auto const& [name, freq] : secondaryFreqs) {
+            if (name == selectedSource || std::find(sourceNames.begin(), sourceNames.end(), name) == sourceNames.end()) { continue; }
+            openSecondary(name);
+        }
 
         sourceRegisteredHandler.handler = onSourceRegistered;
         sourceUnregisterHandler.handler = onSourceUnregister;
@@ -163,6 +205,105 @@ namespace sourcemenu {
         core::configManager.release();
     }
 
+    void drawStats() {
+        SourceStats::Snapshot stats;
+        if (!gui::mainWindow.sdrIsRunning() || !sigpath::sourceManager.getStats(stats)) { return; }
+
+        // Input buffer fill relative to the latency target
+        char fillTxt[64];
+        uint64_t overflows = sigpath::iqFrontEnd.getInputBufferOverflows();
+        float fill = sigpath::iqFrontEnd.getInputBufferFill();
+        if (overflows) { sprintf(fillTxt, "Buffer %d%%, %" PRIu64 " overflows", (int)(fill * 100.0f), overflows); }
+        else { sprintf(fillTxt, "Buffer %d%%", (int)(fill * 100.0f)); }
+        ImGui::ProgressBar(std::clamp<float>(fill, 0.0f, 1.0f), ImVec2(ImGui::GetContentRegionAvail().x, 0), fillTxt);
+
+        // The source's blocks may be too short for the rings to reach the target
+        double maxLatency = sigpath::iqFrontEnd.getInputBufferMaxLatency();
+        if (maxLatency > 0.0 && maxLatency < bufferLatency) {
+            ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Latency limited to %d ms", (int)maxLatency);
+        }
+
+        if (!stats.gaps()) {
+            ImGui::TextUnformatted("No samples lost");
+            return;
+        }
+
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Lost: %" PRIu64 " samples in %" PRIu64 " drops", stats.droppedSamples, stats.drops);
+        ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Overruns: %" PRIu64 ", Stalls: %" PRIu64, stats.overruns, stats.stalls);
+        ImGui::Text("Last gap %.1fs ago", (double)(now - stats.lastGapTime) / 1000.0);
+    }
+
+    void drawSecondaryStats(std::string name) {
+        SourceStats::Snapshot stats;
+        if (!sigpath::sourceManager.isSecondaryRunning(name) || !sigpath::sourceManager.getSecondaryStats(name, stats)) { return; }
+        if (!stats.gaps()) { return; }
+        ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Lost: %" PRIu64 " samples, %" PRIu64 " gaps", stats.droppedSamples, stats.gaps());
+    }
+
+    void drawSecondaries() {
+        float itemWidth = ImGui::GetContentRegionAvail().x;
+        if (!ImGui::CollapsingHeader("Secondary sources##_sdrpp_sec_src")) { return; }
+
+        // Sources that are neither selected nor already open
+        std::vector<std::string> candidates;
+        std::string candidatesTxt;
+        for (auto const& name : sourceNames) {
+            if (name == selectedSource || sigpath::sourceManager.isSecondary(name)) { continue; }
+            candidates.push_back(name);
+            candidatesTxt += name;
+            candidatesTxt += '\0';
+        }
+        secondaryId = std::clamp<int>(secondaryId, 0, std::max<int>(candidates.size() - 1, 0));
+
+        ImGui::SetNextItemWidth(itemWidth - ImGui::CalcTextSize("Open").x - ImGui::GetStyle().FramePadding.x * 2.0f - ImGui::GetStyle().ItemSpacing.x);
+        ImGui::Combo("##_sdrpp_sec_src_sel", &secondaryId, candidatesTxt.c_str());
+        ImGui::SameLine();
+        if (candidates.empty()) { style::beginDisabled(); }
+        if (ImGui::Button("Open##_sdrpp_sec_src_open") && !candidates.empty()) {
+            openSecondary(candidates[secondaryId]);
+            saveSecondaries();
+        }
+        if (candidates.empty()) { style::endDisabled(); }
+
+        ImGui::TextDisabled("Prefix a VFO name with \"<source>/\" to use it");
+
+        for (auto const& name : sigpath::sourceManager.getSecondaryNames()) {
+            bool running = sigpath::sourceManager.isSecondaryRunning(name);
+
+            // Sources opened through a VFO name have no saved frequency yet
+            if (secondaryFreqs.find(name) == secondaryFreqs.end()) {
+                secondaryFreqs[name] = 100000000.0;
+                sigpath::sourceManager.tuneSecondary(name, secondaryFreqs[name]);
+                saveSecondaries();
+            }
+
+            ImGui::Separator();
+            ImGui::TextUnformatted(name.c_str());
+
+            if (ImGui::Button(((running ? "Stop##_sdrpp_sec_run_" : "Start##_sdrpp_sec_run_") + name).c_str())) {
+                if (running) { sigpath::sourceManager.stopSecondary(name); }
+                else { sigpath::sourceManager.startSecondary(name); }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button(("Close##_sdrpp_sec_close_" + name).c_str()) && sigpath::sourceManager.closeSecondary(name)) {
+                secondaryFreqs.erase(name);
+                saveSecondaries();
+                continue;
+            }
+
+            ImGui::LeftLabel("Frequency");
+            ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX());
+            if (ImGui::InputDouble(("##_sdrpp_sec_freq_" + name).c_str(), &secondaryFreqs[name], 1000.0, 100000.0, "%.0f")) {
+                sigpath::sourceManager.tuneSecondary(name, secondaryFreqs[name]);
+                saveSecondaries();
+            }
+
+            sigpath::sourceManager.showSecondaryMenu(name);
+            drawSecondaryStats(name);
+        }
+    }
+
     void draw(void* ctx) {
         float itemWidth = ImGui::GetContentRegionAvail().x;
         bool running = gui::mainWindow.sdrIsRunning();
@@ -175,11 +316,15 @@ namespace sourcemenu {
             core::configManager.acquire();
             core::configManager.conf["source"] = sourceNames[sourceId];
             core::configManager.release(true);
+
+            // The source may have been a secondary one before
+            if (!sigpath::sourceManager.isSecondary(selectedSource) && secondaryFreqs.erase(selectedSource)) { saveSecondaries(); }
         }
 
         if (running) { style::endDisabled(); }
 
         sigpath::sourceManager.showSelectedMenu();
+        drawStats();
 
         if (ImGui::Checkbox("IQ Correction##_sdrpp_iq_corr", &iqCorrection)) {
             sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
@@ -230,5 +375,16 @@ namespace sourcemenu {
             core::configManager.release(true);
         }
         if (running) { style::endDisabled(); }
+
+        ImGui::LeftLabel("Buffer latency (ms)");
+        ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX());
+        if (ImGui::SliderInt("##_sdrpp_buf_latency", &bufferLatency, 10, 1000)) {
+            sigpath::iqFrontEnd.setBufferLatency(bufferLatency);
+            core::configManager.acquire();
+            core::configManager.conf["iqBufferLatency"] = bufferLatency;
+            core::configManager.release(true);
+        }
+
+        drawSecondaries();
     }
 }
@@ -1,4 +1,5 @@
 #include "server.h"
+#include "server_compressor.h"
 #include "core.h"
 #include <utils/flog.h>
 #include <version.h>
@@ -7,19 +8,77 @@
 #include <dsp/types.h>
 #include <signal_path/signal_path.h>
 #include <gui/smgui.h>
+#include <gui/gui.h>
 #include <utils/optionlist.h>
 #include "dsp/compression/sample_stream_compressor.h"
+#include "dsp/multirate/power_decimator.h"
 #include "dsp/sink/handler_sink.h"
-#include <zstd.h>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+
+// Length of the window over which the link is evaluated
+#define ADAPTIVE_WINDOW_SEC         1.0
+
+// The link is considered congested above this much time spent blocked in write or data queued in the kernel
+#define ADAPTIVE_MAX_LOAD           0.8
+#define ADAPTIVE_MAX_QUEUE_SEC      0.2
+
+// The link is considered to have headroom below these values
+#define ADAPTIVE_IDLE_LOAD          0.3
+#define ADAPTIVE_IDLE_QUEUE_SEC     0.05
+
+// Maximum predicted load after stepping up a level
+#define ADAPTIVE_TARGET_LOAD        0.6
+
+// Number of consecutive idle windows required before stepping up
+#define ADAPTIVE_UPGRADE_WINDOWS    3
+
+// Number of windows to wait after stepping down before trying to step up again
+#define ADAPTIVE_HOLDOFF_WINDOWS    5
 
 namespace server {
+    struct AdaptiveLevel {
+        dsp::compression::PCMType sampleType;
+        int compressionLevel;
+        int decimation;
+    };
+
+    // Ordered from highest quality to lowest bandwidth
+    const AdaptiveLevel adaptiveLevels[] = {
+        { dsp::compression::PCM_TYPE_F32, 0, 1 },
+        { dsp::compression::PCM_TYPE_I16, 0, 1 },
+        { dsp::compression::PCM_TYPE_I16, 1, 1 },
+        { dsp::compression::PCM_TYPE_BFP_I8, 1, 1 },
+        { dsp::compression::PCM_TYPE_I8, 1, 1 },
+        { dsp::compression::PCM_TYPE_I8, 3, 1 },
+        { dsp::compression::PCM_TYPE_I8, 3, 2 },
+        { dsp::compression::PCM_TYPE_I8, 3, 4 },
+        { dsp::compression::PCM_TYPE_I8, 3, 8 },
+        { dsp::compression::PCM_TYPE_I8, 3, 16 },
+        { dsp::compression::PCM_TYPE_I8, 3, 32 },
+        { dsp::compression::PCM_TYPE_I8, 3, 64 }
+    };
+    const int adaptiveLevelCount = sizeof(adaptiveLevels) / sizeof(AdaptiveLevel);
+    const int adaptiveDefaultLevel = 1;
+
+    struct LinkStats {
+        double streamTime = 0;
+        double writeTime = 0;
+        size_t rawBytes = 0;
+        size_t compressedBytes = 0;
+        size_t sentBytes = 0;
+        int maxQueued = 0;
+    };
+
     dsp::stream<dsp::complex_t> dummyInput;
+    dsp::stream<dsp::complex_t>* input = &dummyInput;
+    dsp::multirate::PowerDecimator<dsp::complex_t> decim;
     dsp::compression::SampleStreamCompressor comp;
     dsp::sink::Handler<uint8_t> hnd;
     net::Conn client;
     uint8_t* rbuf = NULL;
     uint8_t* sbuf = NULL;
-    uint8_t* bbuf = NULL;
 
     PacketHeader* r_pkt_hdr = NULL;
     uint8_t* r_pkt_data = NULL;
@@ -31,30 +90,57 @@ namespace server {
     CommandHeader* s_cmd_hdr = NULL;
     uint8_t* s_cmd_data = NULL;
 
-    PacketHeader* bb_pkt_hdr = NULL;
-    uint8_t* bb_pkt_data = NULL;
-
     SmGui::DrawListElem dummyElem;
 
-    ZSTD_CCtx* cctx;
+    net::Conn udpClient;
+    uint8_t ubuf[SERVER_UDP_MAX_PACKET_SIZE];
+    std::mutex udpMtx;
+    std::atomic<bool> udp = false;
+    uint32_t udpSequence = 0;
+    uint64_t udpSampleIndex = 0;
+
+    ParallelCompressor compressor;
 
     net::Listener listener;
 
     OptionList<std::string, std::string> sourceList;
     int sourceId = 0;
     bool running = false;
-    bool compression = false;
+    std::atomic<int> compressionLevel = 0;
+    std::atomic<uint32_t> clientCapabilities = 0;
+    std::atomic<dsp::compression::PCMType> pcmType = dsp::compression::PCM_TYPE_I16;
+    dsp::compression::PCMType compPCMType = dsp::compression::PCM_TYPE_I8;
+    dsp::compression::CompressionType compCompressionType = dsp::compression::COMPRESSION_TYPE_NONE;
+    int decimRatio = 1;
     double sampleRate = 1000000.0;
 
+    // Guards the DSP chain and every stream setting, whether changed by a command or by the adaptive control
+    std::recursive_mutex dspMtx;
+
+    std::atomic<bool> adaptive = false;
+    int adaptiveMaxDecim = 1;
+    int adaptiveLevel = adaptiveDefaultLevel;
+    int adaptiveIdleWindows = 0;
+    int adaptiveHoldoff = 0;
+    double compressionRatio = 1.0;
+    LinkStats linkStats;
+
+    // Level changes decided on the sender thread are applied by the adaptive thread, since applying them
+    // waits for the sender to flush the packets still queued at the old settings
+    std::thread adaptiveThread;
+    std::mutex adaptiveMtx;
+    std::condition_variable adaptiveCnd;
+    int adaptiveRequest = -1;
+
     int main() {
         flog::info("=====| SERVER MODE |=====");
 
         // Init DSP
+        decim.init(&dummyInput, 2);
         comp.init(&dummyInput, dsp::compression::PCM_TYPE_I8);
         hnd.init(&comp.out, _testServerHandler, NULL);
         rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
         sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        bbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
         comp.start();
         hnd.start();
 
@@ -69,11 +155,12 @@ namespace server {
         s_cmd_hdr = (CommandHeader*)s_pkt_data;
         s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
 
-        bb_pkt_hdr = (PacketHeader*)bbuf;
-        bb_pkt_data = &bbuf[sizeof(PacketHeader)];
-
-        // Initialize compressor
-        cctx = ZSTD_createCCtx();
+        // Initialize compressor, leaving some cores to the source and DSP
+        int workerCount = std::clamp<int>(std::thread::hardware_concurrency() / 2, 1, SERVER_MAX_COMPRESSION_THREADS);
+        compressor.init(workerCount, _sendHandler, NULL);
+        compressor.start();
+        adaptiveThread = std::thread(adaptiveWorker);
+        flog::info("Using {0} compression threads", workerCount);
 
         // Load config
         core::configManager.acquire();
@@ -155,7 +242,11 @@ namespace server {
         listener->acceptAsync(_clientHandler, NULL);
 
         flog::info("Ready, listening on {0}:{1}", host, port);
-        while(1) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        // There is no GUI thread, run the tasks posted by the modules from here instead
+        while(1) {
+            gui::mainWindow.runTasks();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
 
         return 0;
     }
@@ -163,7 +254,7 @@ namespace server {
     void _clientHandler(net::Conn conn, void* ctx) {
         // Reject if someone else is already connected
         if (client && client->isOpen()) {
-            flog::info("REJECTED Connection from {0}:{1}, another client is already connected.", "TODO", "TODO");
+            flog::info("REJECTED Connection from {0}, another client is already connected.", conn->getRemoteHost());
             
             // Issue a disconnect command to the client
             uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
@@ -184,16 +275,20 @@ namespace server {
             return;
         }
 
-        flog::info("Connection from {0}:{1}", "TODO", "TODO");
+        flog::info("Connection from {0}", conn->getRemoteHost());
         client = std::move(conn);
         client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
 
         // Perform settings reset
         sigpath::sourceManager.stop();
-        comp.setPCMType(dsp::compression::PCM_TYPE_I16);
-        compression = false;
-
-        sendSampleRate(sampleRate);
+        {
+            std::lock_guard<std::recursive_mutex> lck(dspMtx);
+            setUDP(false, 0);
+            adaptive = false;
+            clientCapabilities = 0;
+            applyStreamSettings(dsp::compression::PCM_TYPE_I16, 0, 1, false);
+            sendSampleRate(sampleRate);
+        }
 
         // TODO: Wait otherwise someone else could connect
 
@@ -227,23 +322,291 @@ namespace server {
     }
 
     void _testServerHandler(uint8_t* data, int count, void* ctx) {
-        // Compress data if needed and fill out header fields
-        if (compression) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_COMPRESSED;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + (uint32_t)ZSTD_compressCCtx(cctx, &bbuf[sizeof(PacketHeader)], SERVER_MAX_PACKET_SIZE, data, count, 1);
+        // Compression happens on the worker threads, packets come back in order through _sendHandler
+        if (!client || !client->isOpen()) { return; }
+        compressor.push(data, count, udp ? 0 : compressionLevel.load());
+    }
+
+    void _sendHandler(const uint8_t* raw, int rawCount, uint8_t* pkt, int pktSize, void* ctx) {
+        // Write to network
+        if (!client || !client->isOpen()) { return; }
+        auto start = std::chrono::high_resolution_clock::now();
+        if (udp) {
+            sendUDP(raw, rawCount);
         }
         else {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + count;
-            memcpy(&bbuf[sizeof(PacketHeader)], data, count);
+            client->write(pktSize, pkt);
         }
 
-        // Write to network
-        if (client && client->isOpen()) { client->write(bb_pkt_hdr->size, bbuf); }
+        // Update the link statistics and adapt the stream settings
+        if (adaptive) {
+            double writeTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            updateAdaptive(raw, rawCount, pktSize, writeTime);
+        }
     }
 
     void setInput(dsp::stream<dsp::complex_t>* stream) {
-        comp.setInput(stream);
+        std::lock_guard<std::recursive_mutex> lck(dspMtx);
+        input = stream;
+        if (decimRatio > 1) {
+            decim.setInput(input);
+        }
+        else {
+            comp.setInput(input);
+        }
+    }
+
+    void setDecimation(int ratio) {
+        std::lock_guard<std::recursive_mutex> lck(dspMtx);
+        if (ratio == decimRatio) { return; }
+
+        // Bypass the decimator entirely when not decimating to avoid a copy
+        if (ratio > 1) {
+            decim.setRatio(ratio);
+            if (decimRatio == 1) {
+                comp.setInput(&decim.out);
+                decim.setInput(input);
+                decim.start();
+            }
+        }
+        else {
+            decim.stop();
+            comp.setInput(input);
+        }
+        decimRatio = ratio;
+    }
+
+    void updateCompressor() {
+        // In UDP mode each datagram is converted on its own, so the compressor only passes float samples through.
+        // Shuffling only helps the entropy coder, so it's only done when compressing, and only for clients that
+        // said they can undo it since older ones ignore the compression type of the header.
+        dsp::compression::PCMType type = udp ? dsp::compression::PCM_TYPE_F32 : pcmType.load();
+        bool shuffle = compressionLevel && !udp && (clientCapabilities & CAPABILITY_SHUFFLE);
+        dsp::compression::CompressionType compType = shuffle ? dsp::compression::COMPRESSION_TYPE_DELTA_SHUFFLE : dsp::compression::COMPRESSION_TYPE_NONE;
+        if (type != compPCMType) {
+            comp.setPCMType(type);
+            compPCMType = type;
+        }
+        if (compType != compCompressionType) {
+            comp.setCompressionType(compType);
+            compCompressionType = compType;
+        }
+    }
+
+    void setCompressionLevel(int level) {
+        std::lock_guard<std::recursive_mutex> lck(dspMtx);
+        compressionLevel = level;
+        updateCompressor();
+    }
+
+    void applyStreamSettings(dsp::compression::PCMType type, int compLevel, int decimation, bool notify) {
+        std::lock_guard<std::recursive_mutex> lck(dspMtx);
+        pcmType = type;
+        setCompressionLevel(compLevel);
+
+        // Buffers carry their own sample type, only a change of decimation changes how the client must decode them
+        if (decimation == decimRatio) {
+            if (notify && client && client->isOpen()) { sendStreamSettings(); }
+            return;
+        }
+
+        // Drop the buffers at the old samplerate that are still in the chain and send the ones already queued
+        // before telling the client about the new samplerate, so that it never decodes a buffer at the wrong rate
+        hnd.tempStop();
+        comp.tempStop();
+        setDecimation(decimation);
+        decim.out.flush();
+        comp.out.flush();
+        compressor.flush();
+
+        if (notify && client && client->isOpen()) {
+            double rate = sampleRate / (double)decimRatio;
+            sendStreamCommand(COMMAND_SET_SAMPLERATE, (uint8_t*)&rate, sizeof(double));
+            sendStreamSettings();
+        }
+        comp.tempStart();
+        hnd.tempStart();
+    }
+
+    void setUDP(bool enabled, int port) {
+        std::lock_guard<std::recursive_mutex> dspLck(dspMtx);
+        std::lock_guard<std::mutex> lck(udpMtx);
+
+        // Close the previous socket if any
+        if (udpClient) {
+            udpClient->close();
+            udpClient.reset();
+        }
+
+        // Datagrams are sent to the address the client connected from
+        if (enabled) {
+            try {
+                std::string host = client->getRemoteHost();
+                udpClient = net::openUDP("0.0.0.0", 0, host, port, false);
+                flog::info("Sending baseband over UDP to {0}:{1}", host, port);
+            }
+            catch (std::exception& e) {
+                flog::error("Could not open UDP socket: {0}", e.what());
+                sendError(ERROR_INVALID_ARGUMENT);
+                enabled = false;
+            }
+        }
+
+        udpSequence = 0;
+        udpSampleIndex = 0;
+        udp = enabled;
+        updateCompressor();
+    }
+
+    void sendUDP(const uint8_t* raw, int rawCount) {
+        std::lock_guard<std::mutex> lck(udpMtx);
+        if (!udpClient || !udpClient->isOpen()) { return; }
+
+        // Find how many samples of the selected type fit in a datagram
+        int avail = SERVER_UDP_MAX_PACKET_SIZE - sizeof(UDPHeader) - 8;
+        int perPacket = (pcmType == dsp::compression::PCM_TYPE_BFP_I8) ? (((avail - 1) * PCM_BFP_BLOCK_SIZE) / (2 * PCM_BFP_BLOCK_SIZE + 1)) : (avail / sampleTypeSize(pcmType));
+
+        // Raw buffers are float32 in UDP mode, convert each slice on its own so that it can be decoded independently
+        const dsp::complex_t* samples = (const dsp::complex_t*)&raw[8];
+        int count = (rawCount - 8) / sizeof(dsp::complex_t);
+        UDPHeader* hdr = (UDPHeader*)ubuf;
+        for (int i = 0; i < count; i += perPacket) {
+            int len = std::min<int>(perPacket, count - i);
+            hdr->sequence = udpSequence++;
+            hdr->sampleIndex = udpSampleIndex;
+            int size = dsp::compression::SampleStreamCompressor::process(len, pcmType, dsp::compression::COMPRESSION_TYPE_NONE, &samples[i], &ubuf[sizeof(UDPHeader)], NULL);
+            udpClient->write(sizeof(UDPHeader) + size, ubuf);
+            udpSampleIndex += len;
+        }
+    }
+
+    void setAdaptive(bool enabled, int maxDecimation) {
+        std::lock_guard<std::recursive_mutex> lck(dspMtx);
+
+        // Clamp the maximum decimation to a supported power of two
+        int maxDecim = 1;
+        while (maxDecim * 2 <= maxDecimation && maxDecim * 2 <= (int)decim.getMaxRatio()) { maxDecim *= 2; }
+
+        adaptive = enabled;
+        adaptiveMaxDecim = maxDecim;
+        adaptiveIdleWindows = 0;
+        adaptiveHoldoff = 0;
+        linkStats = LinkStats();
+        {
+            std::lock_guard<std::mutex> reqLck(adaptiveMtx);
+            adaptiveRequest = -1;
+        }
+
+        if (adaptive) {
+            adaptiveLevel = adaptiveDefaultLevel;
+            const AdaptiveLevel& lvl = adaptiveLevels[adaptiveLevel];
+            applyStreamSettings(lvl.sampleType, lvl.compressionLevel, lvl.decimation, true);
+        }
+        else {
+            // Decimation can only be controlled in adaptive mode
+            applyStreamSettings(pcmType, compressionLevel, 1, true);
+        }
+    }
+
+    double estimateLevelCost(int level) {
+        // Bytes per input sample sent over the link
+        const AdaptiveLevel& lvl = adaptiveLevels[level];
+        double cost = (double)sampleTypeSize(lvl.sampleType) / (double)lvl.decimation;
+        if (lvl.compressionLevel) { cost *= compressionRatio; }
+        return cost;
+    }
+
+    void updateAdaptive(const uint8_t* data, int count, int sentBytes, double writeTime) {
+        // The settings are being changed, which waits for this thread, so the buffer is left out of the statistics
+        std::unique_lock<std::recursive_mutex> lck(dspMtx, std::try_to_lock);
+        if (!lck.owns_lock()) { return; }
+
+        // Find the duration of the buffer using the sample type from its header
+        dsp::compression::PCMType type = (dsp::compression::PCMType)(*(uint16_t*)&data[2]);
+        int samples = (type == dsp::compression::PCM_TYPE_BFP_I8) ? *(uint32_t*)&data[4] : ((count - 8) / sampleTypeSize(type));
+        double rate = sampleRate / (double)decimRatio;
+
+        linkStats.streamTime += (double)samples / rate;
+        linkStats.writeTime += writeTime;
+        linkStats.sentBytes += sentBytes;
+        if (compressionLevel) {
+            linkStats.rawBytes += count;
+            linkStats.compressedBytes += sentBytes;
+        }
+        linkStats.maxQueued = std::max<int>(linkStats.maxQueued, client->getSendQueueSize());
+
+        // Only take a decision once a full window has been sent
+        if (linkStats.streamTime < ADAPTIVE_WINDOW_SEC) { return; }
+        LinkStats stats = linkStats;
+        linkStats = LinkStats();
+
+        // Compute the link load and the latency of the data sitting in the send queue
+        double load = stats.writeTime / stats.streamTime;
+        double byteRate = (double)stats.sentBytes / stats.streamTime;
+        double queueTime = (stats.maxQueued > 0) ? ((double)stats.maxQueued / byteRate) : 0.0;
+        if (stats.rawBytes) { compressionRatio = (double)stats.compressedBytes / (double)stats.rawBytes; }
+        if (adaptiveHoldoff) { adaptiveHoldoff--; }
+
+        int newLevel = adaptiveLevel;
+        if (load > ADAPTIVE_MAX_LOAD || queueTime > ADAPTIVE_MAX_QUEUE_SEC) {
+            // Congested, step down if possible
+            adaptiveIdleWindows = 0;
+            if (adaptiveLevel + 1 < adaptiveLevelCount && adaptiveLevels[adaptiveLevel + 1].decimation <= adaptiveMaxDecim) {
+                newLevel = adaptiveLevel + 1;
+                adaptiveHoldoff = ADAPTIVE_HOLDOFF_WINDOWS;
+            }
+        }
+        else if (load < ADAPTIVE_IDLE_LOAD && queueTime < ADAPTIVE_IDLE_QUEUE_SEC) {
+            // Step up only if the link has been idle long enough and the next level is predicted to fit
+            if (++adaptiveIdleWindows >= ADAPTIVE_UPGRADE_WINDOWS && !adaptiveHoldoff && adaptiveLevel > 0) {
+                double predicted = load * estimateLevelCost(adaptiveLevel - 1) / estimateLevelCost(adaptiveLevel);
+                if (predicted < ADAPTIVE_TARGET_LOAD) { newLevel = adaptiveLevel - 1; }
+                adaptiveIdleWindows = 0;
+            }
+        }
+        else {
+            adaptiveIdleWindows = 0;
+        }
+
+        if (newLevel == adaptiveLevel) { return; }
+        flog::info("Link load {0}%, queue {1}ms, switching to adaptive level {2}", (int)(load * 100.0), (int)(queueTime * 1000.0), newLevel);
+        adaptiveLevel = newLevel;
+        {
+            std::lock_guard<std::mutex> reqLck(adaptiveMtx);
+            adaptiveRequest = newLevel;
+        }
+        adaptiveCnd.notify_one();
+    }
+
+    void adaptiveWorker() {
+        while (true) {
+            // Wait for the sender thread to request a level
+            int level;
+            {
+                std::unique_lock<std::mutex> lck(adaptiveMtx);
+                adaptiveCnd.wait(lck, []() { return adaptiveRequest >= 0; });
+                level = adaptiveRequest;
+                adaptiveRequest = -1;
+            }
+
+            // Adaptive mode may have been turned off in the meantime
+            std::lock_guard<std::recursive_mutex> lck(dspMtx);
+            if (!adaptive || level != adaptiveLevel) { continue; }
+            const AdaptiveLevel& lvl = adaptiveLevels[level];
+            applyStreamSettings(lvl.sampleType, lvl.compressionLevel, lvl.decimation, true);
+        }
+    }
+
+    int sampleTypeSize(dsp::compression::PCMType type) {
+        switch (type) {
+        case dsp::compression::PCM_TYPE_I8:
+        case dsp::compression::PCM_TYPE_BFP_I8:
+            return sizeof(int8_t) * 2;
+        case dsp::compression::PCM_TYPE_I16:
+            return sizeof(int16_t) * 2;
+        default:
+            return sizeof(float) * 2;
+        }
     }
 
     void commandHandler(Command cmd, uint8_t* data, int len) {
@@ -293,10 +656,23 @@ namespace server {
         }
         else if (cmd == COMMAND_SET_SAMPLE_TYPE && len == 1) {
             dsp::compression::PCMType type = (dsp::compression::PCMType)*(uint8_t*)data;
-            comp.setPCMType(type);
+            applyStreamSettings(type, compressionLevel, decimRatio, false);
         }
         else if (cmd == COMMAND_SET_COMPRESSION && len == 1) {
-            compression = *(uint8_t*)data;
+            setCompressionLevel(*(uint8_t*)data ? 1 : 0);
+        }
+        else if (cmd == COMMAND_SET_ADAPTIVE && len == sizeof(AdaptiveConfig)) {
+            AdaptiveConfig* conf = (AdaptiveConfig*)data;
+            setAdaptive(conf->enabled, conf->maxDecimation);
+        }
+        else if (cmd == COMMAND_SET_UDP && len == sizeof(UDPConfig)) {
+            UDPConfig* conf = (UDPConfig*)data;
+            setUDP(conf->enabled, conf->port);
+        }
+        else if (cmd == COMMAND_SET_CAPABILITIES && len == sizeof(uint32_t)) {
+            std::lock_guard<std::recursive_mutex> lck(dspMtx);
+            clientCapabilities = *(uint32_t*)data;
+            updateCompressor();
         }
         else {
             flog::error("Invalid Command: {0} (len = {1})", (int)cmd, len);
@@ -363,10 +739,19 @@ namespace server {
         sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
     }
 
+    void sendStreamSettings() {
+        StreamSettings settings;
+        settings.sampleType = pcmType;
+        settings.compressionLevel = compressionLevel;
+        settings.decimation = decimRatio;
+        sendStreamCommand(COMMAND_SET_STREAM_SETTINGS, (uint8_t*)&settings, sizeof(StreamSettings));
+    }
+
     void setInputSampleRate(double samplerate) {
+        std::lock_guard<std::recursive_mutex> lck(dspMtx);
         sampleRate = samplerate;
         if (!client || !client->isOpen()) { return; }
-        sendSampleRate(sampleRate);
+        sendSampleRate(sampleRate / (double)decimRatio);
     }
 
     void sendPacket(PacketType type, int len) {
@@ -384,4 +769,16 @@ namespace server {
         s_cmd_hdr->cmd = cmd;
         sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
     }
+
+    void sendStreamCommand(Command cmd, uint8_t* data, int len) {
+        // Uses its own buffer since it's called from the DSP thread while sbuf may be in use
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader) + 64];
+        PacketHeader* tmp_phdr = (PacketHeader*)buf;
+        CommandHeader* tmp_chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+        tmp_phdr->type = PACKET_TYPE_COMMAND;
+        tmp_phdr->size = sizeof(PacketHeader) + sizeof(CommandHeader) + len;
+        tmp_chdr->cmd = cmd;
+        memcpy(&buf[sizeof(PacketHeader) + sizeof(CommandHeader)], data, len);
+        client->write(tmp_phdr->size, buf);
+    }
 }
@@ -3,14 +3,28 @@
 #include <dsp/stream.h>
 #include <dsp/types.h>
 #include <server_protocol.h>
+#include <dsp/compression/pcm_type.h>
 
 namespace server {
     void setInput(dsp::stream<dsp::complex_t>* stream);
+    void setDecimation(int ratio);
     int main();
 
     void _clientHandler(net::Conn conn, void* ctx);
     void _packetHandler(int count, uint8_t* buf, void* ctx);
     void _testServerHandler(uint8_t* data, int count, void* ctx);
+    void _sendHandler(const uint8_t* raw, int rawCount, uint8_t* pkt, int pktSize, void* ctx);
+
+    void updateCompressor();
+    void setCompressionLevel(int level);
+    void applyStreamSettings(dsp::compression::PCMType type, int compLevel, int decimation, bool notify);
+    void setUDP(bool enabled, int port);
+    void sendUDP(const uint8_t* raw, int rawCount);
+    void setAdaptive(bool enabled, int maxDecimation);
+    double estimateLevelCost(int level);
+    void updateAdaptive(const uint8_t* data, int count, int sentBytes, double writeTime);
+    void adaptiveWorker();
+    int sampleTypeSize(dsp::compression::PCMType type);
 
     void drawMenu();
 
@@ -19,9 +33,11 @@ namespace server {
     void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
     void sendError(Error err);
     void sendSampleRate(double sampleRate);
+    void sendStreamSettings();
     void setInputSampleRate(double samplerate);
 
     void sendPacket(PacketType type, int len);
     void sendCommand(Command cmd, int len);
     void sendCommandAck(Command cmd, int len);
+    void sendStreamCommand(Command cmd, uint8_t* data, int len);
 }
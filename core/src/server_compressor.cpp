@@ -0,0 +1,160 @@
+#include "server_compressor.h"
+#include <string.h>
+#include <utils/flog.h>
+
+namespace server {
+    ParallelCompressor::~ParallelCompressor() {
+        if (!_init) { return; }
+        stop();
+        for (auto& cctx : cctxs) { ZSTD_freeCCtx(cctx); }
+    }
+
+    void ParallelCompressor::init(int workerCount, void (*handler)(const uint8_t* raw, int rawCount, uint8_t* pkt, int pktSize, void* ctx), void* ctx) {
+        _handler = handler;
+        _ctx = ctx;
+
+        // One slot per worker plus one being filled and one being sent
+        slots.resize(workerCount + 2);
+        for (auto& slot : slots) { freeSlots.push_back(&slot); }
+        for (int i = 0; i < workerCount; i++) { cctxs.push_back(ZSTD_createCCtx()); }
+
+        _init = true;
+    }
+
+    bool ParallelCompressor::push(const uint8_t* data, int count, int level) {
+        // Wait for a free slot
+        std::unique_lock<std::mutex> lck(mtx);
+        freeCnd.wait(lck, [this]() { return !freeSlots.empty() || stopWorkers; });
+        if (stopWorkers) { return false; }
+        Slot* slot = freeSlots.back();
+        freeSlots.pop_back();
+        lck.unlock();
+
+        // Buffers only grow to the largest size seen to avoid allocating the maximum packet size for every slot
+        slot->rawCount = count;
+        slot->level = level;
+        if (level) {
+            if (slot->raw.size() < count) { slot->raw.resize(count); }
+            memcpy(slot->raw.data(), data, count);
+            slot->done = false;
+        }
+        else {
+            // Uncompressed packets are built in place, there's nothing left for a worker to do
+            size_t size = sizeof(PacketHeader) + count;
+            if (slot->pkt.size() < size) { slot->pkt.resize(size); }
+            PacketHeader* hdr = (PacketHeader*)slot->pkt.data();
+            hdr->type = PACKET_TYPE_BASEBAND;
+            hdr->size = size;
+            memcpy(&slot->pkt[sizeof(PacketHeader)], data, count);
+            slot->pktSize = size;
+            slot->done = true;
+        }
+
+        // Queue for compression if needed and keep track of the order
+        lck.lock();
+        if (level) { jobs.push_back(slot); }
+        pending.push_back(slot);
+        lck.unlock();
+        if (level) {
+            jobCnd.notify_one();
+        }
+        else {
+            doneCnd.notify_all();
+        }
+        return true;
+    }
+
+    void ParallelCompressor::flush() {
+        std::unique_lock<std::mutex> lck(mtx);
+        freeCnd.wait(lck, [this]() { return freeSlots.size() == slots.size() || stopWorkers; });
+    }
+
+    void ParallelCompressor::start() {
+        if (running) { return; }
+        stopWorkers = false;
+        for (auto& cctx : cctxs) {
+            workerThreads.push_back(std::thread(&ParallelCompressor::worker, this, cctx));
+        }
+        senderThread = std::thread(&ParallelCompressor::sender, this);
+        running = true;
+    }
+
+    void ParallelCompressor::stop() {
+        if (!running) { return; }
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopWorkers = true;
+        }
+        freeCnd.notify_all();
+        jobCnd.notify_all();
+        doneCnd.notify_all();
+
+        for (auto& thread : workerThreads) {
+            if (thread.joinable()) { thread.join(); }
+        }
+        workerThreads.clear();
+        if (senderThread.joinable()) { senderThread.join(); }
+
+        // Drop everything that was in flight
+        jobs.clear();
+        pending.clear();
+        freeSlots.clear();
+        for (auto& slot : slots) { freeSlots.push_back(&slot); }
+        running = false;
+    }
+
+    void ParallelCompressor::worker(ZSTD_CCtx* cctx) {
+        while (true) {
+            // Wait for a job
+            std::unique_lock<std::mutex> lck(mtx);
+            jobCnd.wait(lck, [this]() { return !jobs.empty() || stopWorkers; });
+            if (stopWorkers) { return; }
+            Slot* slot = jobs.front();
+            jobs.pop_front();
+            lck.unlock();
+
+            // Compress the packet
+            size_t bound = sizeof(PacketHeader) + ZSTD_compressBound(slot->rawCount);
+            if (slot->pkt.size() < bound) { slot->pkt.resize(bound); }
+            PacketHeader* hdr = (PacketHeader*)slot->pkt.data();
+            size_t size = ZSTD_compressCCtx(cctx, &slot->pkt[sizeof(PacketHeader)], bound - sizeof(PacketHeader), slot->raw.data(), slot->rawCount, slot->level);
+            if (ZSTD_isError(size)) {
+                flog::error("Failed to compress baseband buffer");
+                size = 0;
+            }
+            hdr->type = PACKET_TYPE_BASEBAND_COMPRESSED;
+            hdr->size = sizeof(PacketHeader) + size;
+            slot->pktSize = hdr->size;
+
+            // Let the sender know
+            lck.lock();
+            slot->done = true;
+            lck.unlock();
+            doneCnd.notify_all();
+        }
+    }
+
+    void ParallelCompressor::sender() {
+        while (true) {
+            // Wait for the oldest packet to be done
+            std::unique_lock<std::mutex> lck(mtx);
+            doneCnd.wait(lck, [this]() { return (!pending.empty() && pending.front()->done) || stopWorkers; });
+            if (stopWorkers) { return; }
+            Slot* slot = pending.front();
+            pending.pop_front();
+            lck.unlock();
+
+            // Empty packets are the result of a compression error, uncompressed packets hold the raw data after the header
+            if (slot->pktSize > sizeof(PacketHeader)) {
+                const uint8_t* raw = slot->level ? slot->raw.data() : &slot->pkt[sizeof(PacketHeader)];
+                _handler(raw, slot->rawCount, slot->pkt.data(), slot->pktSize, _ctx);
+            }
+
+            // Release slot
+            lck.lock();
+            freeSlots.push_back(slot);
+            lck.unlock();
+            freeCnd.notify_all();
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <server_protocol.h>
+#include <zstd.h>
+
+#define SERVER_MAX_COMPRESSION_THREADS  4
+
+namespace server {
+    // Compresses baseband buffers on a pool of worker threads and hands the finished packets back in order
+    class ParallelCompressor {
+    public:
+        ParallelCompressor() {}
+        ~ParallelCompressor();
+
+        void init(int workerCount, void (*handler)(const uint8_t* raw, int rawCount, uint8_t* pkt, int pktSize, void* ctx), void* ctx);
+
+        // Queue a buffer for compression, level 0 sends it uncompressed. Blocks if all slots are in use
+        bool push(const uint8_t* data, int count, int level);
+
+        // Wait until every queued buffer has been handed to the handler, must not be called from the handler
+        void flush();
+
+        void start();
+        void stop();
+
+    private:
+        struct Slot {
+            std::vector<uint8_t> raw;
+            std::vector<uint8_t> pkt;
+            int rawCount;
+            int pktSize;
+            int level;
+            bool done;
+        };
+
+        void worker(ZSTD_CCtx* cctx);
+        void sender();
+
+        void (*_handler)(const uint8_t* raw, int rawCount, uint8_t* pkt, int pktSize, void* ctx);
+        void* _ctx;
+
+        std::vector<Slot> slots;
+        std::vector<Slot*> freeSlots;
+        std::deque<Slot*> jobs;
+        std::deque<Slot*> pending;
+
+        std::mutex mtx;
+        std::condition_variable freeCnd;
+        std::condition_variable jobCnd;
+        std::condition_variable doneCnd;
+
+        std::vector<ZSTD_CCtx*> cctxs;
+        std::vector<std::thread> workerThreads;
+        std::thread senderThread;
+
+        bool running = false;
+        bool stopWorkers = false;
+        bool _init = false;
+    };
+}
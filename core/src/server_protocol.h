@@ -5,6 +5,9 @@
 
 #define SERVER_MAX_PACKET_SIZE  (STREAM_BUFFER_SIZE * sizeof(dsp::complex_t) * 2)
 
+// Keeps baseband datagrams under the usual ethernet MTU to avoid IP fragmentation
+#define SERVER_UDP_MAX_PACKET_SIZE  1400
+
 namespace server {
     enum PacketType {
         // Client to Server
@@ -27,10 +30,20 @@ namespace server {
         COMMAND_GET_SAMPLERATE,
         COMMAND_SET_SAMPLE_TYPE,
         COMMAND_SET_COMPRESSION,
+        COMMAND_SET_ADAPTIVE,
+        COMMAND_SET_UDP,
+        COMMAND_SET_CAPABILITIES,
 
         // Server to client
         COMMAND_SET_SAMPLERATE = 0x80,
-        COMMAND_DISCONNECT
+        COMMAND_DISCONNECT,
+        COMMAND_SET_STREAM_SETTINGS
+    };
+
+    // Sent by the client with COMMAND_SET_CAPABILITIES, older clients never send it and get none of them
+    enum Capability {
+        // The client undoes the byte shuffle and delta filters given in the sample stream header
+        CAPABILITY_SHUFFLE = (1 << 0)
     };
 
     enum Error {
@@ -49,5 +62,27 @@ namespace server {
     struct CommandHeader {
         uint32_t cmd;
     };
+
+    struct AdaptiveConfig {
+        uint8_t enabled;
+        uint8_t maxDecimation;
+    };
+
+    struct UDPConfig {
+        uint8_t enabled;
+        uint16_t port;
+    };
+
+    // Prepended to every baseband datagram, followed by a self-contained sample stream buffer
+    struct UDPHeader {
+        uint32_t sequence;
+        uint64_t sampleIndex;
+    };
+
+    struct StreamSettings {
+        uint8_t sampleType;
+        uint8_t compressionLevel;
+        uint8_t decimation;
+    };
 #pragma pack(pop)
 }
\ No newline at end of file
@@ -27,7 +27,9 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
     effectiveSr = _sampleRate / _decimRatio;
 
     inBuf.init(in);
-    inBuf.bypass = !buffering;
+    inBuf.setBypass(!buffering);
+    inBuf.setSampleRate(_sampleRate);
+    inBuf.clock.reset(_sampleRate);
 
     decim.init(NULL, _decimRatio);
     dcBlock.init(NULL, genDCBlockRate(effectiveSr));
@@ -80,8 +82,10 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
         vfo->tempStop();
     }
 
-    // Update the samplerate
+    // Update the samplerate, this starts a new metadata epoch
     _sampleRate = sampleRate;
+    inBuf.setSampleRate(_sampleRate);
+    inBuf.clock.reset(_sampleRate);
     effectiveSr = _sampleRate / _decimRatio;
     dcBlock.setRate(genDCBlockRate(effectiveSr));
     for (auto& [name, vfo] : vfos) {
@@ -98,8 +102,16 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
     }
 }
 
+void IQFrontEnd::setCenterFrequency(double frequency) {
+    inBuf.clock.setFrequency(frequency);
+}
+
 void IQFrontEnd::setBuffering(bool enabled) {
-    inBuf.bypass = !enabled;
+    inBuf.setBypass(!enabled);
+}
+
+void IQFrontEnd::setBufferLatency(double ms) {
+    inBuf.setLatency(ms);
 }
 
 void IQFrontEnd::setDecimation(int ratio) {
@@ -201,7 +213,19 @@ void IQFrontEnd::flushInputBuffer() {
     inBuf.flush();
 }
 
+bool IQFrontEnd::waitIdle(std::chrono::milliseconds timeout) {
+    // Each stage is idle once the one before it is, so the streams are waited on in the order of the chain
+    if (!inBuf.waitIdle(timeout) || !preproc.waitIdle(timeout)) { return false; }
+    for (auto& [name, vfo] : vfos) {
+        if (!vfoStreams[name]->waitIdle(timeout) || !vfo->out.waitIdle(timeout)) { return false; }
+    }
+    return true;
+}
+
 void IQFrontEnd::start() {
+    // Sample indices restart with the stream
+    inBuf.clock.reset(_sampleRate);
+
     // Start input buffer
     inBuf.start();
 
@@ -24,9 +24,11 @@ public:
 
     void setInput(dsp::stream<dsp::complex_t>* in);
     void setSampleRate(double sampleRate);
+    void setCenterFrequency(double frequency);
     inline double getSampleRate() { return _sampleRate / _decimRatio; }
 
     void setBuffering(bool enabled);
+    void setBufferLatency(double ms);
     void setDecimation(int ratio);
     void setInvertIQ(bool enabled);
     void setDCBlocking(bool enabled);
@@ -36,6 +38,7 @@ public:
 
     dsp::channel::RxVFO* addVFO(std::string name, double sampleRate, double bandwidth, double offset);
     void removeVFO(std::string name);
+    inline bool hasVFOs() { return !vfos.empty(); }
 
     void setFFTSize(int size);
     void setFFTRate(double rate);
@@ -43,6 +46,12 @@ public:
 
     void flushInputBuffer();
 
+    // Wait until everything the source wrote went through the front end and was read from the VFOs
+    bool waitIdle(std::chrono::milliseconds timeout);
+    inline float getInputBufferFill() { return inBuf.getFill(); }
+    inline uint64_t getInputBufferOverflows() { return inBuf.getOverflows(); }
+    inline double getInputBufferMaxLatency() { return inBuf.getMaxLatency(); }
+
     void start();
     void stop();
 
@@ -4,52 +4,127 @@
 #include <signal_path/signal_path.h>
 #include <core.h>
 
+// Secondary front ends have no waterfall, their FFT is kept as small and slow as possible
+#define SECONDARY_FFT_SIZE  512
+#define SECONDARY_FFT_RATE  1.0
+
+thread_local SourceManager::SecondarySource* SourceManager::currentSecondary = NULL;
+
+static float* acquireNullFFTBuffer(void* ctx) {
+    // Returning NULL makes the front end skip the conversion
+    return NULL;
+}
+
+static void releaseNullFFTBuffer(void* ctx) {}
+
 SourceManager::SourceManager() {
 }
 
 void SourceManager::registerSource(std::string name, SourceHandler* handler) {
-    if (sources.find(name) != sources.end()) {
-        flog::error("Tried to register new source with existing name: {0}", name);
-        return;
+    SecondarySource* sec = NULL;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (sources.find(name) != sources.end()) {
+            flog::error("Tried to register new source with existing name: {0}", name);
+            return;
+        }
+        sources[name] = handler;
+
+        // Reattach a secondary source whose module was reloaded while VFOs were still using it
+        auto sit = secondaries.find(name);
+        if (sit != secondaries.end()) {
+            sec = sit->second;
+            sec->handler = handler;
+        }
     }
-    sources[name] = handler;
+    if (sec) {
+        sec->frontEnd->setInput(handler->stream);
+        callSecondary(sec, [=]() { handler->selectHandler(handler->ctx); });
+        sec->frontEnd->start();
+    }
+
     onSourceRegistered.emit(name);
 }
 
 void SourceManager::unregisterSource(std::string name) {
-    if (sources.find(name) == sources.end()) {
-        flog::error("Tried to unregister non existent source: {0}", name);
-        return;
+    bool selected;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (sources.find(name) == sources.end()) {
+            flog::error("Tried to unregister non existent source: {0}", name);
+            return;
+        }
+        selected = (name == selectedName);
     }
     onSourceUnregister.emit(name);
-    if (name == selectedName) {
+
+    // Detach a secondary source. If VFOs still use its front end, it is kept stopped until the source comes back.
+    // It stays in the map until its handlers were called so that the source still knows it is a secondary.
+    SecondarySource* sec = findSecondary(name);
+    if (sec) {
+        if (sec->running) { stopSecondary(name); }
+        callSecondary(sec, [=]() { sec->handler->deselectHandler(sec->handler->ctx); });
+        sec->frontEnd->stop();
+        bool remove;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            sec->handler = NULL;
+            remove = !sec->frontEnd->hasVFOs();
+            if (remove) { secondaries.erase(name); }
+        }
+        if (remove) {
+            delete sec->frontEnd;
+            delete sec;
+        }
+    }
+
+    if (selected) {
         if (selectedHandler != NULL) {
-            sources[selectedName]->deselectHandler(sources[selectedName]->ctx);
+            selectedHandler->deselectHandler(selectedHandler->ctx);
         }
         sigpath::iqFrontEnd.setInput(&nullSource);
         selectedHandler = NULL;
     }
-    sources.erase(name);
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        sources.erase(name);
+    }
     onSourceUnregistered.emit(name);
 }
 
 std::vector<std::string> SourceManager::getSourceNames() {
+    std::lock_guard<std::mutex> lck(mtx);
     std::vector<std::string> names;
     for (auto const& [name, src] : sources) { names.push_back(name); }
     return names;
 }
 
 void SourceManager::selectSource(std::string name) {
-    if (sources.find(name) == sources.end()) {
-        flog::error("Tried to select non existent source: {0}", name);
+    SourceHandler* handler;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        auto it = sources.find(name);
+        if (it == sources.end()) {
+            flog::error("Tried to select non existent source: {0}", name);
+            return;
+        }
+        handler = it->second;
+    }
+    if (isSecondary(name) && !closeSecondary(name)) {
+        flog::error("Cannot select source '{0}' while it is used as a secondary source", name);
         return;
     }
     if (selectedHandler != NULL) {
-        sources[selectedName]->deselectHandler(sources[selectedName]->ctx);
+        selectedHandler->deselectHandler(selectedHandler->ctx);
     }
-    selectedHandler = sources[name];
+    // The name is set first so that the samplerate the source announces when selected is routed to the main front end
+    selectedHandler = handler;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        selectedName = name;
+    }
+    if (selectedHandler->stats) { selectedHandler->stats->reset(); }
     selectedHandler->selectHandler(selectedHandler->ctx);
-    selectedName = name;
     if (core::args["server"].b()) {
         server::setInput(selectedHandler->stream);
     }
@@ -70,6 +145,10 @@ void SourceManager::start() {
     if (selectedHandler == NULL) {
         return;
     }
+    if (selectedHandler->stats) {
+        selectedHandler->stats->reset();
+        selectedHandler->stats->setSampleRate(sampleRate);
+    }
     selectedHandler->startHandler(selectedHandler->ctx);
 }
 
@@ -86,6 +165,7 @@ void SourceManager::tune(double freq) {
     }
     // TODO: No need to always retune the hardware in panadpter mode
     selectedHandler->tuneHandler(((tuneMode == TuningMode::NORMAL) ? freq : ifFreq) + tuneOffset, selectedHandler->ctx);
+    sigpath::iqFrontEnd.setCenterFrequency(freq);
     onRetune.emit(freq);
     currentFreq = freq;
 }
@@ -103,4 +183,192 @@ void SourceManager::setTuningMode(TuningMode mode) {
 void SourceManager::setPanadpterIF(double freq) {
     ifFreq = freq;
     tune(currentFreq);
-}
\ No newline at end of file
+}
+void SourceManager::setSampleRate(double sampleRate) {
+    this->sampleRate = sampleRate;
+    if (selectedHandler && selectedHandler->stats) { selectedHandler->stats->setSampleRate(sampleRate); }
+}
+
+bool SourceManager::getStats(SourceStats::Snapshot& stats) {
+    if (!selectedHandler || !selectedHandler->stats) { return false; }
+    stats = selectedHandler->stats->get();
+    return true;
+}
+
+template <typename Func>
+void SourceManager::callSecondary(SecondarySource* sec, Func func) {
+    SecondarySource* prev = currentSecondary;
+    currentSecondary = sec;
+    func();
+    currentSecondary = prev;
+}
+
+bool SourceManager::openSecondary(std::string name) {
+    SourceHandler* handler;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (secondaries.find(name) != secondaries.end()) { return true; }
+        auto it = sources.find(name);
+        if (it == sources.end()) {
+            flog::error("Tried to open non existent source as secondary: {0}", name);
+            return false;
+        }
+        if (name == selectedName) {
+            flog::error("Cannot open the selected source '{0}' as a secondary source", name);
+            return false;
+        }
+        handler = it->second;
+    }
+
+    // Without buffering, the source is only throttled by its own DSP. The samplerate is set by the source when selected.
+    SecondarySource* sec = new SecondarySource;
+    sec->handler = handler;
+    sec->frontEnd = new IQFrontEnd;
+    sec->frontEnd->init(sec->handler->stream, 1000000.0, false, 1, false, SECONDARY_FFT_SIZE, SECONDARY_FFT_RATE, IQFrontEnd::FFTWindow::NUTTALL, acquireNullFFTBuffer, releaseNullFFTBuffer, NULL);
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        secondaries[name] = sec;
+    }
+
+    if (sec->handler->stats) { sec->handler->stats->reset(); }
+    callSecondary(sec, [=]() { sec->handler->selectHandler(sec->handler->ctx); });
+    sec->frontEnd->start();
+
+    flog::info("Opened secondary source '{0}'", name);
+    return true;
+}
+
+bool SourceManager::closeSecondary(std::string name) {
+    SecondarySource* sec = findSecondary(name);
+    if (!sec) { return true; }
+
+    // The VFOs hold pointers into the front end, it has to outlive them
+    if (sec->frontEnd->hasVFOs()) {
+        flog::error("Cannot close secondary source '{0}' while VFOs are using it", name);
+        return false;
+    }
+
+    if (sec->handler) {
+        if (sec->running) { stopSecondary(name); }
+        callSecondary(sec, [=]() { sec->handler->deselectHandler(sec->handler->ctx); });
+    }
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        secondaries.erase(name);
+    }
+    delete sec->frontEnd;
+    delete sec;
+
+    flog::info("Closed secondary source '{0}'", name);
+    return true;
+}
+
+void SourceManager::startSecondary(std::string name) {
+    SecondarySource* sec = findSecondary(name);
+    if (!sec || !sec->handler || sec->running) { return; }
+    if (sec->handler->stats) {
+        sec->handler->stats->reset();
+        sec->handler->stats->setSampleRate(sec->sampleRate);
+    }
+    callSecondary(sec, [=]() { sec->handler->startHandler(sec->handler->ctx); });
+    sec->running = true;
+}
+
+void SourceManager::stopSecondary(std::string name) {
+    SecondarySource* sec = findSecondary(name);
+    if (!sec || !sec->handler || !sec->running) { return; }
+    callSecondary(sec, [=]() { sec->handler->stopHandler(sec->handler->ctx); });
+    sec->running = false;
+}
+
+void SourceManager::tuneSecondary(std::string name, double freq) {
+    SecondarySource* sec = findSecondary(name);
+    if (!sec || !sec->handler) { return; }
+    callSecondary(sec, [=]() { sec->handler->tuneHandler(freq, sec->handler->ctx); });
+    sec->frontEnd->setCenterFrequency(freq);
+}
+
+void SourceManager::showSecondaryMenu(std::string name) {
+    SecondarySource* sec = findSecondary(name);
+    if (!sec || !sec->handler) { return; }
+    callSecondary(sec, [=]() { sec->handler->menuHandler(sec->handler->ctx); });
+}
+
+bool SourceManager::isSecondary(std::string name) {
+    return findSecondary(name) != NULL;
+}
+
+bool SourceManager::isSecondaryRunning(std::string name) {
+    SecondarySource* sec = findSecondary(name);
+    return sec && sec->running;
+}
+
+bool SourceManager::getSecondaryStats(std::string name, SourceStats::Snapshot& stats) {
+    SecondarySource* sec = findSecondary(name);
+    if (!sec || !sec->handler || !sec->handler->stats) { return false; }
+    stats = sec->handler->stats->get();
+    return true;
+}
+
+std::vector<std::string> SourceManager::getSecondaryNames() {
+    std::lock_guard<std::mutex> lck(mtx);
+    std::vector<std::string> names;
+    for (auto const& [name, sec] : secondaries) { names.push_back(name); }
+    return names;
+}
+
+bool SourceManager::setSecondaryFrequency(std::string name, double freq) {
+    std::lock_guard<std::mutex> lck(mtx);
+    auto sit = secondaries.find(name);
+    if (sit == secondaries.end()) { return false; }
+    sit->second->frontEnd->setCenterFrequency(freq);
+    return true;
+}
+
+IQFrontEnd* SourceManager::getVFOFrontEnd(std::string name) {
+    size_t sep = name.find(SECONDARY_VFO_SEPARATOR);
+    if (sep == std::string::npos) { return &sigpath::iqFrontEnd; }
+
+    std::string srcName = name.substr(0, sep);
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (srcName == selectedName) { return &sigpath::iqFrontEnd; }
+        if (sources.find(srcName) == sources.end() && secondaries.find(srcName) == secondaries.end()) {
+            flog::warn("VFO '{0}' refers to unknown source '{1}', using the selected source instead", name, srcName);
+            return &sigpath::iqFrontEnd;
+        }
+    }
+    if (!openSecondary(srcName)) { return &sigpath::iqFrontEnd; }
+    return findSecondary(srcName)->frontEnd;
+}
+
+bool SourceManager::routeSampleRate(double sampleRate) {
+    SecondarySource* sec = currentSecondary;
+    if (!sec) { return false; }
+    setSecondarySampleRate(sec, sampleRate);
+    return true;
+}
+
+bool SourceManager::routeSampleRate(std::string name, double sampleRate) {
+    // Applied under the lock so that the secondary can't be closed meanwhile
+    std::lock_guard<std::mutex> lck(mtx);
+    auto sit = secondaries.find(name);
+    if (sit != secondaries.end()) {
+        setSecondarySampleRate(sit->second, sampleRate);
+        return true;
+    }
+    return name != selectedName;
+}
+
+SourceManager::SecondarySource* SourceManager::findSecondary(std::string name) {
+    std::lock_guard<std::mutex> lck(mtx);
+    auto sit = secondaries.find(name);
+    return (sit != secondaries.end()) ? sit->second : NULL;
+}
+
+void SourceManager::setSecondarySampleRate(SecondarySource* sec, double sampleRate) {
+    sec->sampleRate = sampleRate;
+    if (sec->handler && sec->handler->stats) { sec->handler->stats->setSampleRate(sampleRate); }
+    sec->frontEnd->setSampleRate(sampleRate);
+    flog::info("New secondary source samplerate: {0}", sampleRate);
+}
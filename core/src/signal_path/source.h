@@ -2,9 +2,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <dsp/stream.h>
 #include <dsp/types.h>
 #include <utils/event.h>
+#include "source_stats.h"
+
+// Separates the source name from the VFO name for VFOs created on a secondary source
+#define SECONDARY_VFO_SEPARATOR '/'
+
+class IQFrontEnd;
 
 class SourceManager {
 public:
@@ -19,6 +26,7 @@ public:
         void (*stopHandler)(void* ctx);
         void (*tuneHandler)(double freq, void* ctx);
         void* ctx;
+        SourceStats* stats = NULL;
     };
 
     enum TuningMode {
@@ -36,6 +44,40 @@ public:
     void setTuningOffset(double offset);
     void setTuningMode(TuningMode mode);
     void setPanadpterIF(double freq);
+    void setSampleRate(double sampleRate);
+
+    // Get the statistics of the selected source, returns false if it doesn't keep any
+    bool getStats(SourceStats::Snapshot& stats);
+
+    // Secondary sources run alongside the selected one, each on its own IQ front end. VFOs are created on
+    // them by prefixing the VFO name with the source name and a slash, eg. "RTL-SDR 2/Radio".
+    bool openSecondary(std::string name);
+    bool closeSecondary(std::string name);
+    void startSecondary(std::string name);
+    void stopSecondary(std::string name);
+    void tuneSecondary(std::string name, double freq);
+    void showSecondaryMenu(std::string name);
+    bool isSecondary(std::string name);
+    bool isSecondaryRunning(std::string name);
+    bool getSecondaryStats(std::string name, SourceStats::Snapshot& stats);
+    std::vector<std::string> getSecondaryNames();
+
+    // For sources that follow a frequency given by their data instead of being tuned. If the source is open as a
+    // secondary, only its own front end is updated and true is returned, otherwise the caller should retune the
+    // main one. Safe to call from any thread.
+    bool setSecondaryFrequency(std::string name, double freq);
+
+    // Front end a VFO should be created on given its name, the main one unless the name is prefixed by the
+    // name of a source other than the selected one, which is then opened as a secondary source if needed
+    IQFrontEnd* getVFOFrontEnd(std::string name);
+
+    // Called by the core when a source announces its samplerate. Returns true if the call came from a
+    // secondary source, in which case only its own front end is updated.
+    bool routeSampleRate(double sampleRate);
+
+    // Same but for a source identified by the name it was registered with, so that it works from any thread.
+    // Also returns true for a source that is neither selected nor secondary, whose samplerate goes nowhere.
+    bool routeSampleRate(std::string name, double sampleRate);
 
     std::vector<std::string> getSourceNames();
 
@@ -45,12 +87,37 @@ public:
     Event<double> onRetune;
 
 private:
+    struct SecondarySource {
+        SourceHandler* handler;
+        IQFrontEnd* frontEnd;
+        double sampleRate = 0.0;
+        bool running = false;
+    };
+
+    // Calls into a secondary source's handlers are wrapped in this so that the samplerate it sets is routed
+    // to its front end and not to the main one
+    template <typename Func>
+    void callSecondary(SecondarySource* sec, Func func);
+
+    void setSecondarySampleRate(SecondarySource* sec, double sampleRate);
+
+    // Secondary source of the given name or NULL. Only the thread that opens and closes secondary sources may
+    // keep the pointer after the lock is released.
+    SecondarySource* findSecondary(std::string name);
+
+    static thread_local SecondarySource* currentSecondary;
+
+    // Protects the maps and the selected name, which sources read from their own threads when announcing a
+    // new samplerate or frequency. Handlers are never called with it held since they may wait for those threads.
+    std::mutex mtx;
     std::map<std::string, SourceHandler*> sources;
+    std::map<std::string, SecondarySource*> secondaries;
     std::string selectedName;
     SourceHandler* selectedHandler = NULL;
     double tuneOffset;
     double currentFreq;
     double ifFreq = 0.0;
+    double sampleRate = 0.0;
     TuningMode tuneMode = TuningMode::NORMAL;
     dsp::stream<dsp::complex_t> nullSource;
 };
\ No newline at end of file
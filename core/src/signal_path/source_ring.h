@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <dsp/stream.h>
+#include <dsp/types.h>
+#include <dsp/buffer/buffer.h>
+#include <utils/flog.h>
+#include "source_stats.h"
+
+// How much signal the ring can hold before overflowing
+#define SOURCE_RING_DURATION        0.5
+// Duration of a slot, same as the block size most sources use
+#define SOURCE_RING_SLOT_DURATION   0.005
+#define SOURCE_RING_MIN_SLOTS       8
+// Minimum time between two overflow warnings
+#define SOURCE_RING_LOG_INTERVAL    std::chrono::seconds(1)
+
+// Hands samples over from a driver callback to the DSP without ever blocking the callback. The callback
+// converts its samples into fixed size slots and a thread of the ring pushes them into the stream. When the
+// DSP falls behind for longer than the ring can hold, the samples are dropped and counted instead of stalling
+// the USB transfers. Buffers are stamped when they arrive so that the ring's latency doesn't skew their time.
+class SourceRing {
+public:
+    SourceRing() {}
+
+    SourceRing(std::string name, dsp::stream<dsp::complex_t>* out, SourceStats* stats = NULL) { init(name, out, stats); }
+
+    ~SourceRing() {
+        stop();
+        if (slots) { dsp::buffer::free(slots); }
+        delete[] sizes;
+        delete[] metas;
+    }
+
+    void init(std::string name, dsp::stream<dsp::complex_t>* out, SourceStats* stats = NULL) {
+        this->name = name;
+        this->out = out;
+        this->stats = stats;
+    }
+
+    // Size the ring for the samplerate and start pushing. Must be called before the driver is started.
+    void start(double sampleRate, double frequency) {
+        if (running) { return; }
+        int newSlotSize = std::max<int>(sampleRate * SOURCE_RING_SLOT_DURATION, 1);
+        int newSlotCount = std::max<int>(SOURCE_RING_DURATION / SOURCE_RING_SLOT_DURATION, SOURCE_RING_MIN_SLOTS);
+        if (newSlotSize != slotSize || newSlotCount != slotCount) {
+            if (slots) { dsp::buffer::free(slots); }
+            delete[] sizes;
+            delete[] metas;
+            slotSize = newSlotSize;
+            slotCount = newSlotCount;
+            slots = dsp::buffer::alloc<dsp::complex_t>(slotSize * slotCount);
+            sizes = new int[slotCount];
+            metas = new dsp::StreamMeta[slotCount];
+        }
+
+        writeIdx = 0;
+        readIdx = 0;
+        overflows = 0;
+        lastLog = std::chrono::steady_clock::time_point();
+        clock.reset(sampleRate);
+        clock.setFrequency(frequency);
+
+        stopWorker = false;
+        workerThread = std::thread(&SourceRing::worker, this);
+        running = true;
+    }
+
+    // Stop pushing. Must be called once the driver no longer calls write().
+    void stop() {
+        if (!running) { return; }
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopWorker = true;
+        }
+        cnd.notify_all();
+        out->stopWriter();
+        if (workerThread.joinable()) { workerThread.join(); }
+        out->clearWriteStop();
+        running = false;
+    }
+
+    void setFrequency(double frequency) { clock.setFrequency(frequency); }
+
+    // Account for samples the driver reported as lost
+    void skip(uint64_t count) { clock.skip(count); }
+
+    // Write count samples from the callback. convert(dst, offset, n) must write n samples starting at sample
+    // offset of the driver's buffer into dst, it is called once per slot. Returns false if samples were dropped.
+    template <typename Func>
+    bool write(int count, Func convert) {
+        bool complete = true;
+        for (int offset = 0; offset < count;) {
+            int n = std::min<int>(count - offset, slotSize);
+            uint64_t w = writeIdx.load(std::memory_order_relaxed);
+            if (w - readIdx.load(std::memory_order_acquire) >= (uint64_t)slotCount) {
+                overflow(count - offset);
+                complete = false;
+                break;
+            }
+
+            int slot = w % slotCount;
+            convert(&slots[slot * slotSize], offset, n);
+            sizes[slot] = n;
+            metas[slot] = clock.stamp(n);
+            writeIdx.store(w + 1, std::memory_order_release);
+            offset += n;
+        }
+
+        // Take the lock so that the notification can't slip between the worker's check and its wait
+        { std::lock_guard<std::mutex> lck(mtx); }
+        cnd.notify_one();
+        return complete;
+    }
+
+    // Write samples that are already complex floats
+    bool write(const dsp::complex_t* data, int count) {
+        return write(count, [data](dsp::complex_t* dst, int offset, int n) {
+            memcpy(dst, &data[offset], n * sizeof(dsp::complex_t));
+        });
+    }
+
+    uint64_t getOverflows() { return overflows; }
+
+    float getFill() {
+        if (!slotCount) { return 0.0f; }
+        return (float)(writeIdx.load() - readIdx.load()) / (float)slotCount;
+    }
+
+private:
+    void overflow(int count) {
+        overflows++;
+        clock.skip(count);
+        if (stats) { stats->addDropped(count); }
+
+        // Don't flood the log when the DSP can't keep up at all
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastLog >= SOURCE_RING_LOG_INTERVAL) {
+            lastLog = now;
+            flog::warn("Source '{0}': ring overflow, dropped {1} samples ({2} overflows so far)", name, count, (uint64_t)overflows);
+        }
+    }
+
+    void worker() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cnd.wait(lck, [this]() { return writeIdx.load(std::memory_order_acquire) != readIdx.load(std::memory_order_relaxed) || stopWorker; });
+                if (stopWorker) { break; }
+            }
+
+            uint64_t r = readIdx.load(std::memory_order_relaxed);
+            int slot = r % slotCount;
+            int count = sizes[slot];
+            memcpy(out->writeBuf, &slots[slot * slotSize], count * sizeof(dsp::complex_t));
+            out->writeMeta = metas[slot];
+            readIdx.store(r + 1, std::memory_order_release);
+
+            if (!out->swap(count)) { break; }
+            if (stats) { stats->addSamples(count); }
+        }
+    }
+
+    std::string name;
+    dsp::stream<dsp::complex_t>* out = NULL;
+    SourceStats* stats = NULL;
+    dsp::StreamClock clock;
+
+    dsp::complex_t* slots = NULL;
+    int* sizes = NULL;
+    dsp::StreamMeta* metas = NULL;
+    int slotSize = 0;
+    int slotCount = 0;
+
+    // Monotonic slot indices, only the callback moves writeIdx and only the worker moves readIdx
+    std::atomic<uint64_t> writeIdx = 0;
+    std::atomic<uint64_t> readIdx = 0;
+    std::atomic<uint64_t> overflows = 0;
+    std::chrono::steady_clock::time_point lastLog;
+
+    std::mutex mtx;
+    std::condition_variable cnd;
+    bool stopWorker = false;
+    bool running = false;
+    std::thread workerThread;
+};
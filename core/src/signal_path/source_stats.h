@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <dsp/stream.h>
+#include <dsp/types.h>
+
+// Statistics kept by a source about the samples it delivered and the ones it lost. All updates are lock free
+// so that they can be done straight from driver callbacks.
+class SourceStats {
+public:
+    struct Snapshot {
+        uint64_t samples = 0;           // Samples delivered to the DSP
+        uint64_t droppedSamples = 0;    // Samples known to have been lost
+        uint64_t drops = 0;             // Number of times samples were lost
+        uint64_t overruns = 0;          // Overflows signalled by the driver or hardware, amount unknown
+        uint64_t stalls = 0;            // Deliveries that waited on the DSP longer than the block lasts
+        int64_t startTime = 0;          // Unix time in ms at which the counters were reset
+        int64_t lastGapTime = 0;        // Unix time in ms of the last drop, overrun or stall, 0 if none
+        uint64_t lastGapSample = 0;     // Value of the sample counter at the last gap
+
+        uint64_t gaps() const { return drops + overruns + stalls; }
+    };
+
+    void reset() {
+        samples = 0;
+        droppedSamples = 0;
+        drops = 0;
+        overruns = 0;
+        stalls = 0;
+        lastGapTime = 0;
+        lastGapSample = 0;
+        startTime = now();
+    }
+
+    // Used to tell how long a block lasts, set by the core whenever the source changes its samplerate
+    void setSampleRate(double sampleRate) { this->sampleRate = sampleRate; }
+
+    // Swap the stream and count the samples. If the swap had to wait for the DSP longer than the duration of
+    // the block, the driver's own buffers were filling up in the meantime and this is counted as a stall.
+    inline bool swap(dsp::stream<dsp::complex_t>* stream, int count) {
+        auto start = std::chrono::steady_clock::now();
+        if (!stream->swap(count)) { return false; }
+        double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double sr = sampleRate;
+        if (sr > 0 && waited > (double)count / sr) {
+            stalls++;
+            markGap();
+        }
+        samples += count;
+        return true;
+    }
+
+    void addSamples(uint64_t count) { samples += count; }
+
+    void addDropped(uint64_t count) {
+        droppedSamples += count;
+        drops++;
+        markGap();
+    }
+
+    void addOverrun() {
+        overruns++;
+        markGap();
+    }
+
+    Snapshot get() {
+        Snapshot snap;
+        snap.samples = samples;
+        snap.droppedSamples = droppedSamples;
+        snap.drops = drops;
+        snap.overruns = overruns;
+        snap.stalls = stalls;
+        snap.startTime = startTime;
+        snap.lastGapTime = lastGapTime;
+        snap.lastGapSample = lastGapSample;
+        return snap;
+    }
+
+private:
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void markGap() {
+        lastGapTime = now();
+        lastGapSample = samples.load();
+    }
+
+    std::atomic<uint64_t> samples = 0;
+    std::atomic<uint64_t> droppedSamples = 0;
+    std::atomic<uint64_t> drops = 0;
+    std::atomic<uint64_t> overruns = 0;
+    std::atomic<uint64_t> stalls = 0;
+    std::atomic<int64_t> startTime = 0;
+    std::atomic<int64_t> lastGapTime = 0;
+    std::atomic<uint64_t> lastGapSample = 0;
+    std::atomic<double> sampleRate = 0;
+};
@@ -5,7 +5,8 @@
 VFOManager::VFO::VFO(std::string name, int reference, double offset, double bandwidth, double sampleRate, double minBandwidth, double maxBandwidth, bool bandwidthLocked) {
     this->name = name;
     _bandwidth = bandwidth;
-    dspVFO = sigpath::iqFrontEnd.addVFO(name, sampleRate, bandwidth, offset);
+    frontEnd = sigpath::sourceManager.getVFOFrontEnd(name);
+    dspVFO = frontEnd->addVFO(name, sampleRate, bandwidth, offset);
     wtfVFO = new ImGui::WaterfallVFO;
     wtfVFO->setReference(reference);
     wtfVFO->setBandwidth(bandwidth);
@@ -14,16 +15,20 @@ VFOManager::VFO::VFO(std::string name, int reference, double offset, double band
     wtfVFO->maxBandwidth = maxBandwidth;
     wtfVFO->bandwidthLocked = bandwidthLocked;
     output = &dspVFO->out;
-    gui::waterfall.vfos[name] = wtfVFO;
+
+    // Only VFOs of the selected source are shown on the waterfall
+    if (frontEnd == &sigpath::iqFrontEnd) { gui::waterfall.vfos[name] = wtfVFO; }
 }
 
 VFOManager::VFO::~VFO() {
     dspVFO->stop();
-    gui::waterfall.vfos.erase(name);
-    if (gui::waterfall.selectedVFO == name) {
-        gui::waterfall.selectFirstVFO();
+    if (frontEnd == &sigpath::iqFrontEnd) {
+        gui::waterfall.vfos.erase(name);
+        if (gui::waterfall.selectedVFO == name) {
+            gui::waterfall.selectFirstVFO();
+        }
     }
-    sigpath::iqFrontEnd.removeVFO(name);
+    frontEnd->removeVFO(name);
     delete wtfVFO;
 }
 
@@ -3,6 +3,8 @@
 #include <gui/widgets/waterfall.h>
 #include <utils/event.h>
 
+class IQFrontEnd;
+
 class VFOManager {
 public:
     VFOManager();
@@ -35,6 +37,7 @@ public:
 
     private:
         std::string name;
+        IQFrontEnd* frontEnd;
         double _bandwidth;
 
     };
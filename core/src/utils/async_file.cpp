@@ -0,0 +1,403 @@
+#include "async_file.h"
+#include <utils/flog.h>
+#include <volk/volk.h>
+#include <string.h>
+#include <fcntl.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#endif
+
+namespace io {
+    IOThread::~IOThread() { stop(); }
+
+    void IOThread::start() {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (running) { return; }
+        stopWorker = false;
+        pending = 0;
+        workerThread = std::thread(&IOThread::worker, this);
+        running = true;
+    }
+
+    void IOThread::stop() {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            if (!running) { return; }
+            detachCnd.wait(lck, [this]() { return files.empty(); });
+            stopWorker = true;
+        }
+        cnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+        running = false;
+    }
+
+    bool IOThread::isRunning() {
+        std::lock_guard<std::mutex> lck(mtx);
+        return running;
+    }
+
+    void IOThread::attach(AsyncFile* file) {
+        std::lock_guard<std::mutex> lck(mtx);
+        files.push_back(file);
+    }
+
+    void IOThread::detach(AsyncFile* file) {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            auto it = std::find(files.begin(), files.end(), file);
+            if (it != files.end()) { files.erase(it); }
+        }
+        detachCnd.notify_all();
+    }
+
+    void IOThread::notify() {
+        // Take the lock so that the notification can't slip between the worker's check and its wait
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            pending++;
+        }
+        cnd.notify_one();
+    }
+
+    void IOThread::worker() {
+        while (true) {
+            AsyncFile* file = NULL;
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cnd.wait(lck, [this]() { return pending || stopWorker; });
+                if (!pending) { break; }
+
+                // Serve the files in turn so that a busy one doesn't starve the others
+                for (size_t i = 0; i < files.size(); i++) {
+                    AsyncFile* f = files[(next + i) % files.size()];
+                    if (!f->hasQueued()) { continue; }
+                    file = f;
+                    next = (next + i + 1) % files.size();
+                    break;
+                }
+                if (!file) {
+                    pending = 0;
+                    continue;
+                }
+            }
+
+            // Only this thread takes buffers from the queue, so the file can't be closed before they're written
+            int written = file->writeQueued();
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                pending -= std::min<uint64_t>(pending, written);
+            }
+        }
+    }
+
+    AsyncFile::~AsyncFile() { close(); }
+
+    bool AsyncFile::open(std::string path, int depth, bool direct, bool preallocate, IOThread* io) {
+        // Close previous file
+        if (opened) { close(); }
+
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+        direct = false;
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        fd = -1;
+#ifdef __linux__
+        // Not every filesystem supports direct I/O, fall back to buffered I/O if it's refused
+        if (direct) {
+            fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            if (fd < 0) { flog::warn("Direct I/O not available for '{0}', using buffered I/O", path); }
+        }
+        direct = (fd >= 0);
+#endif
+        if (fd < 0) { fd = ::open(path.c_str(), flags, 0644); }
+#ifdef __APPLE__
+        if (fd >= 0 && direct) { fcntl(fd, F_NOCACHE, 1); }
+        direct = false;
+#endif
+#endif
+        if (fd < 0) { return false; }
+
+        // Reset state
+        this->path = path;
+        this->direct = direct;
+        this->preallocate = preallocate;
+        allocated = 0;
+        this->depth = std::max<int>(depth, 2);
+        size = 0;
+        cur = NULL;
+        overflows = 0;
+        droppedBytes = 0;
+        failed = false;
+
+        // Use the shared I/O thread or start our own
+        if (!io || !io->isRunning()) {
+            ownIO.start();
+            io = &ownIO;
+        }
+        this->io = io;
+        io->attach(this);
+
+        opened = true;
+        return true;
+    }
+
+    bool AsyncFile::isOpen() {
+        return opened;
+    }
+
+    void AsyncFile::close() {
+        if (!opened) { return; }
+
+        // Queue the partially filled buffer and let the I/O thread finish everything that's queued
+        if (cur) { enqueue(cur); }
+        cur = NULL;
+        drain();
+        io->detach(this);
+        if (io == &ownIO) { ownIO.stop(); }
+        io = NULL;
+
+        // Direct I/O pads the last buffer to the alignment, cut the padding off along with the unused preallocation
+#ifdef _WIN32
+        _chsize_s(fd, size);
+        _close(fd);
+#else
+        if (ftruncate(fd, size)) { flog::error("Could not truncate '{0}' to its final size", path); }
+        ::close(fd);
+#endif
+        fd = -1;
+
+        // Free buffers
+        for (auto& buf : buffers) {
+            volk_free(buf->data);
+            delete buf;
+        }
+        buffers.clear();
+        freeBufs.clear();
+        queued.clear();
+
+        opened = false;
+    }
+
+    bool AsyncFile::write(const uint8_t* data, size_t len) {
+        if (!opened) { return false; }
+
+        // Make sure the data fits before copying anything so that it's either entirely written or not at all
+        size_t room = cur ? (ASYNC_FILE_BUFFER_SIZE - cur->len) : 0;
+        if (len > room) {
+            size_t needed = (len - room + ASYNC_FILE_BUFFER_SIZE - 1) / ASYNC_FILE_BUFFER_SIZE;
+            std::lock_guard<std::mutex> lck(queueMtx);
+            size_t available = freeBufs.size() + (depth - buffers.size());
+            if (needed > available) {
+                overflows++;
+                droppedBytes += len;
+                return false;
+            }
+        }
+
+        while (len) {
+            if (!cur) {
+                cur = takeBuffer();
+                cur->offset = size;
+                cur->len = 0;
+            }
+
+            size_t n = std::min<size_t>(len, ASYNC_FILE_BUFFER_SIZE - cur->len);
+            memcpy(&cur->data[cur->len], data, n);
+            cur->len += n;
+            size += n;
+            data += n;
+            len -= n;
+
+            // Hand full buffers to the I/O thread
+            if (cur->len == ASYNC_FILE_BUFFER_SIZE) {
+                enqueue(cur);
+                cur = NULL;
+            }
+        }
+
+        return true;
+    }
+
+    void AsyncFile::writeAt(uint64_t pos, const uint8_t* data, size_t len) {
+        if (!opened) { return; }
+        uint64_t end = std::min<uint64_t>(pos + len, size);
+        if (end <= pos) { return; }
+
+        // Patch the part that is still in the buffer being filled
+        if (cur && end > cur->offset) {
+            uint64_t start = std::max<uint64_t>(pos, cur->offset);
+            memcpy(&cur->data[start - cur->offset], &data[start - pos], end - start);
+            end = start;
+        }
+        if (end <= pos) { return; }
+
+        // The rest is on its way to the disk, wait for it to land then overwrite it. The write is unaligned
+        // so direct I/O is turned off for the rest of the file.
+        drain();
+        setDirect(false);
+        if (!writeToDisk(pos, data, end - pos)) {
+            flog::error("Could not write to '{0}'", path);
+            failed = true;
+        }
+    }
+
+    uint64_t AsyncFile::tell() {
+        return size;
+    }
+
+    float AsyncFile::getFill() {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        if (!depth) { return 0.0f; }
+        return (float)queued.size() / (float)depth;
+    }
+
+    AsyncFile::Buffer* AsyncFile::takeBuffer() {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        if (!freeBufs.empty()) {
+            Buffer* buf = freeBufs.back();
+            freeBufs.pop_back();
+            return buf;
+        }
+        Buffer* buf = new Buffer;
+        buf->data = (uint8_t*)volk_malloc(ASYNC_FILE_BUFFER_SIZE, ASYNC_FILE_ALIGNMENT);
+        buffers.push_back(buf);
+        return buf;
+    }
+
+    void AsyncFile::enqueue(Buffer* buf) {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            queued.push_back(buf);
+        }
+        io->notify();
+    }
+
+    void AsyncFile::drain() {
+        std::unique_lock<std::mutex> lck(queueMtx);
+        drainCnd.wait(lck, [this]() { return queued.empty() && !writing; });
+    }
+
+    void AsyncFile::setDirect(bool enabled) {
+        if (direct == enabled) { return; }
+#ifdef __linux__
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, enabled ? (flags | O_DIRECT) : (flags & ~O_DIRECT));
+#endif
+        direct = enabled;
+    }
+
+    void AsyncFile::reserve(uint64_t end) {
+#ifdef __linux__
+        // The reserved space doesn't count in the file size, so a crash doesn't leave zeros at the end
+        while (preallocate && end > allocated) {
+            if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, ASYNC_FILE_PREALLOC_SIZE)) {
+                flog::warn("Could not preallocate '{0}', continuing without", path);
+                preallocate = false;
+                return;
+            }
+            allocated += ASYNC_FILE_PREALLOC_SIZE;
+        }
+#endif
+    }
+
+    bool AsyncFile::writeToDisk(uint64_t pos, const uint8_t* data, size_t len) {
+#ifdef _WIN32
+        if (_lseeki64(fd, pos, SEEK_SET) < 0) { return false; }
+        while (len) {
+            int ret = _write(fd, data, (unsigned int)std::min<size_t>(len, 1 << 30));
+            if (ret <= 0) { return false; }
+            data += ret;
+            len -= ret;
+        }
+#else
+        while (len) {
+            ssize_t ret = pwrite(fd, data, len, pos);
+            if (ret < 0 && errno == EINTR) { continue; }
+            if (ret <= 0) { return false; }
+            data += ret;
+            len -= ret;
+            pos += ret;
+        }
+#endif
+        return true;
+    }
+
+    bool AsyncFile::writeBatchToDisk(Buffer** batch, int count, size_t lastLen) {
+#ifdef _WIN32
+        for (int i = 0; i < count; i++) {
+            if (!writeToDisk(batch[i]->offset, batch[i]->data, (i == count - 1) ? lastLen : batch[i]->len)) { return false; }
+        }
+#else
+        struct iovec iov[ASYNC_FILE_MAX_BATCH];
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = batch[i]->data;
+            iov[i].iov_len = (i == count - 1) ? lastLen : batch[i]->len;
+        }
+        ssize_t ret;
+        do {
+            ret = pwritev(fd, iov, count, batch[0]->offset);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) { return false; }
+
+        // Finish a short write buffer by buffer
+        size_t done = ret;
+        for (int i = 0; i < count; i++) {
+            if (done >= iov[i].iov_len) {
+                done -= iov[i].iov_len;
+                continue;
+            }
+            if (!writeToDisk(batch[i]->offset + done, &batch[i]->data[done], iov[i].iov_len - done)) { return false; }
+            done = 0;
+        }
+#endif
+        return true;
+    }
+
+    bool AsyncFile::hasQueued() {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        return !queued.empty();
+    }
+
+    int AsyncFile::writeQueued() {
+        // Take the buffers that follow each other in the file
+        Buffer* batch[ASYNC_FILE_MAX_BATCH];
+        int count = 0;
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            while (count < ASYNC_FILE_MAX_BATCH && !queued.empty()) {
+                Buffer* buf = queued.front();
+                if (count && buf->offset != batch[count - 1]->offset + batch[count - 1]->len) { break; }
+                batch[count++] = buf;
+                queued.pop_front();
+            }
+            if (!count) { return 0; }
+            writing = true;
+        }
+
+        // Direct I/O needs whole blocks, only the last buffer can be partial and the padding is cut at close
+        Buffer* last = batch[count - 1];
+        size_t lastLen = last->len;
+        if (direct) { lastLen = ((lastLen + ASYNC_FILE_ALIGNMENT - 1) / ASYNC_FILE_ALIGNMENT) * ASYNC_FILE_ALIGNMENT; }
+        reserve(last->offset + lastLen);
+        if (!failed && !writeBatchToDisk(batch, count, lastLen)) {
+            flog::error("Could not write to '{0}', the rest of the recording is lost", path);
+            failed = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            for (int i = 0; i < count; i++) { freeBufs.push_back(batch[i]); }
+            writing = false;
+        }
+        drainCnd.notify_all();
+        return count;
+    }
+}
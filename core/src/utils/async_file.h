@@ -0,0 +1,134 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+
+// Size of the buffers handed to the I/O thread, a multiple of the alignment required for direct I/O
+#define ASYNC_FILE_BUFFER_SIZE      (1 << 20)
+#define ASYNC_FILE_ALIGNMENT        4096
+#define ASYNC_FILE_DEFAULT_DEPTH    64
+// Size of the extents reserved ahead of the writes when preallocating
+#define ASYNC_FILE_PREALLOC_SIZE    (256ull << 20)
+// Most buffers of a file written by a single system call
+#define ASYNC_FILE_MAX_BATCH        16
+
+namespace io {
+    class AsyncFile;
+
+    // Thread writing out the buffers of any number of files, so that recording many files at once doesn't take
+    // as many threads. Files are served in turn, with the contiguous buffers of a file written in one batch.
+    class IOThread {
+    public:
+        ~IOThread();
+
+        void start();
+
+        // Wait for the files to be closed and stop the thread
+        void stop();
+        bool isRunning();
+
+    private:
+        friend class AsyncFile;
+        void attach(AsyncFile* file);
+        void detach(AsyncFile* file);
+        void notify();
+        void worker();
+
+        std::mutex mtx;
+        std::condition_variable cnd;
+        std::condition_variable detachCnd;
+        std::vector<AsyncFile*> files;
+        uint64_t pending = 0;
+        size_t next = 0;
+        bool stopWorker = false;
+        bool running = false;
+        std::thread workerThread;
+    };
+
+    // File writer that never waits on the disk. Appended data is copied into page aligned buffers that an
+    // I/O thread writes out, so that a slow disk only shows up as dropped data instead of stalling the
+    // caller. Buffers are allocated as needed up to the configured depth. On Linux the file can be opened with
+    // O_DIRECT to keep gigabytes of recording out of the page cache, macOS gets the equivalent F_NOCACHE.
+    // Large extents can also be reserved ahead of the writes so that long recordings aren't fragmented.
+    // Only the statistics can be read from another thread than the one writing.
+    class AsyncFile {
+    public:
+        ~AsyncFile();
+
+        // The file gets its own I/O thread unless a running one is given
+        bool open(std::string path, int depth = ASYNC_FILE_DEFAULT_DEPTH, bool direct = false, bool preallocate = false, IOThread* io = NULL);
+        bool isOpen();
+        void close();
+
+        // Append data. If it doesn't fit in the free buffers nothing is written, the call returns false
+        // and the data is counted as an overflow.
+        bool write(const uint8_t* data, size_t len);
+
+        // Overwrite data already written, eg. a header. Waits for the queued buffers to reach the disk
+        // unless the data is still in the buffer being filled.
+        void writeAt(uint64_t pos, const uint8_t* data, size_t len);
+
+        // Logical size of the file, including what's not on disk yet
+        uint64_t tell();
+
+        uint64_t getOverflows() { return overflows; }
+        uint64_t getDroppedBytes() { return droppedBytes; }
+        bool hasFailed() { return failed; }
+
+        // Share of the buffers waiting to be written
+        float getFill();
+
+    private:
+        friend class IOThread;
+
+        struct Buffer {
+            uint8_t* data;
+            uint64_t offset;
+            size_t len;
+        };
+
+        Buffer* takeBuffer();
+        void enqueue(Buffer* buf);
+        void drain();
+        void setDirect(bool enabled);
+        void reserve(uint64_t end);
+        bool writeToDisk(uint64_t pos, const uint8_t* data, size_t len);
+        bool writeBatchToDisk(Buffer** batch, int count, size_t lastLen);
+
+        // Called by the I/O thread, writeQueued() returns the number of buffers written
+        bool hasQueued();
+        int writeQueued();
+
+        bool opened = false;
+        std::string path;
+        int fd = -1;
+        bool direct = false;
+        bool preallocate = false;
+        uint64_t allocated = 0;
+        int depth = 0;
+
+        // Buffer being filled, only touched by the writing thread
+        Buffer* cur = NULL;
+        uint64_t size = 0;
+
+        // Allocated buffers, the ones waiting to be written and the free ones
+        std::mutex queueMtx;
+        std::condition_variable drainCnd;
+        std::vector<Buffer*> buffers;
+        std::deque<Buffer*> queued;
+        std::vector<Buffer*> freeBufs;
+        bool writing = false;
+
+        IOThread* io = NULL;
+        IOThread ownIO;
+
+        std::atomic<uint64_t> overflows = 0;
+        std::atomic<uint64_t> droppedBytes = 0;
+        std::atomic<bool> failed = false;
+    };
+}
@@ -3,6 +3,15 @@
 #include <utils/flog.h>
 #include <stdexcept>
 
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#endif
+
 namespace net {
 
 #ifdef _WIN32
@@ -80,7 +89,7 @@ namespace net {
                 connectionOpenCnd.notify_all();
                 return -1;
             }
-            return count;
+            return ret;
         }
 
         int beenRead = 0;
@@ -175,6 +184,33 @@ namespace net {
         writeQueueCnd.notify_all();
     }
 
+    int ConnClass::getSendQueueSize() {
+        if (!connectionOpen || _udp) { return -1; }
+#if defined(__linux__)
+        int queued;
+        if (ioctl(_sock, SIOCOUTQ, &queued) < 0) { return -1; }
+        return queued;
+#elif defined(__APPLE__)
+        int queued;
+        socklen_t len = sizeof(queued);
+        if (getsockopt(_sock, SOL_SOCKET, SO_NWRITE, &queued, &len) < 0) { return -1; }
+        return queued;
+#else
+        return -1;
+#endif
+    }
+
+    bool ConnClass::setRecvBufferSize(int size) {
+        if (!connectionOpen) { return false; }
+        return !setsockopt(_sock, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof(int));
+    }
+
+    std::string ConnClass::getRemoteHost() {
+        char buf[INET_ADDRSTRLEN];
+        if (!inet_ntop(AF_INET, &remoteAddr.sin_addr, buf, sizeof(buf))) { return ""; }
+        return buf;
+    }
+
     void ConnClass::readWorker() {
         while (true) {
             // Wait for wakeup and exit if it's for terminating the thread
@@ -242,7 +278,9 @@ namespace net {
         Socket _sock;
 
         // Accept socket
-        _sock = ::accept(sock, NULL, NULL);
+        struct sockaddr_in raddr = {};
+        socklen_t raddrLen = sizeof(raddr);
+        _sock = ::accept(sock, (struct sockaddr*)&raddr, &raddrLen);
 #ifdef _WIN32
         if (_sock < 0 || _sock == SOCKET_ERROR) {
 #else
@@ -253,7 +291,7 @@ namespace net {
             return NULL;
         }
 
-        return Conn(new ConnClass(_sock));
+        return Conn(new ConnClass(_sock, raddr));
     }
 
     void ListenerClass::acceptAsync(void (*handler)(Conn conn, void* ctx), void* ctx) {
@@ -373,7 +411,7 @@ namespace net {
             return NULL;
         }
 
-        return Conn(new ConnClass(sock));
+        return Conn(new ConnClass(sock, addr));
     }
 
     Listener listen(std::string host, uint16_t port) {
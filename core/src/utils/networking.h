@@ -55,6 +55,12 @@ namespace net {
         void readAsync(int count, uint8_t* buf, void (*handler)(int count, uint8_t* buf, void* ctx), void* ctx, bool enforceSize = true);
         void writeAsync(int count, uint8_t* buf);
 
+        // Returns the number of bytes waiting in the kernel send queue or -1 if not supported
+        int getSendQueueSize();
+        bool setRecvBufferSize(int size);
+
+        std::string getRemoteHost();
+
     private:
         void readWorker();
         void writeWorker();
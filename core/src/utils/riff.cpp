@@ -7,12 +7,11 @@ namespace riff {
     const char* LIST_SIGNATURE      = "LIST";
     const size_t RIFF_LABEL_SIZE    = 4;
 
-    bool Writer::open(std::string path, const char form[4]) {
+    bool Writer::open(std::string path, const char form[4], int bufferDepth, bool directIO, bool preallocate, io::IOThread* io) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
 
         // Open file
-        file = std::ofstream(path, std::ios::out | std::ios::binary);
-        if (!file.is_open()) { return false; }
+        if (!file.open(path, bufferDepth, directIO, preallocate, io)) { return false; }
 
         // Begin RIFF chunk
         beginRIFF(form);
@@ -22,7 +21,7 @@ namespace riff {
 
     bool Writer::isOpen() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        return file.is_open();
+        return file.isOpen();
     }
 
     void Writer::close() {
@@ -63,10 +62,16 @@ namespace riff {
 
         // Create and write header
         ChunkDesc desc;
-        desc.pos = file.tellp();
+        desc.pos = file.tell();
         memcpy(desc.hdr.id, id, sizeof(desc.hdr.id));
         desc.hdr.size = 0;
-        file.write((char*)&desc.hdr, sizeof(ChunkHeader));
+        desc.size = 0;
+        file.write((uint8_t*)&desc.hdr, sizeof(ChunkHeader));
+
+        // The header is part of the parent chunk
+        if (!chunks.empty()) {
+            chunks.top().size += sizeof(ChunkHeader);
+        }
 
         // Save descriptor
         chunks.push(desc);
@@ -84,27 +89,39 @@ namespace riff {
         chunks.pop();
 
         // Write size
-        auto pos = file.tellp();
-        auto npos = desc.pos;
-        npos += 4;
-        file.seekp(npos);
-        file.write((char*)&desc.hdr.size, sizeof(desc.hdr.size));
-        file.seekp(pos);
+        desc.hdr.size = (desc.size > RIFF_SIZE_OVERFLOW) ? RIFF_SIZE_OVERFLOW : desc.size;
+        file.writeAt(desc.pos + 4, (uint8_t*)&desc.hdr.size, sizeof(desc.hdr.size));
 
         // If parent chunk, increment its size
         if (!chunks.empty()) {
-            chunks.top().hdr.size += desc.hdr.size;
+            chunks.top().size += desc.size;
         }
     }
 
-    void Writer::write(const uint8_t* data, size_t len) {
+    bool Writer::write(const uint8_t* data, size_t len) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
 
         if (chunks.empty()) {
             throw std::runtime_error("No chunk to write into");
         }
-        file.write((char*)data, len);
-        chunks.top().hdr.size += len;
+        if (!file.write(data, len)) { return false; }
+        chunks.top().size += len;
+        return true;
+    }
+
+    void Writer::writeAt(uint64_t pos, const uint8_t* data, size_t len) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        file.writeAt(pos, data, len);
+    }
+
+    uint64_t Writer::tell() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return file.tell();
+    }
+
+    uint64_t Writer::getChunkSize() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return chunks.empty() ? 0 : chunks.top().size;
     }
 
     void Writer::beginRIFF(const char form[4]) {
@@ -1,9 +1,12 @@
 #pragma once
 #include <mutex>
-#include <fstream>
 #include <string>
 #include <stack>
 #include <stdint.h>
+#include "async_file.h"
+
+// Value of 32bit size fields that don't fit, RF64 files store the real size in a ds64 chunk
+#define RIFF_SIZE_OVERFLOW  0xFFFFFFFF
 
 namespace riff {
 #pragma pack(push, 1)
@@ -15,12 +18,13 @@ namespace riff {
 
     struct ChunkDesc {
         ChunkHeader hdr;
-        std::streampos pos;
+        uint64_t pos;
+        uint64_t size;
     };
 
     class Writer {
     public:
-        bool open(std::string path, const char form[4]);
+        bool open(std::string path, const char form[4], int bufferDepth = ASYNC_FILE_DEFAULT_DEPTH, bool directIO = false, bool preallocate = false, io::IOThread* io = NULL);
         bool isOpen();
         void close();
 
@@ -30,14 +34,24 @@ namespace riff {
         void beginChunk(const char id[4]);
         void endChunk();
 
-        void write(const uint8_t* data, size_t len);
+        // Returns false if the data was dropped because the disk can't keep up
+        bool write(const uint8_t* data, size_t len);
+
+        // Overwrite data already written, eg. to turn a reserved chunk into another one
+        void writeAt(uint64_t pos, const uint8_t* data, size_t len);
+        uint64_t tell();
+
+        // Size of the chunk being written, may exceed what fits in its 32bit size field
+        uint64_t getChunkSize();
+
+        io::AsyncFile& getFile() { return file; }
 
     private:
         void beginRIFF(const char form[4]);
         void endRIFF();
 
         std::recursive_mutex mtx;
-        std::ofstream file;
+        io::AsyncFile file;
         std::stack<ChunkDesc> chunks;
     };
 }
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include "sigmf.h"
+#include <volk/volk.h>
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include <ctime>
+#include <stdio.h>
+#include <json.hpp>
+#include <dsp/buffer/buffer.h>
+#include <dsp/stream.h>
+#include <utils/flog.h>
+
+using nlohmann::json;
+
+namespace sigmf {
+    std::string dataTypeName(DataType type) {
+        switch (type) {
+        case DATATYPE_CI8:  return "ci8";
+        case DATATYPE_CI16: return "ci16_le";
+        case DATATYPE_CF32: return "cf32_le";
+        default:            return "";
+        }
+    }
+
+    std::string formatTime(int64_t time) {
+        // Split in whole seconds and nanoseconds, rounding towards negative infinity
+        int64_t sec = time / 1000000000;
+        int64_t nsec = time % 1000000000;
+        if (nsec < 0) {
+            sec--;
+            nsec += 1000000000;
+        }
+
+        time_t t = sec;
+        tm* gtm = gmtime(&t);
+        if (!gtm) { return ""; }
+        char buf[64];
+        sprintf(buf, "%04d-%02d-%02dT%02d:%02d:%02d.%09dZ", gtm->tm_year + 1900, gtm->tm_mon + 1, gtm->tm_mday, gtm->tm_hour, gtm->tm_min, gtm->tm_sec, (int)nsec);
+        return buf;
+    }
+
+    bool parseTime(std::string str, int64_t& time) {
+        tm gtm = {};
+        int len = 0;
+        if (sscanf(str.c_str(), "%d-%d-%dT%d:%d:%d%n", &gtm.tm_year, &gtm.tm_mon, &gtm.tm_mday, &gtm.tm_hour, &gtm.tm_min, &gtm.tm_sec, &len) != 6) { return false; }
+        gtm.tm_year -= 1900;
+        gtm.tm_mon -= 1;
+
+        // Optional fraction of a second with any number of digits, anything past the nanoseconds is ignored
+        int64_t nsec = 0;
+        const char* frac = &str.c_str()[len];
+        if (*frac == '.') {
+            int64_t scale = 100000000;
+            for (frac++; *frac >= '0' && *frac <= '9'; frac++) {
+                nsec += (*frac - '0') * scale;
+                scale /= 10;
+            }
+        }
+
+#ifdef _WIN32
+        int64_t sec = _mkgmtime(&gtm);
+#else
+        int64_t sec = timegm(&gtm);
+#endif
+        if (sec == -1) { return false; }
+        time = sec * 1000000000 + nsec;
+        return true;
+    }
+
+    Writer::Writer(double samplerate, DataType type) {
+        if (samplerate <= 0) { throw std::runtime_error("Samplerate must be non-zero"); }
+        _samplerate = samplerate;
+        _type = type;
+    }
+
+    Writer::~Writer() { close(); }
+
+    bool Writer::open(std::string path, double frequency, int64_t time) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Close previous file
+        if (_open) { close(); }
+
+        // Reset work values
+        samplesWritten = 0;
+        samplesDropped = 0;
+        pendingDrop = 0;
+        captures.clear();
+        annotations.clear();
+        addCapture(frequency, time);
+        metaPath = path + SIGMF_META_EXT;
+
+        // Open the data file
+        if (!file.open(path + SIGMF_DATA_EXT, _bufferDepth, _directIO, _preallocate)) { return false; }
+
+        // Write the metadata right away so that the recording can be read even if it isn't closed properly
+        if (!writeMeta()) {
+            file.close();
+            return false;
+        }
+
+        // Allocate conversion buffers
+        switch (_type) {
+        case DATATYPE_CI8:
+            bufI8 = dsp::buffer::alloc<int8_t>(STREAM_BUFFER_SIZE * 2);
+            break;
+        case DATATYPE_CI16:
+            bufI16 = dsp::buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * 2);
+            break;
+        default:
+            break;
+        }
+
+        _open = true;
+        return true;
+    }
+
+    bool Writer::isOpen() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return _open;
+    }
+
+    void Writer::close() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do nothing if the file is not open
+        if (!_open) { return; }
+
+        // Samples dropped at the very end are noted even though nothing follows them
+        if (pendingDrop) {
+            addAnnotation("Dropped", std::to_string(pendingDrop) + " samples lost, the disk couldn't keep up");
+            pendingDrop = 0;
+        }
+
+        file.close();
+        if (!writeMeta()) { flog::error("Could not write SigMF metadata to '{0}'", metaPath); }
+
+        // Free buffers
+        if (bufI8) {
+            dsp::buffer::free(bufI8);
+            bufI8 = NULL;
+        }
+        if (bufI16) {
+            dsp::buffer::free(bufI16);
+            bufI16 = NULL;
+        }
+
+        _open = false;
+    }
+
+    void Writer::setSamplerate(double samplerate) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (_open) { throw std::runtime_error("Cannot change parameters while file is open"); }
+
+        // Validate samplerate
+        if (samplerate <= 0) { throw std::runtime_error("Samplerate must be non-zero"); }
+        _samplerate = samplerate;
+    }
+
+    void Writer::setDataType(DataType type) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (_open) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _type = type;
+    }
+
+    void Writer::setBufferDepth(int depth) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (_open) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _bufferDepth = depth;
+    }
+
+    void Writer::setDirectIO(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (_open) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _directIO = enabled;
+    }
+
+    void Writer::setPreallocate(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (_open) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _preallocate = enabled;
+    }
+
+    void Writer::setDescription(std::string description) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        _description = description;
+    }
+
+    void Writer::addCapture(double frequency, int64_t time) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        Capture cap = { samplesWritten, frequency, time };
+        if (!captures.empty() && captures.back().sampleStart == samplesWritten) {
+            captures.back() = cap;
+            return;
+        }
+        captures.push_back(cap);
+    }
+
+    void Writer::addAnnotation(std::string label, std::string comment, int64_t start, uint64_t count) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        Annotation an = { (start >= 0) ? (uint64_t)start : samplesWritten, count, label, comment };
+        annotations.push_back(an);
+    }
+
+    float Writer::getBufferFill() {
+        return file.getFill();
+    }
+
+    bool Writer::hasFailed() {
+        return file.hasFailed();
+    }
+
+    void Writer::write(const float* samples, int count) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (!_open || count <= 0) { return; }
+
+        // The data file has no gaps, so samples after a drop start a new capture whose time accounts for the lost samples
+        if (pendingDrop) {
+            addAnnotation("Dropped", std::to_string(pendingDrop) + " samples lost, the disk couldn't keep up");
+            if (!captures.empty()) {
+                Capture last = captures.back();
+                int64_t time = last.time;
+                if (time >= 0) { time += (int64_t)((double)(samplesWritten - last.sampleStart + pendingDrop) * 1e9 / _samplerate); }
+                addCapture(last.frequency, time);
+            }
+            pendingDrop = 0;
+        }
+
+        // Convert to the datatype of the recording
+        int tcount = count * 2;
+        bool written = false;
+        switch (_type) {
+        case DATATYPE_CI8:
+            volk_32f_s32f_convert_8i(bufI8, samples, 127.0f, tcount);
+            written = file.write((uint8_t*)bufI8, tcount * sizeof(int8_t));
+            break;
+        case DATATYPE_CI16:
+            volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, tcount);
+            written = file.write((uint8_t*)bufI16, tcount * sizeof(int16_t));
+            break;
+        case DATATYPE_CF32:
+            written = file.write((uint8_t*)samples, tcount * sizeof(float));
+            break;
+        default:
+            break;
+        }
+
+        // Increment sample counters
+        if (written) {
+            samplesWritten += count;
+        }
+        else {
+            samplesDropped += count;
+            pendingDrop += count;
+        }
+    }
+
+    bool Writer::writeMeta() {
+        json meta;
+        meta["global"]["core:datatype"] = dataTypeName(_type);
+        meta["global"]["core:sample_rate"] = _samplerate;
+        meta["global"]["core:version"] = SIGMF_VERSION;
+        meta["global"]["core:num_channels"] = 1;
+        meta["global"]["core:recorder"] = "SDR++";
+        if (!_description.empty()) { meta["global"]["core:description"] = _description; }
+
+        meta["captures"] = json::array();
+        for (const auto& cap : captures) {
+            json c;
+            c["core:sample_start"] = cap.sampleStart;
+            c["core:frequency"] = cap.frequency;
+            if (cap.time >= 0) { c["core:datetime"] = formatTime(cap.time); }
+            meta["captures"].push_back(c);
+        }
+
+        // The specification requires the annotations to be sorted by their start
+        std::vector<Annotation> sorted = annotations;
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Annotation& a, const Annotation& b) { return a.sampleStart < b.sampleStart; });
+        meta["annotations"] = json::array();
+        for (const auto& an : sorted) {
+            json a;
+            a["core:sample_start"] = an.sampleStart;
+            if (an.sampleCount) { a["core:sample_count"] = an.sampleCount; }
+            if (!an.label.empty()) { a["core:label"] = an.label; }
+            if (!an.comment.empty()) { a["core:comment"] = an.comment; }
+            meta["annotations"].push_back(a);
+        }
+
+        std::ofstream file(metaPath, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) { return false; }
+        file << meta.dump(4);
+        file.close();
+        return !file.fail();
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+#include "async_file.h"
+
+#define SIGMF_DATA_EXT  ".sigmf-data"
+#define SIGMF_META_EXT  ".sigmf-meta"
+#define SIGMF_VERSION   "1.0.0"
+
+namespace sigmf {
+    enum DataType {
+        DATATYPE_CI8,
+        DATATYPE_CI16,
+        DATATYPE_CF32
+    };
+
+    // Name of a datatype in the metadata, eg. "ci16_le"
+    std::string dataTypeName(DataType type);
+
+    // Convert between ns since the unix epoch and the ISO 8601 UTC timestamps used in the metadata
+    std::string formatTime(int64_t time);
+    bool parseTime(std::string str, int64_t& time);
+
+    struct Capture {
+        uint64_t sampleStart;
+        double frequency;
+        int64_t time;   // ns since the unix epoch, negative if unknown
+    };
+
+    struct Annotation {
+        uint64_t sampleStart;
+        uint64_t sampleCount;
+        std::string label;
+        std::string comment;
+    };
+
+    // Writes complex baseband as a SigMF recording, a raw .sigmf-data file and a JSON .sigmf-meta file
+    // describing it. Each retune starts a new capture segment so that the frequency and time of every
+    // sample are known. The metadata is written when the recording is opened and rewritten on close.
+    class Writer {
+    public:
+        Writer(double samplerate = 48000, DataType type = DATATYPE_CI16);
+        ~Writer();
+
+        // Path without extension, the .sigmf-data and .sigmf-meta extensions are added. The first capture
+        // segment starts at the given frequency and time.
+        bool open(std::string path, double frequency, int64_t time = -1);
+        bool isOpen();
+        void close();
+
+        void setSamplerate(double samplerate);
+        void setDataType(DataType type);
+        void setBufferDepth(int depth);
+        void setDirectIO(bool enabled);
+        void setPreallocate(bool enabled);
+        void setDescription(std::string description);
+
+        // Start a new capture segment at the next sample written. A capture at the same position as the
+        // previous one replaces it.
+        void addCapture(double frequency, int64_t time = -1);
+
+        // Annotate count samples starting at start, the position of the next sample to be written if negative
+        void addAnnotation(std::string label, std::string comment = "", int64_t start = -1, uint64_t count = 0);
+
+        uint64_t getSamplesWritten() { return samplesWritten; }
+        uint64_t getSamplesDropped() { return samplesDropped; }
+        float getBufferFill();
+        bool hasFailed();
+
+        void write(const float* samples, int count);
+
+    private:
+        bool writeMeta();
+
+        std::recursive_mutex mtx;
+        io::AsyncFile file;
+        bool _open = false;
+
+        double _samplerate;
+        DataType _type;
+        int _bufferDepth = ASYNC_FILE_DEFAULT_DEPTH;
+        bool _directIO = false;
+        bool _preallocate = false;
+        std::string _description;
+
+        std::string metaPath;
+        std::vector<Capture> captures;
+        std::vector<Annotation> annotations;
+        uint64_t pendingDrop = 0;
+
+        int8_t* bufI8 = NULL;
+        int16_t* bufI16 = NULL;
+        uint64_t samplesWritten = 0;
+        uint64_t samplesDropped = 0;
+    };
+}
@@ -3,12 +3,20 @@
 #include <stdexcept>
 #include <dsp/buffer/buffer.h>
 #include <dsp/stream.h>
+#include <dsp/convert/float_to_u8.h>
+#include <utils/flog.h>
 #include <map>
+#include <algorithm>
 
 namespace wav {
     const char* WAVE_FILE_TYPE          = "WAVE";
     const char* FORMAT_MARKER           = "fmt ";
     const char* DATA_MARKER             = "data";
+    const char* JUNK_MARKER             = "JUNK";
+    const char* DS64_MARKER             = "ds64";
+    const char* RF64_SIGNATURE          = "RF64";
+    const uint64_t DS64_CHUNK_POS       = 12;
+    const uint64_t WAV_HEADER_MARGIN    = 1024;
     const uint32_t FORMAT_HEADER_LEN    = 16;
     const uint16_t SAMPLE_TYPE_PCM      = 1;
 
@@ -36,10 +44,15 @@ namespace wav {
     bool Writer::open(std::string path) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Close previous file
-        if (rw.isOpen()) { close(); }
+        if (rw) { close(); }
 
         // Reset work values
         samplesWritten = 0;
+        samplesDropped = 0;
+        segment = 0;
+        segmentSamples = 0;
+        failed = false;
+        basePath = path;
 
         // Fill header
         bytesPerSamp = (SAMP_BITS[_type] / 8) * _channels;
@@ -69,34 +82,25 @@ namespace wav {
         }
 
         // Open file
-        if (!rw.open(path, WAVE_FILE_TYPE)) { return false; }
-
-        // Write format chunk
-        rw.beginChunk(FORMAT_MARKER);
-        rw.write((uint8_t*)&hdr, sizeof(FormatHeader));
-        rw.endChunk();
-
-        // Begin data chunk
-        rw.beginChunk(DATA_MARKER);
-        
-        return true;
+        rw = openSegment(path);
+        return rw != NULL;
     }
 
     bool Writer::isOpen() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        return rw.isOpen();
+        return rw != NULL;
     }
 
     void Writer::close() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do nothing if the file is not open
-        if (!rw.isOpen()) { return; }
+        if (!rw) { return; }
 
-        // Finish data chunk
-        rw.endChunk();
-
-        // Close the file
-        rw.close();
+        // Finish the last segment and wait for the previous one to be finished
+        failed |= rw->getFile().hasFailed();
+        closeSegment(rw, _format, bytesPerSamp);
+        rw = NULL;
+        if (closeThread.joinable()) { closeThread.join(); }
 
         // Free buffers
         if (bufU8) {
@@ -116,7 +120,7 @@ namespace wav {
     void Writer::setChannels(int channels) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
 
         // Validate channel count
         if (channels < 1) { throw std::runtime_error("Channel count must be greater or equal to 1"); }
@@ -126,7 +130,7 @@ namespace wav {
     void Writer::setSamplerate(uint64_t samplerate) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
 
         // Validate samplerate
         if (!samplerate) { throw std::runtime_error("Samplerate must be non-zero"); }
@@ -136,48 +140,204 @@ namespace wav {
     void Writer::setFormat(Format format) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
         _format = format;
     }
 
     void Writer::setSampleType(SampleType type) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
         _type = type;
     }
 
+    void Writer::setBufferDepth(int depth) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _bufferDepth = depth;
+    }
+
+    void Writer::setDirectIO(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _directIO = enabled;
+    }
+
+    void Writer::setPreallocate(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _preallocate = enabled;
+    }
+
+    void Writer::setIOThread(io::IOThread* io) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _io = io;
+    }
+
+    void Writer::setRollover(uint64_t maxBytes, double maxSeconds) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _rolloverBytes = maxBytes;
+        _rolloverTime = maxSeconds;
+    }
+
+    float Writer::getBufferFill() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return rw ? rw->getFile().getFill() : 0.0f;
+    }
+
+    bool Writer::hasFailed() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return failed || (rw && rw->getFile().hasFailed());
+    }
+
     void Writer::write(float* samples, int count) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        if (!rw.isOpen()) { return; }
-        
+        if (!rw) { return; }
+
+        // Split the samples between segments so that no sample is lost or duplicated across files
+        while (count) {
+            uint64_t room = segmentLength() - segmentSamples;
+            if (!room) {
+                if (rollover()) { continue; }
+                samplesDropped += count;
+                return;
+            }
+            int n = std::min<uint64_t>(count, room);
+            writeSamples(samples, n);
+            samples += n * _channels;
+            count -= n;
+        }
+    }
+
+    riff::Writer* Writer::openSegment(std::string path) {
+        riff::Writer* srw = new riff::Writer;
+        if (!srw->open(path, WAVE_FILE_TYPE, _bufferDepth, _directIO, _preallocate, _io)) {
+            delete srw;
+            return NULL;
+        }
+
+        // Reserve room for a ds64 chunk in case the file outgrows the 32bit sizes of WAV
+        if (_format == FORMAT_RF64) {
+            DS64Chunk ds64 = {};
+            srw->beginChunk(JUNK_MARKER);
+            srw->write((uint8_t*)&ds64, sizeof(DS64Chunk));
+            srw->endChunk();
+        }
+
+        // Write format chunk
+        srw->beginChunk(FORMAT_MARKER);
+        srw->write((uint8_t*)&hdr, sizeof(FormatHeader));
+        srw->endChunk();
+
+        // Begin data chunk
+        srw->beginChunk(DATA_MARKER);
+
+        return srw;
+    }
+
+    void Writer::closeSegment(riff::Writer* rw, Format format, size_t bytesPerSamp) {
+        // Finish data chunk
+        uint64_t dataSize = rw->getChunkSize();
+        rw->endChunk();
+
+        // Files that outgrew WAV become RF64, the reserved JUNK chunk is turned into the ds64 chunk
+        uint64_t riffSize = rw->tell() - sizeof(riff::ChunkHeader);
+        if (format == FORMAT_RF64 && riffSize > RIFF_SIZE_OVERFLOW) {
+            DS64Chunk ds64 = {};
+            ds64.riffSize = riffSize;
+            ds64.dataSize = dataSize;
+            ds64.sampleCount = dataSize / bytesPerSamp;
+            rw->writeAt(0, (uint8_t*)RF64_SIGNATURE, 4);
+            rw->writeAt(DS64_CHUNK_POS, (uint8_t*)DS64_MARKER, 4);
+            rw->writeAt(DS64_CHUNK_POS + sizeof(riff::ChunkHeader), (uint8_t*)&ds64, sizeof(DS64Chunk));
+        }
+
+        // Close the file
+        rw->close();
+        delete rw;
+    }
+
+    std::string Writer::segmentPath(int segment) {
+        if (!segment) { return basePath; }
+        char suffix[16];
+        sprintf(suffix, "_%03d", segment + 1);
+
+        // Insert the suffix before the extension
+        size_t dot = basePath.find_last_of('.');
+        size_t sep = basePath.find_last_of("/\\");
+        if (dot == std::string::npos || (sep != std::string::npos && dot < sep)) { return basePath + suffix; }
+        return basePath.substr(0, dot) + suffix + basePath.substr(dot);
+    }
+
+    uint64_t Writer::segmentLength() {
+        // Plain WAV can't describe more than 4GB
+        uint64_t len = UINT64_MAX;
+        if (_format == FORMAT_WAV) { len = (RIFF_SIZE_OVERFLOW - WAV_HEADER_MARGIN) / bytesPerSamp; }
+        if (_rolloverBytes) { len = std::min<uint64_t>(len, std::max<uint64_t>(_rolloverBytes / bytesPerSamp, 1)); }
+        if (_rolloverTime > 0.0) { len = std::min<uint64_t>(len, std::max<uint64_t>(_rolloverTime * (double)_samplerate, 1)); }
+        return len;
+    }
+
+    bool Writer::rollover() {
+        // Open the next segment first so that the recording can continue in the current one if it fails
+        std::string path = segmentPath(segment + 1);
+        riff::Writer* next = openSegment(path);
+        if (!next) {
+            flog::error("Could not open the next recording segment: {0}", path);
+            return false;
+        }
+
+        // Finish the previous segment in the background
+        if (closeThread.joinable()) { closeThread.join(); }
+        failed |= rw->getFile().hasFailed();
+        closeThread = std::thread(&Writer::closeSegment, rw, _format, bytesPerSamp);
+
+        rw = next;
+        segment++;
+        segmentSamples = 0;
+        return true;
+    }
+
+    bool Writer::writeSamples(float* samples, int count) {
         // Select different writer function depending on the chose depth
         int tcount = count * _channels;
         int tbytes = count * bytesPerSamp;
+        bool written = false;
         switch (_type) {
         case SAMP_TYPE_UINT8:
-            // Volk doesn't support unsigned ints yet :/
-            for (int i = 0; i < tcount; i++) {
-                bufU8[i] = (samples[i] * 127.0f) + 128.0f;
-            }
-            rw.write(bufU8, tbytes);
+            dsp::convert::FloatToU8::process(tcount, samples, bufU8);
+            written = rw->write(bufU8, tbytes);
             break;
         case SAMP_TYPE_INT16:
             volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, tcount);
-            rw.write((uint8_t*)bufI16, tbytes);
+            written = rw->write((uint8_t*)bufI16, tbytes);
             break;
         case SAMP_TYPE_INT32:
             volk_32f_s32f_convert_32i(bufI32, samples, 2147483647.0f, tcount);
-            rw.write((uint8_t*)bufI32, tbytes);
+            written = rw->write((uint8_t*)bufI32, tbytes);
             break;
         case SAMP_TYPE_FLOAT32:
-            rw.write((uint8_t*)samples, tbytes);
+            written = rw->write((uint8_t*)samples, tbytes);
             break;
         default:
             break;
         }
 
-        // Increment sample counter
-        samplesWritten += count;
+        // Increment sample counters, samples the disk couldn't keep up with are dropped
+        if (written) {
+            samplesWritten += count;
+            segmentSamples += count;
+        }
+        else {
+            samplesDropped += count;
+        }
+        return written;
     }
-}
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <stdint.h>
 #include <mutex>
+#include <thread>
 #include "riff.h"
 
 namespace wav {    
@@ -15,6 +16,14 @@ namespace wav {
         uint16_t bytesPerSample;
         uint16_t bitDepth;
     };
+
+    // Real sizes of an RF64 file, replaces the JUNK chunk reserved at the start of the file
+    struct DS64Chunk {
+        uint64_t riffSize;
+        uint64_t dataSize;
+        uint64_t sampleCount;
+        uint32_t tableLength;
+    };
     #pragma pack(pop)
 
     enum Format {
@@ -48,24 +57,63 @@ namespace wav {
         void setFormat(Format format);
         void setSampleType(SampleType type);
 
+        // Number of 1MiB buffers the disk writes can lag behind by before samples are dropped
+        void setBufferDepth(int depth);
+        void setDirectIO(bool enabled);
+        void setPreallocate(bool enabled);
+
+        // Have the files written by a shared I/O thread instead of one of their own
+        void setIOThread(io::IOThread* io);
+
+        // Continue the recording in a new file once the current one reaches a size in bytes or a duration in
+        // seconds, zero to disable. The first file keeps the name given to open(), the next ones get a _002,
+        // _003, etc suffix. Plain WAV files are always split before reaching their 4GB limit.
+        void setRollover(uint64_t maxBytes, double maxSeconds);
+
         size_t getSamplesWritten() { return samplesWritten; }
+        size_t getSamplesDropped() { return samplesDropped; }
+        int getSegment() { return segment; }
+        float getBufferFill();
+        bool hasFailed();
 
         void write(float* samples, int count);
 
     private:
+        riff::Writer* openSegment(std::string path);
+        static void closeSegment(riff::Writer* rw, Format format, size_t bytesPerSamp);
+        std::string segmentPath(int segment);
+        uint64_t segmentLength();
+        bool rollover();
+        bool writeSamples(float* samples, int count);
+
         std::recursive_mutex mtx;
         FormatHeader hdr;
-        riff::Writer rw;
+        riff::Writer* rw = NULL;
+
+        // Segments are finished in the background so that waiting for their last buffers doesn't stall the writes
+        std::thread closeThread;
 
         int _channels;
         uint64_t _samplerate;
         Format _format;
         SampleType _type;
+        int _bufferDepth = ASYNC_FILE_DEFAULT_DEPTH;
+        bool _directIO = false;
+        bool _preallocate = false;
+        io::IOThread* _io = NULL;
+        uint64_t _rolloverBytes = 0;
+        double _rolloverTime = 0.0;
         size_t bytesPerSamp;
 
+        std::string basePath;
+        int segment = 0;
+        uint64_t segmentSamples = 0;
+        bool failed = false;
+
         uint8_t* bufU8 = NULL;
         int16_t* bufI16 = NULL;
         int32_t* bufI32 = NULL;
         size_t samplesWritten = 0;
+        size_t samplesDropped = 0;
     };
 }
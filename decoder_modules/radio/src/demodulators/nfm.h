@@ -25,11 +25,15 @@ namespace demod {
             if (config->conf[name][getName()].contains("highPass")) {
                 _highPass = config->conf[name][getName()]["highPass"];
             }
+            if (config->conf[name][getName()].contains("fastDiscriminator")) {
+                _fastDiscriminator = config->conf[name][getName()]["fastDiscriminator"];
+            }
             _config->release();
 
 
             // Define structure
             demod.init(input, getIFSampleRate(), bandwidth, _lowPass, _highPass);
+            demod.setAccuracy(_fastDiscriminator ? dsp::demod::Quadrature::ACCURACY_FAST : dsp::demod::Quadrature::ACCURACY_HIGH);
         }
 
         void start() { demod.start(); }
@@ -49,6 +53,13 @@ namespace demod {
                 _config->conf[name][getName()]["highPass"] = _highPass;
                 _config->release(true);
             }
+            if (ImGui::Checkbox(("Fast Discriminator##_radio_nfm_fast_" + name).c_str(), &_fastDiscriminator)) {
+                demod.setAccuracy(_fastDiscriminator ? dsp::demod::Quadrature::ACCURACY_FAST : dsp::demod::Quadrature::ACCURACY_HIGH);
+                _config->acquire();
+                _config->conf[name][getName()]["fastDiscriminator"] = _fastDiscriminator;
+                _config->release(true);
+            }
+            if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Cheaper, slightly less accurate phase detector, for when many channels are demodulated at once"); }
         }
 
         void setBandwidth(double bandwidth) {
@@ -84,6 +95,7 @@ namespace demod {
 
         bool _lowPass = true;
         bool _highPass = false;
+        bool _fastDiscriminator = false;
 
         std::string name;
     };
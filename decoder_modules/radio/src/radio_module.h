@@ -426,6 +426,7 @@ private:
 
         // Configure noise blanker
         nb.setRate(500.0 / ifSamplerate);
+        nb.setWindow(ceil(10e-6 * ifSamplerate), ceil(20e-6 * ifSamplerate));
         setNBLevel(nbLevel);
         setNBEnabled(nbAllowed && nbEnabled);
 
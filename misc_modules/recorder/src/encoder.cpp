@@ -0,0 +1,203 @@
+#include "encoder.h"
+#include <stdexcept>
+#include <algorithm>
+#include <dsp/buffer/buffer.h>
+#include <utils/flog.h>
+
+#ifdef RECORDER_COMPRESSION
+#include <sndfile.h>
+#endif
+
+namespace encoder {
+    bool isSupported() {
+#ifdef RECORDER_COMPRESSION
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    Writer::Writer(int channels, uint64_t samplerate, Codec codec) {
+        // Validate channels and samplerate
+        if (channels < 1) { throw std::runtime_error("Channel count must be greater or equal to 1"); }
+        if (!samplerate) { throw std::runtime_error("Samplerate must be non-zero"); }
+
+        // Initialize variables
+        _channels = channels;
+        _samplerate = samplerate;
+        _codec = codec;
+    }
+
+    Writer::~Writer() { close(); }
+
+    bool Writer::open(std::string path) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Close previous file
+        if (file) { close(); }
+
+#ifdef RECORDER_COMPRESSION
+        // Open the file
+        SF_INFO info = {};
+        info.samplerate = _samplerate;
+        info.channels = _channels;
+        if (_codec == CODEC_OPUS) {
+            info.format = SF_FORMAT_OGG | SF_FORMAT_OPUS;
+        }
+        else {
+            int depth = (_bitDepth == 8) ? SF_FORMAT_PCM_S8 : ((_bitDepth == 24) ? SF_FORMAT_PCM_24 : SF_FORMAT_PCM_16);
+            info.format = SF_FORMAT_FLAC | depth;
+        }
+        if (!sf_format_check(&info)) {
+            flog::error("Cannot encode {0} channels at {1} Hz in this format", _channels, _samplerate);
+            return false;
+        }
+        SNDFILE* sf = sf_open(path.c_str(), SFM_WRITE, &info);
+        if (!sf) {
+            flog::error("Could not open '{0}': {1}", path, sf_strerror(NULL));
+            return false;
+        }
+
+        // Clip instead of wrapping around and set the compression before anything is encoded
+        double level = _compressionLevel;
+        sf_command(sf, SFC_SET_CLIPPING, NULL, SF_TRUE);
+        sf_command(sf, SFC_SET_COMPRESSION_LEVEL, &level, sizeof(double));
+        file = sf;
+#else
+        flog::error("Could not open '{0}': the recorder was built without FLAC and Opus support", path);
+        return false;
+#endif
+
+        // Reset work values
+        samplesWritten = 0;
+        samplesDropped = 0;
+        failed = false;
+
+        // Start the encoder thread
+        ring = std::make_unique<dsp::buffer::PrefetchRing>(_bufferSize << 20);
+        encodeBuf = dsp::buffer::alloc<float>(ENCODER_CHUNK_SIZE * _channels);
+        workerThread = std::thread(&Writer::worker, this);
+        return true;
+    }
+
+    bool Writer::isOpen() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return file != NULL;
+    }
+
+    void Writer::close() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do nothing if the file is not open
+        if (!file) { return; }
+
+        // Let the encoder thread finish what's in the ring
+        ring->stopReader();
+        if (workerThread.joinable()) { workerThread.join(); }
+
+#ifdef RECORDER_COMPRESSION
+        sf_close((SNDFILE*)file);
+#endif
+        file = NULL;
+
+        // Free buffers
+        ring.reset();
+        dsp::buffer::free(encodeBuf);
+        encodeBuf = NULL;
+    }
+
+    void Writer::setChannels(int channels) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file) { throw std::runtime_error("Cannot change parameters while file is open"); }
+
+        // Validate channel count
+        if (channels < 1) { throw std::runtime_error("Channel count must be greater or equal to 1"); }
+        _channels = channels;
+    }
+
+    void Writer::setSamplerate(uint64_t samplerate) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file) { throw std::runtime_error("Cannot change parameters while file is open"); }
+
+        // Validate samplerate
+        if (!samplerate) { throw std::runtime_error("Samplerate must be non-zero"); }
+        _samplerate = samplerate;
+    }
+
+    void Writer::setCodec(Codec codec) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _codec = codec;
+    }
+
+    void Writer::setBitDepth(int bits) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _bitDepth = bits;
+    }
+
+    void Writer::setCompressionLevel(double level) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _compressionLevel = std::clamp<double>(level, 0.0, 1.0);
+    }
+
+    void Writer::setBufferSize(int size) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _bufferSize = std::clamp<int>(size, 1, 1024);
+    }
+
+    float Writer::getBufferFill() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return ring ? ring->getFill() : 0.0f;
+    }
+
+    void Writer::write(float* samples, int count) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (!file) { return; }
+
+        // Hand the samples over in chunks the encoder thread has room for, the ring never blocks
+        while (count) {
+            int n = std::min<int>(count, ENCODER_CHUNK_SIZE);
+            if (ring->write((uint8_t*)samples, n * _channels * sizeof(float))) {
+                samplesWritten += n;
+            }
+            else {
+                samplesDropped += n;
+            }
+            samples += n * _channels;
+            count -= n;
+        }
+    }
+
+    void Writer::worker() {
+        int maxLen = ENCODER_CHUNK_SIZE * _channels * sizeof(float);
+        while (true) {
+            int len = ring->read((uint8_t*)encodeBuf, maxLen);
+            if (len < 0) { break; }
+            encode(len);
+        }
+
+        // The writer is stopped, encode what it left in the ring
+        int len;
+        while ((len = ring->tryRead((uint8_t*)encodeBuf, maxLen)) >= 0) {
+            encode(len);
+        }
+    }
+
+    void Writer::encode(int len) {
+#ifdef RECORDER_COMPRESSION
+        sf_count_t frames = len / (_channels * sizeof(float));
+        if (failed || !frames) { return; }
+        if (sf_writef_float((SNDFILE*)file, encodeBuf, frames) != frames) {
+            flog::error("Could not encode audio: {0}", sf_strerror((SNDFILE*)file));
+            failed = true;
+        }
+#endif
+    }
+}
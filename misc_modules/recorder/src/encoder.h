@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <dsp/buffer/prefetch_ring.h>
+
+// Number of frames handed to the encoder thread at once
+#define ENCODER_CHUNK_SIZE      4096
+#define ENCODER_DEFAULT_BUFFER  64
+
+struct sf_private_tag;
+
+namespace encoder {
+    enum Codec {
+        CODEC_FLAC,
+        CODEC_OPUS
+    };
+
+    // Whether the module was built with libsndfile, without it no file can be opened
+    bool isSupported();
+
+    // Writes FLAC or Ogg Opus audio files. The samples are handed to an encoder thread through a lock-free
+    // ring so that the encoding never runs on the DSP thread. If the encoder falls further behind than the
+    // ring can hold, the samples are dropped and counted.
+    class Writer {
+    public:
+        Writer(int channels = 2, uint64_t samplerate = 48000, Codec codec = CODEC_FLAC);
+        ~Writer();
+
+        bool open(std::string path);
+        bool isOpen();
+        void close();
+
+        void setChannels(int channels);
+        void setSamplerate(uint64_t samplerate);
+        void setCodec(Codec codec);
+
+        // Bits per sample of FLAC files, 8, 16 or 24. Opus doesn't have a bit depth.
+        void setBitDepth(int bits);
+
+        // From 0 for the fastest FLAC encoding or the highest Opus bitrate to 1 for the smallest files
+        void setCompressionLevel(double level);
+
+        // Size of the ring in MiB
+        void setBufferSize(int size);
+
+        uint64_t getSamplesWritten() { return samplesWritten; }
+        uint64_t getSamplesDropped() { return samplesDropped; }
+        float getBufferFill();
+        bool hasFailed() { return failed; }
+
+        void write(float* samples, int count);
+
+    private:
+        void worker();
+        void encode(int len);
+
+        std::recursive_mutex mtx;
+        sf_private_tag* file = NULL;
+        std::unique_ptr<dsp::buffer::PrefetchRing> ring;
+        std::thread workerThread;
+        float* encodeBuf = NULL;
+
+        int _channels;
+        uint64_t _samplerate;
+        Codec _codec;
+        int _bitDepth = 16;
+        double _compressionLevel = 0.5;
+        int _bufferSize = ENCODER_DEFAULT_BUFFER;
+
+        std::atomic<uint64_t> samplesWritten = 0;
+        std::atomic<uint64_t> samplesDropped = 0;
+        std::atomic<bool> failed = false;
+    };
+}
@@ -7,7 +7,11 @@
 #include <dsp/routing/splitter.h>
 #include <dsp/audio/volume.h>
 #include <dsp/convert/stereo_to_mono.h>
+#include <dsp/buffer/history.h>
+#include <dsp/audio/silence_gate.h>
 #include <thread>
+#include <memory>
+#include <chrono>
 #include <ctime>
 #include <gui/gui.h>
 #include <filesystem>
@@ -18,13 +22,39 @@
 #include <regex>
 #include <gui/widgets/folder_select.h>
 #include <recorder_interface.h>
+#include "encoder.h"
 #include <core.h>
 #include <utils/optionlist.h>
 #include <utils/wav.h>
+#include <utils/sigmf.h>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
-#define SILENCE_LVL 10e-6
+// Defaults of the silence gate, the threshold is in dBFS RMS
+#define RECORDER_SILENCE_THRESHOLD  -100.0f
+#define RECORDER_SILENCE_HANG_TIME  500
+
+// Depth of the disk write buffer in 1MiB buffers
+#define RECORDER_MIN_BUFFER_DEPTH   4
+#define RECORDER_MAX_BUFFER_DEPTH   1024
+
+// Samples kept from before the recording is started, the memory limit mostly matters for baseband
+#define RECORDER_MAX_PRERECORD_TIME 300
+#define RECORDER_MAX_PRERECORD_MB   256
+
+// The pre-recorded samples are written out while the disk buffer is below this fill
+#define RECORDER_PRERECORD_MAX_FILL 0.5f
+
+// Audio each track can get ahead of the others by when multi-track recording to a single file
+#define RECORDER_MULTI_SYNC_TIME    1.0
+
+enum {
+    RECORDER_CONTAINER_WAV,
+    RECORDER_CONTAINER_RF64,
+    RECORDER_CONTAINER_SIGMF,
+    RECORDER_CONTAINER_FLAC,
+    RECORDER_CONTAINER_OPUS
+};
 
 SDRPP_MOD_INFO{
     /* Name:            */ "recorder",
@@ -44,16 +74,25 @@ public:
         strcpy(nameTemplate, "$t_$f_$h-$m-$s_$d-$M-$y");
 
         // Define option lists
-        containers.define("WAV", wav::FORMAT_WAV);
-        // containers.define("RF64", wav::FORMAT_RF64); // Disabled for now
+        containers.define("WAV", RECORDER_CONTAINER_WAV);
+        containers.define("RF64", RECORDER_CONTAINER_RF64);
+        containers.define("SigMF", RECORDER_CONTAINER_SIGMF);
+        if (encoder::isSupported()) {
+            containers.define("FLAC", RECORDER_CONTAINER_FLAC);
+            containers.define("Opus", RECORDER_CONTAINER_OPUS);
+        }
         sampleTypes.define(wav::SAMP_TYPE_UINT8, "Uint8", wav::SAMP_TYPE_UINT8);
         sampleTypes.define(wav::SAMP_TYPE_INT16, "Int16", wav::SAMP_TYPE_INT16);
         sampleTypes.define(wav::SAMP_TYPE_INT32, "Int32", wav::SAMP_TYPE_INT32);
         sampleTypes.define(wav::SAMP_TYPE_FLOAT32, "Float32", wav::SAMP_TYPE_FLOAT32);
+        sigmfTypes.define("ci8", "ci8", sigmf::DATATYPE_CI8);
+        sigmfTypes.define("ci16", "ci16_le", sigmf::DATATYPE_CI16);
+        sigmfTypes.define("cf32", "cf32_le", sigmf::DATATYPE_CF32);
 
         // Load default config for option lists
-        containerId = containers.valueId(wav::FORMAT_WAV);
+        containerId = containers.valueId(RECORDER_CONTAINER_WAV);
         sampleTypeId = sampleTypes.valueId(wav::SAMP_TYPE_INT16);
+        sigmfTypeId = sigmfTypes.valueId(sigmf::DATATYPE_CI16);
 
         // Load config
         config.acquire();
@@ -69,6 +108,9 @@ public:
         if (config.conf[name].contains("sampleType") && sampleTypes.keyExists(config.conf[name]["sampleType"])) {
             sampleTypeId = sampleTypes.keyId(config.conf[name]["sampleType"]);
         }
+        if (config.conf[name].contains("sigmfType") && sigmfTypes.keyExists(config.conf[name]["sigmfType"])) {
+            sigmfTypeId = sigmfTypes.keyId(config.conf[name]["sigmfType"]);
+        }
         if (config.conf[name].contains("audioStream")) {
             selectedStreamName = config.conf[name]["audioStream"];
         }
@@ -78,9 +120,44 @@ public:
         if (config.conf[name].contains("stereo")) {
             stereo = config.conf[name]["stereo"];
         }
+        if (config.conf[name].contains("multiStreams")) {
+            for (const auto& stream : config.conf[name]["multiStreams"]) {
+                multiStreams.push_back((std::string)stream);
+            }
+        }
+        if (config.conf[name].contains("multiSingleFile")) {
+            multiSingleFile = config.conf[name]["multiSingleFile"];
+        }
         if (config.conf[name].contains("ignoreSilence")) {
             ignoreSilence = config.conf[name]["ignoreSilence"];
         }
+        if (config.conf[name].contains("silenceThreshold")) {
+            silenceThreshold = config.conf[name]["silenceThreshold"];
+        }
+        if (config.conf[name].contains("silenceHangTime")) {
+            silenceHangTime = std::max<int>((int)config.conf[name]["silenceHangTime"], 0);
+        }
+        if (config.conf[name].contains("compressionLevel")) {
+            compressionLevel = std::clamp<float>(config.conf[name]["compressionLevel"], 0.0f, 1.0f);
+        }
+        if (config.conf[name].contains("bufferDepth")) {
+            bufferDepth = std::clamp<int>(config.conf[name]["bufferDepth"], RECORDER_MIN_BUFFER_DEPTH, RECORDER_MAX_BUFFER_DEPTH);
+        }
+        if (config.conf[name].contains("directIO")) {
+            directIO = config.conf[name]["directIO"];
+        }
+        if (config.conf[name].contains("preallocate")) {
+            preallocate = config.conf[name]["preallocate"];
+        }
+        if (config.conf[name].contains("rolloverSize")) {
+            rolloverSize = std::max<int>((int)config.conf[name]["rolloverSize"], 0);
+        }
+        if (config.conf[name].contains("rolloverTime")) {
+            rolloverTime = std::max<int>((int)config.conf[name]["rolloverTime"], 0);
+        }
+        if (config.conf[name].contains("preRecordTime")) {
+            preRecordTime = std::clamp<int>((int)config.conf[name]["preRecordTime"], 0, RECORDER_MAX_PRERECORD_TIME);
+        }
         if (config.conf[name].contains("nameTemplate")) {
             std::string _nameTemplate = config.conf[name]["nameTemplate"];
             if (_nameTemplate.length() > sizeof(nameTemplate)-1) {
@@ -111,6 +188,7 @@ public:
         core::modComManager.unregisterInterface(name);
         gui::menu.removeEntry(name);
         stop();
+        stopPath();
         deselectStream();
         sigpath::sinkManager.onStreamRegistered.unbindHandler(&onStreamRegisteredHandler);
         sigpath::sinkManager.onStreamUnregister.unbindHandler(&onStreamUnregisterHandler);
@@ -135,6 +213,7 @@ public:
 
         // Select the stream
         selectStream(selectedStreamName);
+        updatePreRecord();
     }
 
     void enable() {
@@ -153,6 +232,28 @@ public:
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         if (recording) { return; }
 
+        // SigMF only describes baseband and the encoders only take audio
+        int container = containers[containerId];
+        sigmfMode = (container == RECORDER_CONTAINER_SIGMF);
+        encoderMode = (container == RECORDER_CONTAINER_FLAC || container == RECORDER_CONTAINER_OPUS);
+        if (sigmfMode && recMode != RECORDER_MODE_BASEBAND) {
+            flog::error("SigMF can only be used to record baseband");
+            return;
+        }
+        if (encoderMode && recMode != RECORDER_MODE_AUDIO) {
+            flog::error("FLAC and Opus can only be used to record a single audio stream");
+            return;
+        }
+
+        // Multi-track recordings have streams of their own
+        if (recMode == RECORDER_MODE_MULTI) {
+            ignoringSilence = false;
+            if (!startMulti()) { return; }
+            hasSourceStats = sigpath::sourceManager.getStats(startStats);
+            recording = true;
+            return;
+        }
+
         // Configure the wav writer
         if (recMode == RECORDER_MODE_AUDIO) {
             if (selectedStreamName.empty()) { return; }
@@ -161,20 +262,308 @@ public:
         else {
             samplerate = sigpath::iqFrontEnd.getSampleRate();
         }
-        writer.setFormat(containers[containerId]);
-        writer.setChannels((recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2);
-        writer.setSampleType(sampleTypes[sampleTypeId]);
-        writer.setSamplerate(samplerate);
+
+        configureWriter(writer, (recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2, samplerate);
+        sigmfWriter.setDataType(sigmfTypes[sigmfTypeId]);
+        sigmfWriter.setSamplerate(samplerate);
+        sigmfWriter.setBufferDepth(bufferDepth);
+        sigmfWriter.setDirectIO(directIO);
+        sigmfWriter.setPreallocate(preallocate);
+        encoderWriter.setCodec((container == RECORDER_CONTAINER_OPUS) ? encoder::CODEC_OPUS : encoder::CODEC_FLAC);
+        encoderWriter.setChannels(stereo ? 2 : 1);
+        encoderWriter.setSamplerate(samplerate);
+        // FLAC doesn't go past 24bit, the 32bit sample types are encoded as 24bit
+        encoderWriter.setBitDepth(std::min<int>(bitDepth(sampleTypes[sampleTypeId]), 24));
+        encoderWriter.setCompressionLevel(compressionLevel);
+        encoderWriter.setBufferSize(bufferDepth);
 
         // Open file
         std::string type = (recMode == RECORDER_MODE_AUDIO) ? "audio" : "baseband";
         std::string vfoName = (recMode == RECORDER_MODE_AUDIO) ? selectedStreamName : "";
         std::string extension = ".wav";
+        if (sigmfMode) { extension = ""; }
+        else if (container == RECORDER_CONTAINER_FLAC) { extension = ".flac"; }
+        else if (container == RECORDER_CONTAINER_OPUS) { extension = ".opus"; }
         std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, vfoName) + extension);
-        if (!writer.open(expandedPath)) {
+        bool opened;
+        if (sigmfMode) {
+            // The first capture starts with the pre-recorded samples, it is corrected with the metadata
+            // of the first live buffer if the source provides it
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            {
+                std::lock_guard<std::mutex> lck(historyMtx);
+                if (historyRate == samplerate) { now -= (int64_t)((double)(history.getSize() / historyChannels) * 1e9 / samplerate); }
+            }
+            lastMeta = dsp::StreamMeta();
+            opened = sigmfWriter.open(expandedPath, gui::waterfall.getCenterFrequency(), now);
+        }
+        else if (encoderMode) {
+            opened = encoderWriter.open(expandedPath);
+        }
+        else {
+            opened = writer.open(expandedPath);
+        }
+        if (!opened) {
             flog::error("Failed to open file for recording: {0}", expandedPath);
             return;
         }
+        recPath = expandedPath;
+
+        // Remember the source statistics to tell if samples were lost during the recording
+        hasSourceStats = sigpath::sourceManager.getStats(startStats);
+
+        // The samples kept while armed go first, unless the samplerate changed since they were taken
+        {
+            std::lock_guard<std::mutex> lck(historyMtx);
+            gate.init(samplerate, (recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2, silenceThreshold, silenceHangTime / 1000.0);
+            ignoringSilence = false;
+            if (!pathRunning || historyRate != samplerate) { history.clear(); }
+            recording = true;
+        }
+
+        // Open audio stream or baseband if it isn't already running for the pre-recording
+        if (!pathRunning) { startPath(); }
+    }
+
+    void stop() {
+        std::lock_guard<std::recursive_mutex> lck(recMtx);
+        if (!recording) { return; }
+
+        // Stop writing, the path keeps running if the pre-recording is armed
+        {
+            std::lock_guard<std::mutex> lck(historyMtx);
+            recording = false;
+            history.clear();
+        }
+        if (recMode == RECORDER_MODE_MULTI) {
+            stopMulti();
+        }
+        else if (!preRecordArmed()) {
+            stopPath();
+        }
+
+        // Close file
+        if (sigmfMode) {
+            sigmfWriter.close();
+        }
+        else if (encoderMode) {
+            encoderWriter.close();
+        }
+        else {
+            writer.close();
+        }
+        ioThread.stop();
+
+        if (getSamplesDropped()) {
+            flog::warn("Recording '{0}': the disk couldn't keep up, {1} samples were dropped", recPath, getSamplesDropped());
+        }
+
+        SourceStats::Snapshot gaps;
+        if (getRecordingGaps(gaps)) {
+            flog::warn("Recording '{0}' has gaps: {1} samples lost in {2} drops, {3} overruns, {4} stalls", recPath, gaps.droppedSamples, gaps.drops, gaps.overruns, gaps.stalls);
+        }
+
+        // The samplerate or settings may have changed during the recording
+        updatePreRecord();
+    }
+
+private:
+    struct Track {
+        RecorderModule* parent;
+        std::string name;
+        dsp::stream<dsp::stereo_t>* stream = NULL;
+        dsp::convert::StereoToMono s2m;
+        dsp::sink::Handler<dsp::stereo_t> stereoSink;
+        dsp::sink::Handler<float> monoSink;
+
+        // Writer of the track when recording to separate files, otherwise the samples wait in the FIFO
+        // until every track has some to interleave
+        wav::Writer writer;
+        dsp::buffer::History<float> fifo;
+    };
+
+    void configureWriter(wav::Writer& w, int channels, uint64_t rate) {
+        w.setFormat((containers[containerId] == RECORDER_CONTAINER_RF64) ? wav::FORMAT_RF64 : wav::FORMAT_WAV);
+        w.setChannels(channels);
+        w.setSampleType(sampleTypes[sampleTypeId]);
+        w.setSamplerate(rate);
+        w.setBufferDepth(bufferDepth);
+        w.setDirectIO(directIO);
+        w.setPreallocate(preallocate);
+        w.setRollover((uint64_t)rolloverSize << 20, rolloverTime * 60.0);
+        w.setIOThread(NULL);
+    }
+
+    // Record the selected streams either as the channels of a single file or to a file each. The files all
+    // share a single I/O thread.
+    bool startMulti() {
+        // Only the selected streams that currently exist are recorded
+        std::vector<std::string> names;
+        for (const auto& stream : multiStreams) {
+            if (audioStreams.keyExists(stream)) { names.push_back(stream); }
+        }
+        if (names.empty()) {
+            flog::error("No stream selected for multi-track recording");
+            return false;
+        }
+
+        // Interleaving needs every stream to run at the same rate
+        trackChannels = stereo ? 2 : 1;
+        samplerate = sigpath::sinkManager.getStreamSampleRate(names[0]);
+        if (multiSingleFile) {
+            for (const auto& stream : names) {
+                if (sigpath::sinkManager.getStreamSampleRate(stream) == samplerate) { continue; }
+                flog::error("Cannot record '{0}' in the same file as '{1}', their samplerates differ", stream, names[0]);
+                return false;
+            }
+        }
+
+        // Open the files
+        ioThread.start();
+        std::string type = "audio";
+        recPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, "") + ".wav");
+        if (multiSingleFile) {
+            configureWriter(writer, trackChannels * names.size(), samplerate);
+            writer.setIOThread(&ioThread);
+            if (!writer.open(recPath)) {
+                flog::error("Failed to open file for recording: {0}", recPath);
+                ioThread.stop();
+                return false;
+            }
+            multiBuf = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE * trackChannels * names.size());
+            multiSyncFrames = samplerate * RECORDER_MULTI_SYNC_TIME;
+        }
+        for (const auto& stream : names) {
+            std::unique_ptr<Track> track = std::make_unique<Track>();
+            track->parent = this;
+            track->name = stream;
+            if (multiSingleFile) {
+                // The sync time plus the one block pushed before the tracks are written out
+                track->fifo.setCapacity((multiSyncFrames + STREAM_BUFFER_SIZE) * trackChannels);
+            }
+            else {
+                // The stream name keeps the files apart when several VFOs are on the same frequency
+                std::string path = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, stream) + "_" + stream + ".wav");
+                configureWriter(track->writer, trackChannels, sigpath::sinkManager.getStreamSampleRate(stream));
+                track->writer.setIOThread(&ioThread);
+                if (!track->writer.open(path)) {
+                    flog::error("Failed to open file for recording: {0}", path);
+                    stopMulti();
+                    writer.close();
+                    ioThread.stop();
+                    return false;
+                }
+            }
+            tracks.push_back(std::move(track));
+        }
+
+        // Start the streams once everything is open
+        for (auto& track : tracks) {
+            track->stream = sigpath::sinkManager.bindStream(track->name);
+            if (stereo) {
+                track->stereoSink.init(track->stream, multiStereoHandler, track.get());
+                track->stereoSink.start();
+            }
+            else {
+                track->s2m.init(track->stream);
+                track->monoSink.init(&track->s2m.out, multiMonoHandler, track.get());
+                track->s2m.start();
+                track->monoSink.start();
+            }
+        }
+        return true;
+    }
+
+    void stopMulti() {
+        for (auto& track : tracks) {
+            if (!track->stream) { continue; }
+            if (trackChannels == 2) {
+                track->stereoSink.stop();
+            }
+            else {
+                track->monoSink.stop();
+                track->s2m.stop();
+            }
+            sigpath::sinkManager.unbindStream(track->name, track->stream);
+        }
+
+        // What is left in the FIFOs is written out, padded with silence
+        if (multiSingleFile && !tracks.empty()) {
+            std::lock_guard<std::mutex> lck(multiMtx);
+            interleaveTracks(true);
+        }
+        for (auto& track : tracks) {
+            track->writer.close();
+        }
+        tracks.clear();
+        if (multiBuf) {
+            dsp::buffer::free(multiBuf);
+            multiBuf = NULL;
+        }
+    }
+
+    bool isTrack(std::string name) {
+        for (const auto& track : tracks) {
+            if (track->name == name) { return true; }
+        }
+        return false;
+    }
+
+    // Write the frames that every track has to the single file. A track that falls more than the sync time
+    // behind the others, eg. because its stream stalled, is padded with silence so the others aren't lost.
+    void interleaveTracks(bool flush = false) {
+        int frames = INT_MAX;
+        int most = 0;
+        for (const auto& track : tracks) {
+            int n = track->fifo.getSize() / trackChannels;
+            frames = std::min<int>(frames, n);
+            most = std::max<int>(most, n);
+        }
+        if (flush || most > multiSyncFrames) { frames = most; }
+
+        int totalChannels = tracks.size() * trackChannels;
+        while (frames > 0) {
+            int count = std::min<int>(frames, STREAM_BUFFER_SIZE);
+            for (size_t i = 0; i < tracks.size(); i++) {
+                float* out = &multiBuf[i * trackChannels];
+                int pos = 0;
+                tracks[i]->fifo.pop(count * trackChannels, [&](float* samples, int n) {
+                    for (int j = 0; j < n; j++, pos++) {
+                        out[(pos / trackChannels) * totalChannels + (pos % trackChannels)] = samples[j];
+                    }
+                });
+                for (; pos < count * trackChannels; pos++) {
+                    out[(pos / trackChannels) * totalChannels + (pos % trackChannels)] = 0.0f;
+                }
+            }
+            writer.write(multiBuf, count);
+            frames -= count;
+        }
+    }
+
+    void writeTrack(Track* track, float* data, int count) {
+        if (!multiSingleFile) {
+            track->writer.write(data, count);
+            return;
+        }
+        std::lock_guard<std::mutex> lck(multiMtx);
+        track->fifo.push(data, count * trackChannels);
+        interleaveTracks();
+    }
+
+    static void multiStereoHandler(dsp::stereo_t* data, int count, void* ctx) {
+        Track* track = (Track*)ctx;
+        track->parent->writeTrack(track, (float*)data, count);
+    }
+
+    static void multiMonoHandler(float* data, int count, void* ctx) {
+        Track* track = (Track*)ctx;
+        track->parent->writeTrack(track, data, count);
+    }
+
+    void startPath() {
+        std::lock_guard<std::recursive_mutex> lck(recMtx);
+        if (pathRunning) { return; }
 
         // Open audio stream or baseband
         if (recMode == RECORDER_MODE_AUDIO) {
@@ -195,16 +584,16 @@ public:
             basebandSink.start();
             sigpath::iqFrontEnd.bindIQStream(basebandStream);
         }
-
-        recording = true;
+        pathMode = recMode;
+        pathRunning = true;
     }
 
-    void stop() {
+    void stopPath() {
         std::lock_guard<std::recursive_mutex> lck(recMtx);
-        if (!recording) { return; }
+        if (!pathRunning) { return; }
 
         // Close audio stream or baseband
-        if (recMode == RECORDER_MODE_AUDIO) {
+        if (pathMode == RECORDER_MODE_AUDIO) {
             splitter.unbindStream(&stereoStream);
             monoSink.stop();
             stereoSink.stop();
@@ -217,14 +606,124 @@ public:
             basebandSink.stop();
             delete basebandStream;
         }
+        pathRunning = false;
+    }
 
-        // Close file
-        writer.close();
-        
-        recording = false;
+    bool preRecordArmed() {
+        if (!preRecordTime) { return false; }
+        return recMode == RECORDER_MODE_BASEBAND || (recMode == RECORDER_MODE_AUDIO && !selectedStreamName.empty() && audioStream);
+    }
+
+    // Restart the path that keeps the pre-recording with the current settings, or stop it if it isn't wanted
+    void updatePreRecord() {
+        std::lock_guard<std::recursive_mutex> lck(recMtx);
+        if (recording) { return; }
+        stopPath();
+
+        // Size the history for the current samplerate, within the memory limit
+        double rate;
+        int channels;
+        if (recMode == RECORDER_MODE_AUDIO) {
+            rate = selectedStreamName.empty() ? 0 : sigpath::sinkManager.getStreamSampleRate(selectedStreamName);
+            channels = stereo ? 2 : 1;
+        }
+        else {
+            rate = sigpath::iqFrontEnd.getSampleRate();
+            channels = 2;
+        }
+        int64_t samples = std::min<int64_t>((double)preRecordTime * rate, ((int64_t)RECORDER_MAX_PRERECORD_MB << 20) / (channels * sizeof(float)));
+        {
+            std::lock_guard<std::mutex> lck(historyMtx);
+            history.setCapacity(preRecordArmed() ? samples * channels : 0);
+            preRecordLength = (rate > 0) ? (double)samples / rate : 0;
+            historyRate = rate;
+            historyChannels = channels;
+        }
+
+        if (preRecordArmed()) { startPath(); }
+    }
+
+    // Keep the samples in the history when not recording. Once recording, the history is written out ahead of the
+    // live samples as fast as the disk buffer allows. Returns false if the samples are to be written directly.
+    bool handleHistory(float* data, int count, int channels) {
+        if (recording && !history.getSize()) { return false; }
+
+        // If the disk can't catch up the oldest samples are overwritten, they would have been dropped anyway
+        history.push(data, count * channels);
+        if (!recording) { return true; }
+        while (history.getSize() && getBufferFill() < RECORDER_PRERECORD_MAX_FILL) {
+            history.pop(STREAM_BUFFER_SIZE * channels, [&](float* samples, int n) {
+                if (sigmfMode) { sigmfWriter.write(samples, n / channels); }
+                else { writeFile(samples, n / channels); }
+            });
+        }
+        return true;
+    }
+
+    // Multi-track recordings to separate files report the first track, or the sum or worst of the tracks
+    bool separateTracks() { return !tracks.empty() && !multiSingleFile; }
+
+    uint64_t getSamplesWritten() {
+        if (separateTracks()) { return tracks[0]->writer.getSamplesWritten(); }
+        if (encoderMode) { return encoderWriter.getSamplesWritten(); }
+        return sigmfMode ? sigmfWriter.getSamplesWritten() : writer.getSamplesWritten();
+    }
+
+    uint64_t getSamplesDropped() {
+        if (separateTracks()) {
+            uint64_t dropped = 0;
+            for (auto& track : tracks) { dropped += track->writer.getSamplesDropped(); }
+            return dropped;
+        }
+        if (encoderMode) { return encoderWriter.getSamplesDropped(); }
+        return sigmfMode ? sigmfWriter.getSamplesDropped() : writer.getSamplesDropped();
+    }
+
+    float getBufferFill() {
+        if (separateTracks()) {
+            float fill = 0.0f;
+            for (auto& track : tracks) { fill = std::max<float>(fill, track->writer.getBufferFill()); }
+            return fill;
+        }
+        if (encoderMode) { return encoderWriter.getBufferFill(); }
+        return sigmfMode ? sigmfWriter.getBufferFill() : writer.getBufferFill();
+    }
+
+    bool writeFailed() {
+        if (separateTracks()) {
+            for (auto& track : tracks) {
+                if (track->writer.hasFailed()) { return true; }
+            }
+            return false;
+        }
+        if (encoderMode) { return encoderWriter.hasFailed(); }
+        return sigmfMode ? sigmfWriter.hasFailed() : writer.hasFailed();
+    }
+
+    int getSegment() {
+        if (sigmfMode || encoderMode) { return 0; }
+        return separateTracks() ? tracks[0]->writer.getSegment() : writer.getSegment();
+    }
+
+    static int bitDepth(wav::SampleType type) {
+        switch (type) {
+        case wav::SAMP_TYPE_UINT8:  return 8;
+        case wav::SAMP_TYPE_INT16:  return 16;
+        default:                    return 32;
+        }
+    }
+
+    // Get what the source lost since the start of the recording, returns false if nothing was lost or it can't be known
+    bool getRecordingGaps(SourceStats::Snapshot& gaps) {
+        SourceStats::Snapshot now;
+        if (!hasSourceStats || !sigpath::sourceManager.getStats(now) || now.startTime != startStats.startTime) { return false; }
+        gaps.droppedSamples = now.droppedSamples - startStats.droppedSamples;
+        gaps.drops = now.drops - startStats.drops;
+        gaps.overruns = now.overruns - startStats.overruns;
+        gaps.stalls = now.stalls - startStats.stalls;
+        return gaps.gaps() > 0;
     }
 
-private:
     static void menuHandler(void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
         float menuWidth = ImGui::GetContentRegionAvail().x;
@@ -232,12 +731,13 @@ private:
         // Recording mode
         if (_this->recording) { style::beginDisabled(); }
         ImGui::BeginGroup();
-        ImGui::Columns(2, CONCAT("RecorderModeColumns##_", _this->name), false);
+        ImGui::Columns(3, CONCAT("RecorderModeColumns##_", _this->name), false);
         if (ImGui::RadioButton(CONCAT("Baseband##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_BASEBAND)) {
             _this->recMode = RECORDER_MODE_BASEBAND;
             config.acquire();
             config.conf[_this->name]["mode"] = _this->recMode;
             config.release(true);
+            _this->updatePreRecord();
         }
         ImGui::NextColumn();
         if (ImGui::RadioButton(CONCAT("Audio##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_AUDIO)) {
@@ -245,6 +745,15 @@ private:
             config.acquire();
             config.conf[_this->name]["mode"] = _this->recMode;
             config.release(true);
+            _this->updatePreRecord();
+        }
+        ImGui::NextColumn();
+        if (ImGui::RadioButton(CONCAT("Multi##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_MULTI)) {
+            _this->recMode = RECORDER_MODE_MULTI;
+            config.acquire();
+            config.conf[_this->name]["mode"] = _this->recMode;
+            config.release(true);
+            _this->updatePreRecord();
         }
         ImGui::Columns(1, CONCAT("EndRecorderModeColumns##_", _this->name), false);
         ImGui::EndGroup();
@@ -275,12 +784,35 @@ private:
             config.release(true);
         }
 
-        ImGui::LeftLabel("Sample type");
-        ImGui::FillWidth();
-        if (ImGui::Combo(CONCAT("##_recorder_st_", _this->name), &_this->sampleTypeId, _this->sampleTypes.txt)) {
-            config.acquire();
-            config.conf[_this->name]["sampleType"] = _this->sampleTypes.key(_this->sampleTypeId);
-            config.release(true);
+        int container = _this->containers[_this->containerId];
+        bool sigmfSelected = (container == RECORDER_CONTAINER_SIGMF);
+        bool encoderSelected = (container == RECORDER_CONTAINER_FLAC || container == RECORDER_CONTAINER_OPUS);
+        if (sigmfSelected) {
+            ImGui::LeftLabel("Data type");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_sigmf_type_", _this->name), &_this->sigmfTypeId, _this->sigmfTypes.txt)) {
+                config.acquire();
+                config.conf[_this->name]["sigmfType"] = _this->sigmfTypes.key(_this->sigmfTypeId);
+                config.release(true);
+            }
+        }
+        else if (container != RECORDER_CONTAINER_OPUS) {
+            ImGui::LeftLabel("Sample type");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_st_", _this->name), &_this->sampleTypeId, _this->sampleTypes.txt)) {
+                config.acquire();
+                config.conf[_this->name]["sampleType"] = _this->sampleTypes.key(_this->sampleTypeId);
+                config.release(true);
+            }
+        }
+        if (encoderSelected) {
+            ImGui::LeftLabel("Compression");
+            ImGui::FillWidth();
+            if (ImGui::SliderFloat(CONCAT("##_recorder_compression_", _this->name), &_this->compressionLevel, 0.0f, 1.0f, "%.2f")) {
+                config.acquire();
+                config.conf[_this->name]["compressionLevel"] = _this->compressionLevel;
+                config.release(true);
+            }
         }
 
         // Show additional audio options
@@ -313,6 +845,7 @@ private:
                 config.acquire();
                 config.conf[_this->name]["stereo"] = _this->stereo;
                 config.release(true);
+                _this->updatePreRecord();
             }
             if (_this->recording) { style::endDisabled(); }
 
@@ -321,22 +854,136 @@ private:
                 config.conf[_this->name]["ignoreSilence"] = _this->ignoreSilence;
                 config.release(true);
             }
+            if (_this->ignoreSilence) {
+                ImGui::LeftLabel("Threshold");
+                ImGui::FillWidth();
+                if (ImGui::SliderFloat(CONCAT("##_recorder_silence_thr_", _this->name), &_this->silenceThreshold, -120.0f, 0.0f, "%.0f dBFS")) {
+                    std::lock_guard<std::mutex> lck(_this->historyMtx);
+                    _this->gate.setThreshold(_this->silenceThreshold);
+                    config.acquire();
+                    config.conf[_this->name]["silenceThreshold"] = _this->silenceThreshold;
+                    config.release(true);
+                }
+                ImGui::LeftLabel("Hang time (ms)");
+                ImGui::FillWidth();
+                if (ImGui::InputInt(CONCAT("##_recorder_silence_hang_", _this->name), &_this->silenceHangTime, 100, 1000)) {
+                    _this->silenceHangTime = std::max<int>(_this->silenceHangTime, 0);
+                    std::lock_guard<std::mutex> lck(_this->historyMtx);
+                    _this->gate.setHangTime(_this->silenceHangTime / 1000.0);
+                    config.acquire();
+                    config.conf[_this->name]["silenceHangTime"] = _this->silenceHangTime;
+                    config.release(true);
+                }
+            }
         }
 
+        // Streams recorded together in multi-track mode
+        if (_this->recMode == RECORDER_MODE_MULTI) {
+            if (_this->recording) { style::beginDisabled(); }
+            for (int i = 0; i < _this->audioStreams.size(); i++) {
+                std::string stream = _this->audioStreams.key(i);
+                auto it = std::find(_this->multiStreams.begin(), _this->multiStreams.end(), stream);
+                bool selected = (it != _this->multiStreams.end());
+                if (ImGui::Checkbox(CONCAT(stream + "##_recorder_multi_stream_", _this->name), &selected)) {
+                    if (selected) {
+                        _this->multiStreams.push_back(stream);
+                    }
+                    else {
+                        _this->multiStreams.erase(it);
+                    }
+                    config.acquire();
+                    config.conf[_this->name]["multiStreams"] = _this->multiStreams;
+                    config.release(true);
+                }
+            }
+            if (ImGui::Checkbox(CONCAT("Stereo##_recorder_multi_stereo_", _this->name), &_this->stereo)) {
+                config.acquire();
+                config.conf[_this->name]["stereo"] = _this->stereo;
+                config.release(true);
+            }
+            if (ImGui::Checkbox(CONCAT("Single file##_recorder_multi_single_", _this->name), &_this->multiSingleFile)) {
+                config.acquire();
+                config.conf[_this->name]["multiSingleFile"] = _this->multiSingleFile;
+                config.release(true);
+            }
+            if (_this->recording) { style::endDisabled(); }
+        }
+
+        // Disk write buffering
+        if (_this->recording) { style::beginDisabled(); }
+        ImGui::LeftLabel("Write buffer (MB)");
+        ImGui::FillWidth();
+        if (ImGui::SliderInt(CONCAT("##_recorder_buf_depth_", _this->name), &_this->bufferDepth, RECORDER_MIN_BUFFER_DEPTH, RECORDER_MAX_BUFFER_DEPTH)) {
+            config.acquire();
+            config.conf[_this->name]["bufferDepth"] = _this->bufferDepth;
+            config.release(true);
+        }
+        if (ImGui::Checkbox(CONCAT("Bypass OS cache##_recorder_direct_io_", _this->name), &_this->directIO)) {
+            config.acquire();
+            config.conf[_this->name]["directIO"] = _this->directIO;
+            config.release(true);
+        }
+        if (ImGui::Checkbox(CONCAT("Preallocate##_recorder_prealloc_", _this->name), &_this->preallocate)) {
+            config.acquire();
+            config.conf[_this->name]["preallocate"] = _this->preallocate;
+            config.release(true);
+        }
+
+        // Splitting into multiple files, zero to disable. SigMF and compressed recordings are a single file.
+        bool canSplit = !sigmfSelected && !encoderSelected;
+        if (!canSplit && !_this->recording) { style::beginDisabled(); }
+        ImGui::LeftLabel("Split size (MB)");
+        ImGui::FillWidth();
+        if (ImGui::InputInt(CONCAT("##_recorder_rollover_size_", _this->name), &_this->rolloverSize, 100, 1000)) {
+            _this->rolloverSize = std::max<int>(_this->rolloverSize, 0);
+            config.acquire();
+            config.conf[_this->name]["rolloverSize"] = _this->rolloverSize;
+            config.release(true);
+        }
+        ImGui::LeftLabel("Split time (min)");
+        ImGui::FillWidth();
+        if (ImGui::InputInt(CONCAT("##_recorder_rollover_time_", _this->name), &_this->rolloverTime, 1, 10)) {
+            _this->rolloverTime = std::max<int>(_this->rolloverTime, 0);
+            config.acquire();
+            config.conf[_this->name]["rolloverTime"] = _this->rolloverTime;
+            config.release(true);
+        }
+        if (!canSplit && !_this->recording) { style::endDisabled(); }
+
+        // Keep the last seconds in memory so that a recording can start before it was triggered
+        if (_this->recMode == RECORDER_MODE_MULTI) { style::beginDisabled(); }
+        ImGui::LeftLabel("Pre-record (s)");
+        ImGui::FillWidth();
+        if (ImGui::InputInt(CONCAT("##_recorder_prerecord_", _this->name), &_this->preRecordTime, 1, 10)) {
+            _this->preRecordTime = std::clamp<int>(_this->preRecordTime, 0, RECORDER_MAX_PRERECORD_TIME);
+            _this->updatePreRecord();
+            config.acquire();
+            config.conf[_this->name]["preRecordTime"] = _this->preRecordTime;
+            config.release(true);
+        }
+        if (_this->pathRunning && _this->preRecordLength < _this->preRecordTime) {
+            ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Limited to %.1fs by memory", _this->preRecordLength);
+        }
+        if (_this->recMode == RECORDER_MODE_MULTI) { style::endDisabled(); }
+        if (_this->recording) { style::endDisabled(); }
+
         // Record button
         bool canRecord = _this->folderSelect.pathIsValid();
-        if (_this->recMode == RECORDER_MODE_AUDIO) { canRecord &= !_this->selectedStreamName.empty(); }
+        if (_this->recMode == RECORDER_MODE_AUDIO) { canRecord &= !_this->selectedStreamName.empty() && !sigmfSelected; }
+        if (_this->recMode == RECORDER_MODE_MULTI) { canRecord &= !_this->multiStreams.empty() && !sigmfSelected && !encoderSelected; }
         if (!_this->recording) {
+            if (!canRecord) { style::beginDisabled(); }
             if (ImGui::Button(CONCAT("Record##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
                 _this->start();
             }
+            if (!canRecord) { style::endDisabled(); }
             ImGui::TextColored(ImGui::GetStyleColorVec4(ImGuiCol_Text), "Idle --:--:--");
         }
         else {
             if (ImGui::Button(CONCAT("Stop##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
                 _this->stop();
             }
-            uint64_t seconds = _this->writer.getSamplesWritten() / _this->samplerate;
+            uint64_t seconds = _this->getSamplesWritten() / _this->samplerate;
             time_t diff = seconds;
             tm* dtm = gmtime(&diff);
 
@@ -346,6 +993,33 @@ private:
             else {
                 ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Recording %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
+            if (!_this->sigmfMode && _this->getSegment()) {
+                ImGui::Text("File %d", _this->getSegment() + 1);
+            }
+
+            SourceStats::Snapshot gaps;
+            if (_this->getRecordingGaps(gaps)) {
+                ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Source gaps: %d", (int)gaps.gaps());
+            }
+
+            // Show how far behind the disk is
+            ImGui::ProgressBar(_this->getBufferFill(), ImVec2(menuWidth, 0), "Write buffer");
+            if (_this->writeFailed()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Disk write error");
+            }
+            else if (_this->getSamplesDropped()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Disk overflow: %d samples dropped", (int)_this->getSamplesDropped());
+            }
+
+            // Mark the current position in the SigMF annotations
+            if (_this->sigmfMode) {
+                ImGui::SetNextItemWidth(menuWidth - ImGui::CalcTextSize("Annotate").x - ImGui::GetStyle().ItemSpacing.x - ImGui::GetStyle().FramePadding.x * 2.0f);
+                ImGui::InputText(CONCAT("##_recorder_annotation_", _this->name), _this->annotationLabel, sizeof(_this->annotationLabel) - 1);
+                ImGui::SameLine();
+                if (ImGui::Button(CONCAT("Annotate##_recorder_annotate_", _this->name))) {
+                    _this->sigmfWriter.addAnnotation(_this->annotationLabel);
+                }
+            }
         }
     }
 
@@ -368,6 +1042,7 @@ private:
         streamId = audioStreams.keyId(name);
         volume.setInput(audioStream);
         startAudioPath();
+        updatePreRecord();
     }
 
     void deselectStream() {
@@ -377,6 +1052,7 @@ private:
             return;
         }
         if (recording && recMode == RECORDER_MODE_AUDIO) { stop(); }
+        if (pathMode == RECORDER_MODE_AUDIO) { stopPath(); }
         stopAudioPath();
         sigpath::sinkManager.unbindStream(selectedStreamName, audioStream);
         selectedStreamName.clear();
@@ -416,6 +1092,12 @@ private:
         // Remove stream from list
         _this->audioStreams.undefineKey(name);
 
+        // A multi-track recording can't go on without one of its streams
+        if (_this->recording && _this->isTrack(name)) {
+            flog::warn("Stream '{0}' is being removed, stopping the multi-track recording", name);
+            _this->stop();
+        }
+
         // If the stream is in used, deselect it and reselect default. Otherwise, update ID.
         if (_this->selectedStreamName == name) {
             _this->selectStream("");
@@ -482,37 +1164,62 @@ private:
 
     static void complexHandler(dsp::complex_t* data, int count, void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->historyMtx);
+        if (_this->handleHistory((float*)data, count, 2)) { return; }
+        if (_this->sigmfMode) {
+            _this->writeSigMF(data, count);
+            return;
+        }
         _this->writer.write((float*)data, count);
     }
 
-    static void stereoHandler(dsp::stereo_t* data, int count, void* ctx) {
-        RecorderModule* _this = (RecorderModule*)ctx;
-        if (_this->ignoreSilence) {
-            float absMax = 0.0f;
-            float* _data = (float*)data;
-            int _count = count * 2;
-            for (int i = 0; i < _count; i++) {
-                float val = fabsf(_data[i]);
-                if (val > absMax) { absMax = val; }
+    void writeSigMF(dsp::complex_t* data, int count) {
+        // Start a new capture on retune, on a restart of the stream or when the source lost samples
+        const dsp::StreamMeta& meta = basebandSink.getInputMeta();
+        if (meta.valid) {
+            uint64_t expected = lastMeta.sampleIndex + lastCount;
+            bool sameEpoch = lastMeta.valid && meta.epoch == lastMeta.epoch;
+            if (sameEpoch && meta.sampleIndex > expected) {
+                sigmfWriter.addAnnotation("Gap", std::to_string(meta.sampleIndex - expected) + " samples lost by the source");
+            }
+            if (!sameEpoch || meta.sampleIndex != expected || meta.frequency != lastMeta.frequency) {
+                sigmfWriter.addCapture(meta.frequency, meta.time);
             }
-            _this->ignoringSilence = (absMax < SILENCE_LVL);
-            if (_this->ignoringSilence) { return; }
+            lastMeta = meta;
+            lastCount = count;
         }
-        _this->writer.write((float*)data, count);
+        sigmfWriter.write((float*)data, count);
+    }
+
+    void writeFile(float* data, int count) {
+        if (encoderMode) {
+            encoderWriter.write(data, count);
+            return;
+        }
+        writer.write(data, count);
+    }
+
+    void writeAudio(float* data, int count) {
+        if (!ignoreSilence) {
+            writeFile(data, count);
+            return;
+        }
+        gate.process(data, count, [this](const float* samples, int n) { writeFile((float*)samples, n); });
+        ignoringSilence = !gate.isOpen();
+    }
+
+    static void stereoHandler(dsp::stereo_t* data, int count, void* ctx) {
+        RecorderModule* _this = (RecorderModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->historyMtx);
+        if (_this->handleHistory((float*)data, count, 2)) { return; }
+        _this->writeAudio((float*)data, count);
     }
 
     static void monoHandler(float* data, int count, void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
-        if (_this->ignoreSilence) {
-            float absMax = 0.0f;
-            for (int i = 0; i < count; i++) {
-                float val = fabsf(data[i]);
-                if (val > absMax) { absMax = val; }
-            }
-            _this->ignoringSilence = (absMax < SILENCE_LVL);
-            if (_this->ignoringSilence) { return; }
-        }
-        _this->writer.write(data, count);
+        std::lock_guard<std::mutex> lck(_this->historyMtx);
+        if (_this->handleHistory(data, count, 1)) { return; }
+        _this->writeAudio(data, count);
     }
 
     static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
@@ -525,7 +1232,8 @@ private:
         else if (code == RECORDER_IFACE_CMD_SET_MODE) {
             if (_this->recording) { return; }
             int* _in = (int*)in;
-            _this->recMode = std::clamp<int>(*_in, 0, 1);
+            _this->recMode = std::clamp<int>(*_in, RECORDER_MODE_BASEBAND, RECORDER_MODE_MULTI);
+            _this->updatePreRecord();
         }
         else if (code == RECORDER_IFACE_CMD_START) {
             if (!_this->recording) { _this->start(); }
@@ -540,22 +1248,63 @@ private:
     std::string root;
     char nameTemplate[1024];
 
-    OptionList<std::string, wav::Format> containers;
+    OptionList<std::string, int> containers;
     OptionList<int, wav::SampleType> sampleTypes;
+    OptionList<std::string, sigmf::DataType> sigmfTypes;
     FolderSelect folderSelect;
 
     int recMode = RECORDER_MODE_AUDIO;
     int containerId;
     int sampleTypeId;
+    int sigmfTypeId;
     bool stereo = true;
+    std::vector<std::string> multiStreams;
+    bool multiSingleFile = false;
     std::string selectedStreamName = "";
     float audioVolume = 1.0f;
     bool ignoreSilence = false;
+    float silenceThreshold = RECORDER_SILENCE_THRESHOLD;
+    int silenceHangTime = RECORDER_SILENCE_HANG_TIME;
+    int bufferDepth = ASYNC_FILE_DEFAULT_DEPTH;
+    bool directIO = false;
+    bool preallocate = false;
+    float compressionLevel = 0.5f;
+    int rolloverSize = 0;
+    int rolloverTime = 0;
+    int preRecordTime = 0;
     dsp::stereo_t audioLvl = { -100.0f, -100.0f };
 
     bool recording = false;
+    bool pathRunning = false;
+    int pathMode = RECORDER_MODE_AUDIO;
     bool ignoringSilence = false;
+    std::string recPath;
+    bool hasSourceStats = false;
+    SourceStats::Snapshot startStats;
     wav::Writer writer;
+    sigmf::Writer sigmfWriter;
+    bool sigmfMode = false;
+    encoder::Writer encoderWriter;
+    bool encoderMode = false;
+    dsp::StreamMeta lastMeta;
+    int lastCount = 0;
+    char annotationLabel[256] = "";
+
+    // Multi-track recording, the files are written by a single thread however many tracks there are
+    io::IOThread ioThread;
+    std::vector<std::unique_ptr<Track>> tracks;
+    int trackChannels = 2;
+    std::mutex multiMtx;
+    float* multiBuf = NULL;
+    int multiSyncFrames = 0;
+
+    // Samples from before the recording was started, shared between the DSP and the GUI threads
+    std::mutex historyMtx;
+    dsp::buffer::History<float> history;
+    double historyRate = 0;
+    double preRecordLength = 0;
+    dsp::audio::SilenceGate gate;
+    int historyChannels = 2;
     std::recursive_mutex recMtx;
     dsp::stream<dsp::complex_t>* basebandStream;
     dsp::stream<dsp::stereo_t> stereoStream;
@@ -3,6 +3,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <signal_path/source_ring.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
@@ -42,6 +43,8 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
+        ring.init(name, &stream, &stats);
 
         refresh();
         if (sampleRateList.size() > 0) {
@@ -310,6 +313,7 @@ private:
 
         airspy_set_rf_bias(_this->openDev, _this->biasT);
 
+        _this->ring.start(_this->sampleRate, _this->freq);
         airspy_start_rx(_this->openDev, callback, _this);
 
         _this->running = true;
@@ -320,9 +324,8 @@ private:
         AirspySourceModule* _this = (AirspySourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
-        _this->stream.stopWriter();
         airspy_close(_this->openDev);
-        _this->stream.clearWriteStop();
+        _this->ring.stop();
         flog::info("AirspySourceModule '{0}': Stop!", _this->name);
     }
 
@@ -332,6 +335,7 @@ private:
             airspy_set_freq(_this->openDev, freq);
         }
         _this->freq = freq;
+        _this->ring.setFrequency(freq);
         flog::info("AirspySourceModule '{0}': Tune: {1}!", _this->name, freq);
     }
 
@@ -564,8 +568,11 @@ private:
 
     static int callback(airspy_transfer_t* transfer) {
         AirspySourceModule* _this = (AirspySourceModule*)transfer->ctx;
-        memcpy(_this->stream.writeBuf, transfer->samples, transfer->sample_count * sizeof(dsp::complex_t));
-        if (!_this->stream.swap(transfer->sample_count)) { return -1; }
+        if (transfer->dropped_samples) {
+            _this->stats.addDropped(transfer->dropped_samples);
+            _this->ring.skip(transfer->dropped_samples);
+        }
+        _this->ring.write((dsp::complex_t*)transfer->samples, transfer->sample_count);
         return 0;
     }
 
@@ -575,6 +582,8 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
+    SourceRing ring;
     bool running = false;
     double freq;
     uint64_t selectedSerial = 0;
@@ -2,6 +2,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <signal_path/source_ring.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
@@ -42,6 +43,8 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
+        ring.init(name, &stream, &stats);
 
         refresh();
 
@@ -264,6 +267,7 @@ private:
         airspyhf_set_hf_att(_this->openDev, _this->atten / 6.0f);
         airspyhf_set_hf_lna(_this->openDev, _this->hfLNA);
 
+        _this->ring.start(_this->sampleRate, _this->freq);
         airspyhf_start(_this->openDev, callback, _this);
 
         _this->running = true;
@@ -274,9 +278,8 @@ private:
         AirspyHFSourceModule* _this = (AirspyHFSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
-        _this->stream.stopWriter();
         airspyhf_close(_this->openDev);
-        _this->stream.clearWriteStop();
+        _this->ring.stop();
         flog::info("AirspyHFSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -286,6 +289,7 @@ private:
             airspyhf_set_freq(_this->openDev, freq);
         }
         _this->freq = freq;
+        _this->ring.setFrequency(freq);
         flog::info("AirspyHFSourceModule '{0}': Tune: {1}!", _this->name, freq);
     }
 
@@ -373,8 +377,11 @@ private:
 
     static int callback(airspyhf_transfer_t* transfer) {
         AirspyHFSourceModule* _this = (AirspyHFSourceModule*)transfer->ctx;
-        memcpy(_this->stream.writeBuf, transfer->samples, transfer->sample_count * sizeof(dsp::complex_t));
-        if (!_this->stream.swap(transfer->sample_count)) { return -1; }
+        if (transfer->dropped_samples) {
+            _this->stats.addDropped(transfer->dropped_samples);
+            _this->ring.skip(transfer->dropped_samples);
+        }
+        _this->ring.write((dsp::complex_t*)transfer->samples, transfer->sample_count);
         return 0;
     }
 
@@ -384,6 +391,8 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
+    SourceRing ring;
     bool running = false;
     double freq;
     uint64_t selectedSerial = 0;
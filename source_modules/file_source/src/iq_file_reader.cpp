@@ -0,0 +1,379 @@
+#include "iq_file_reader.h"
+#include <volk/volk.h>
+#include <dsp/convert/u8_to_complex.h>
+#include <utils/sigmf.h>
+#include <json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_IEEE_FLOAT  0x0003
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+#pragma pack(push, 1)
+struct RIFFChunkHeader {
+    char id[4];
+    uint32_t size;
+};
+
+struct WavFormatChunk {
+    uint16_t codec;
+    uint16_t channelCount;
+    uint32_t sampleRate;
+    uint32_t bytesPerSecond;
+    uint16_t bytesPerSample;
+    uint16_t bitDepth;
+};
+
+struct DS64Chunk {
+    uint64_t riffSize;
+    uint64_t dataSize;
+    uint64_t sampleCount;
+};
+#pragma pack(pop)
+
+IQFileReader::IQFileReader(std::string path, double rawSampleRate, bool float32Pcm) {
+    this->float32Pcm = float32Pcm;
+
+    // A SigMF recording can be opened from either of its files, the samples are always in the data file
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    bool sigmf = (ext == SIGMF_META_EXT || ext == SIGMF_DATA_EXT);
+    std::string basePath = path.substr(0, path.size() - ext.size());
+
+    map(sigmf ? basePath + SIGMF_DATA_EXT : path);
+    try {
+        if (sigmf) {
+            parseSigMF(basePath + SIGMF_META_EXT);
+        }
+        else if (mapSize >= 12 && (!memcmp(mapBase, "RIFF", 4) || !memcmp(mapBase, "RF64", 4)) && !memcmp(&mapBase[8], "WAVE", 4)) {
+            parseWav();
+        }
+        else {
+            parseRaw(path, rawSampleRate);
+        }
+    }
+    catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+IQFileReader::~IQFileReader() {
+    unmap();
+}
+
+int IQFileReader::read(dsp::complex_t* out, int count) {
+    count = std::min<uint64_t>(count, sampleCount - position);
+    if (count <= 0) { return 0; }
+    const uint8_t* in = &data[position * frameSize];
+
+    switch (sampleType) {
+    case IQ_SAMPLE_TYPE_UINT8:
+        dsp::convert::U8ToComplex::process(count, in, out, u8Offset, 1.0f / 128.0f);
+        break;
+    case IQ_SAMPLE_TYPE_INT8:
+        volk_8i_s32f_convert_32f((float*)out, (const int8_t*)in, 128.0f, count * 2);
+        break;
+    case IQ_SAMPLE_TYPE_INT16:
+        volk_16i_s32f_convert_32f((float*)out, (const int16_t*)in, 32768.0f, count * 2);
+        break;
+    case IQ_SAMPLE_TYPE_INT32:
+        volk_32i_s32f_convert_32f((float*)out, (const int32_t*)in, 2147483648.0f, count * 2);
+        break;
+    case IQ_SAMPLE_TYPE_FLOAT32:
+        memcpy(out, in, count * sizeof(dsp::complex_t));
+        break;
+    }
+
+    position += count;
+    return count;
+}
+
+void IQFileReader::seek(uint64_t sample) {
+    position = std::min<uint64_t>(sample, sampleCount);
+}
+
+uint64_t IQFileReader::getPosition() {
+    return position;
+}
+
+uint64_t IQFileReader::getSampleCount() {
+    return sampleCount;
+}
+
+double IQFileReader::getSampleRate() {
+    return sampleRate;
+}
+
+IQSampleType IQFileReader::getSampleType() {
+    return sampleType;
+}
+
+bool IQFileReader::isRaw() {
+    return raw;
+}
+
+bool IQFileReader::hasCaptures() {
+    return !captures.empty();
+}
+
+double IQFileReader::getFrequency(uint64_t sample) {
+    const IQCapture* cap = findCapture(sample);
+    return cap ? cap->frequency : 0.0;
+}
+
+int64_t IQFileReader::getTime(uint64_t sample) {
+    const IQCapture* cap = findCapture(sample);
+    if (!cap || cap->time < 0) { return -1; }
+    return cap->time + (int64_t)((double)(sample - cap->start) * 1e9 / sampleRate);
+}
+
+uint64_t IQFileReader::getCaptureEnd(uint64_t sample) {
+    auto it = std::upper_bound(captures.begin(), captures.end(), sample, [](uint64_t s, const IQCapture& c) { return s < c.start; });
+    return (it == captures.end()) ? sampleCount : std::min<uint64_t>(it->start, sampleCount);
+}
+
+const IQCapture* IQFileReader::findCapture(uint64_t sample) {
+    // Captures are sorted by their start, samples before the first one belong to it
+    if (captures.empty()) { return NULL; }
+    auto it = std::upper_bound(captures.begin(), captures.end(), sample, [](uint64_t s, const IQCapture& c) { return s < c.start; });
+    return (it == captures.begin()) ? &captures.front() : &*(it - 1);
+}
+
+void IQFileReader::map(std::string path) {
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) { throw std::runtime_error("Could not open file"); }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fileHandle, &size) || !size.QuadPart) {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+        throw std::runtime_error("Could not get file size or file is empty");
+    }
+    mapSize = size.QuadPart;
+    mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapHandle) { mapBase = (const uint8_t*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0); }
+    if (!mapBase) {
+        if (mapHandle) { CloseHandle(mapHandle); }
+        CloseHandle(fileHandle);
+        mapHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+        throw std::runtime_error("Could not map file");
+    }
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { throw std::runtime_error("Could not open file"); }
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size) {
+        close(fd);
+        fd = -1;
+        throw std::runtime_error("Could not get file size or file is empty");
+    }
+    mapSize = st.st_size;
+    void* base = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        fd = -1;
+        throw std::runtime_error("Could not map file");
+    }
+    mapBase = (const uint8_t*)base;
+
+    // Playback is sequential, let the kernel read ahead aggressively
+    madvise(base, mapSize, MADV_SEQUENTIAL);
+#endif
+}
+
+void IQFileReader::unmap() {
+#ifdef _WIN32
+    if (mapBase) { UnmapViewOfFile(mapBase); }
+    if (mapHandle) { CloseHandle(mapHandle); }
+    if (fileHandle != INVALID_HANDLE_VALUE) { CloseHandle(fileHandle); }
+    mapHandle = NULL;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (mapBase) { munmap((void*)mapBase, mapSize); }
+    if (fd >= 0) { close(fd); }
+    fd = -1;
+#endif
+    mapBase = NULL;
+    mapSize = 0;
+}
+
+void IQFileReader::parseWav() {
+    bool rf64 = !memcmp(mapBase, "RF64", 4);
+    uint64_t ds64DataSize = 0;
+    const WavFormatChunk* fmt = NULL;
+    uint16_t format = 0;
+    uint64_t offset = 12;
+
+    // Walk the chunk list, the fmt and data chunks are not required to be at fixed offsets
+    while (offset + sizeof(RIFFChunkHeader) <= mapSize) {
+        const RIFFChunkHeader* hdr = (const RIFFChunkHeader*)&mapBase[offset];
+        uint64_t bodyOffset = offset + sizeof(RIFFChunkHeader);
+        uint64_t size = hdr->size;
+        uint64_t available = mapSize - bodyOffset;
+
+        if (!memcmp(hdr->id, "ds64", 4) && size >= sizeof(DS64Chunk) && size <= available) {
+            ds64DataSize = ((const DS64Chunk*)&mapBase[bodyOffset])->dataSize;
+        }
+        else if (!memcmp(hdr->id, "fmt ", 4) && size >= sizeof(WavFormatChunk) && size <= available) {
+            fmt = (const WavFormatChunk*)&mapBase[bodyOffset];
+            format = fmt->codec;
+
+            // The actual format of an extensible header is in the first two bytes of the subformat GUID
+            if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26) {
+                format = *(const uint16_t*)&mapBase[bodyOffset + 24];
+            }
+        }
+        else if (!memcmp(hdr->id, "data", 4)) {
+            if (!fmt) { throw std::runtime_error("WAV file has no format chunk before its data"); }
+
+            // RF64 stores the real size in the ds64 chunk. Recordings that were not closed properly
+            // have a zero or bogus size, in which case everything up to the end of the file is used
+            if (rf64 && size == 0xFFFFFFFF) { size = ds64DataSize; }
+            if (!size || size > available) { size = available; }
+
+            if (fmt->channelCount != 2) { throw std::runtime_error("WAV file is not a two channel IQ file"); }
+            setSampleType(format, fmt->bitDepth);
+            sampleRate = fmt->sampleRate;
+            data = &mapBase[bodyOffset];
+            sampleCount = size / frameSize;
+            return;
+        }
+
+        // Chunks are word aligned
+        offset = bodyOffset + size + (size & 1);
+    }
+
+    throw std::runtime_error("WAV file has no data chunk");
+}
+
+void IQFileReader::parseRaw(std::string path, double rawSampleRate) {
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    if (ext == ".cu8" || ext == ".u8") { sampleType = IQ_SAMPLE_TYPE_UINT8; }
+    else if (ext == ".cs8" || ext == ".s8") { sampleType = IQ_SAMPLE_TYPE_INT8; }
+    else if (ext == ".cs16" || ext == ".s16") { sampleType = IQ_SAMPLE_TYPE_INT16; }
+    else if (ext == ".cf32" || ext == ".f32" || ext == ".cfile") { sampleType = IQ_SAMPLE_TYPE_FLOAT32; }
+    else { throw std::runtime_error("Unknown file type"); }
+
+    if (rawSampleRate <= 0) { throw std::runtime_error("Raw files need a valid samplerate"); }
+
+    switch (sampleType) {
+    case IQ_SAMPLE_TYPE_UINT8:
+    case IQ_SAMPLE_TYPE_INT8:
+        frameSize = 2;
+        break;
+    case IQ_SAMPLE_TYPE_INT16:
+        frameSize = 4;
+        break;
+    default:
+        frameSize = 8;
+        break;
+    }
+
+    // Raw captures come straight from an RTL2832U, WAV files are centered on 128
+    raw = true;
+    u8Offset = U8_IQ_DEFAULT_OFFSET;
+    sampleRate = rawSampleRate;
+    data = mapBase;
+    sampleCount = mapSize / frameSize;
+}
+
+void IQFileReader::parseSigMF(std::string metaPath) {
+    std::ifstream file(metaPath);
+    if (!file.is_open()) { throw std::runtime_error("Could not open SigMF metadata"); }
+    nlohmann::json meta;
+    try {
+        meta = nlohmann::json::parse(file);
+    }
+    catch (...) {
+        throw std::runtime_error("Invalid SigMF metadata");
+    }
+    if (!meta.contains("global") || !meta["global"].contains("core:datatype") || !meta["global"].contains("core:sample_rate")) {
+        throw std::runtime_error("SigMF metadata has no datatype or samplerate");
+    }
+    nlohmann::json global = meta["global"];
+    if (global.contains("core:num_channels") && global["core:num_channels"] != 1) {
+        throw std::runtime_error("Multichannel SigMF recordings are not supported");
+    }
+
+    // Datatypes are a complex/real prefix, the sample format and an endianness suffix for multibyte samples
+    std::string datatype = global["core:datatype"];
+    if (datatype.size() > 3 && datatype.substr(datatype.size() - 3) == "_be") {
+        throw std::runtime_error("Big endian SigMF recordings are not supported");
+    }
+    if (datatype.size() > 3 && datatype.substr(datatype.size() - 3) == "_le") { datatype = datatype.substr(0, datatype.size() - 3); }
+    if (datatype == "cu8") { sampleType = IQ_SAMPLE_TYPE_UINT8; }
+    else if (datatype == "ci8") { sampleType = IQ_SAMPLE_TYPE_INT8; }
+    else if (datatype == "ci16") { sampleType = IQ_SAMPLE_TYPE_INT16; }
+    else if (datatype == "ci32") { sampleType = IQ_SAMPLE_TYPE_INT32; }
+    else if (datatype == "cf32") { sampleType = IQ_SAMPLE_TYPE_FLOAT32; }
+    else { throw std::runtime_error("Unsupported SigMF datatype"); }
+
+    switch (sampleType) {
+    case IQ_SAMPLE_TYPE_UINT8:
+    case IQ_SAMPLE_TYPE_INT8:
+        frameSize = 2;
+        break;
+    case IQ_SAMPLE_TYPE_INT16:
+        frameSize = 4;
+        break;
+    default:
+        frameSize = 8;
+        break;
+    }
+
+    sampleRate = global["core:sample_rate"];
+    if (sampleRate <= 0) { throw std::runtime_error("SigMF recording has an invalid samplerate"); }
+    u8Offset = U8_IQ_DEFAULT_OFFSET;
+    data = mapBase;
+    sampleCount = mapSize / frameSize;
+
+    // Captures give the frequency and time of each segment of the recording
+    if (meta.contains("captures")) {
+        for (const auto& c : meta["captures"]) {
+            if (c.contains("core:header_bytes") && c["core:header_bytes"] != 0) {
+                throw std::runtime_error("SigMF captures with header bytes are not supported");
+            }
+            IQCapture cap;
+            cap.start = c.contains("core:sample_start") ? (uint64_t)c["core:sample_start"] : 0;
+            cap.frequency = c.contains("core:frequency") ? (double)c["core:frequency"] : 0.0;
+            cap.time = -1;
+            if (c.contains("core:datetime") && !sigmf::parseTime(c["core:datetime"], cap.time)) { cap.time = -1; }
+            captures.push_back(cap);
+        }
+        std::stable_sort(captures.begin(), captures.end(), [](const IQCapture& a, const IQCapture& b) { return a.start < b.start; });
+    }
+}
+
+void IQFileReader::setSampleType(uint16_t format, uint16_t bitDepth) {
+    if (format == WAVE_FORMAT_IEEE_FLOAT && bitDepth == 32) {
+        sampleType = IQ_SAMPLE_TYPE_FLOAT32;
+    }
+    else if (format == WAVE_FORMAT_PCM && bitDepth == 8) {
+        sampleType = IQ_SAMPLE_TYPE_UINT8;
+    }
+    else if (format == WAVE_FORMAT_PCM && bitDepth == 16) {
+        sampleType = IQ_SAMPLE_TYPE_INT16;
+    }
+    else if (format == WAVE_FORMAT_PCM && bitDepth == 32) {
+        sampleType = float32Pcm ? IQ_SAMPLE_TYPE_FLOAT32 : IQ_SAMPLE_TYPE_INT32;
+    }
+    else {
+        throw std::runtime_error("Unsupported WAV sample format");
+    }
+    frameSize = (bitDepth / 8) * 2;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <dsp/types.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+enum IQSampleType {
+    IQ_SAMPLE_TYPE_UINT8,
+    IQ_SAMPLE_TYPE_INT8,
+    IQ_SAMPLE_TYPE_INT16,
+    IQ_SAMPLE_TYPE_INT32,
+    IQ_SAMPLE_TYPE_FLOAT32
+};
+
+// Segment of a recording tuned to one frequency, as described by SigMF captures
+struct IQCapture {
+    uint64_t start;
+    double frequency;
+    int64_t time;   // ns since the unix epoch, negative if unknown
+};
+
+// Memory mapped reader for IQ recordings. Understands RIFF/WAVE (PCM, float and
+// WAVE_FORMAT_EXTENSIBLE), RF64, SigMF and headerless raw files (.cu8, .cs8, .cs16, .cf32)
+class IQFileReader {
+public:
+    // Throws std::runtime_error if the file cannot be mapped or parsed. rawSampleRate is used
+    // for headerless files, float32Pcm interprets 32bit integer PCM as float (old SDR++ recordings)
+    IQFileReader(std::string path, double rawSampleRate, bool float32Pcm = false);
+    ~IQFileReader();
+
+    // Convert up to count samples starting at the current position, returns the number of samples read
+    int read(dsp::complex_t* out, int count);
+
+    void seek(uint64_t sample);
+    uint64_t getPosition();
+    uint64_t getSampleCount();
+    double getSampleRate();
+    IQSampleType getSampleType();
+    bool isRaw();
+
+    // Frequency and time of a sample, only known if the file has capture metadata
+    bool hasCaptures();
+    double getFrequency(uint64_t sample);
+    int64_t getTime(uint64_t sample);
+
+    // First sample after the capture that contains the given one
+    uint64_t getCaptureEnd(uint64_t sample);
+
+private:
+    void map(std::string path);
+    void unmap();
+    void parseWav();
+    void parseRaw(std::string path, double rawSampleRate);
+    void parseSigMF(std::string metaPath);
+    const IQCapture* findCapture(uint64_t sample);
+    void setSampleType(uint16_t format, uint16_t bitDepth);
+
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mapHandle = NULL;
+#else
+    int fd = -1;
+#endif
+    const uint8_t* mapBase = NULL;
+    uint64_t mapSize = 0;
+
+    const uint8_t* data = NULL;
+    uint64_t sampleCount = 0;
+    uint64_t position = 0;
+    int frameSize = 0;
+    double sampleRate = 0;
+    IQSampleType sampleType = IQ_SAMPLE_TYPE_INT16;
+    bool raw = false;
+    float u8Offset = 128.0f;
+    std::vector<IQCapture> captures;
+    bool float32Pcm = false;
+};
@@ -2,21 +2,28 @@
 #include <utils/flog.h>
 #include <module.h>
 #include <gui/gui.h>
+#include <gui/style.h>
 #include <signal_path/signal_path.h>
-#include <wavreader.h>
+#include "iq_file_reader.h"
 #include <core.h>
+#include <batch.h>
 #include <gui/widgets/file_select.h>
 #include <filesystem>
 #include <regex>
 #include <gui/tuner.h>
+#include <atomic>
+#include <chrono>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
+// If playback falls further behind the wall clock than this, the pacing is re-anchored instead of bursting to catch up
+#define MAX_PACING_LAG  std::chrono::milliseconds(100)
+
 SDRPP_MOD_INFO{
     /* Name:            */ "file_source",
-    /* Description:     */ "Wav file source module for SDR++",
+    /* Description:     */ "Wav, SigMF and raw IQ file source module for SDR++",
     /* Author:          */ "Ryzerth",
-    /* Version:         */ 0, 1, 1,
+    /* Version:         */ 0, 2, 0,
     /* Max instances    */ 1
 };
 
@@ -24,13 +31,17 @@ ConfigManager config;
 
 class FileSourceModule : public ModuleManager::Instance {
 public:
-    FileSourceModule(std::string name) : fileSelect("", { "Wav IQ Files (*.wav)", "*.wav", "All Files", "*" }) {
+    FileSourceModule(std::string name) : fileSelect("", { "IQ Files (*.wav *.sigmf-meta *.cu8 *.cs8 *.cs16 *.cf32)", "*.wav *.sigmf-meta *.sigmf-data *.cu8 *.cs8 *.cs16 *.cf32", "Wav IQ Files (*.wav)", "*.wav", "SigMF Recordings (*.sigmf-meta)", "*.sigmf-meta", "All Files", "*" }) {
         this->name = name;
 
         if (core::args["server"].b()) { return; }
 
         config.acquire();
         fileSelect.setPath(config.conf["path"], true);
+        if (config.conf.contains("rawSampleRate")) { rawSampleRate = config.conf["rawSampleRate"]; }
+        if (config.conf.contains("loop")) { loop = config.conf["loop"]; }
+        if (config.conf.contains("fastMode")) { fastMode = config.conf["fastMode"]; }
+        if (config.conf.contains("float32Mode")) { float32Mode = config.conf["float32Mode"]; }
         config.release();
 
         handler.ctx = this;
@@ -42,11 +53,22 @@ public:
         handler.tuneHandler = tune;
         handler.stream = &stream;
         sigpath::sourceManager.registerSource("File", &handler);
+
+        // In batch mode the file comes from the command line and is played once, as fast as possible
+        std::string batchPath = core::args["batch"].s();
+        if (!batchPath.empty()) {
+            batchMode = true;
+            fastMode = true;
+            loop = false;
+            fileSelect.setPath(batchPath);
+            openFile();
+        }
     }
 
     ~FileSourceModule() {
         stop(this);
         sigpath::sourceManager.unregisterSource("File");
+        if (reader) { delete reader; }
     }
 
     void postInit() {}
@@ -67,6 +89,14 @@ private:
     static void menuSelected(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
         core::setInputSampleRate(_this->sampleRate);
+
+        // As a secondary source only its own front end follows the file, which is never buffered. The main
+        // source, its buffering and the waterfall are left alone.
+        if (sigpath::sourceManager.setSecondaryFrequency("File", _this->centerFreq)) {
+            flog::info("FileSourceModule '{0}': Menu Select as secondary!", _this->name);
+            return;
+        }
+        _this->selected = true;
         tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", _this->centerFreq);
         sigpath::iqFrontEnd.setBuffering(false);
         gui::waterfall.centerFrequencyLocked = true;
@@ -78,18 +108,32 @@ private:
 
     static void menuDeselected(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
-        sigpath::iqFrontEnd.setBuffering(true);
-        //gui::freqSelect.limitFreq = false;
-        gui::waterfall.centerFrequencyLocked = false;
+        if (!sigpath::sourceManager.isSecondary("File")) {
+            _this->selected = false;
+            sigpath::iqFrontEnd.setBuffering(true);
+            //gui::freqSelect.limitFreq = false;
+            gui::waterfall.centerFrequencyLocked = false;
+        }
         flog::info("FileSourceModule '{0}': Menu Deselect!", _this->name);
     }
 
     static void start(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
+        // A worker that reached the end of the file is done, play it again from the start
+        if (_this->running && _this->ended) {
+            _this->workerThread.join();
+            _this->running = false;
+            if (_this->seekRequest < 0) { _this->seekRequest = 0; }
+        }
         if (_this->running) { return; }
-        if (_this->reader == NULL) { return; }
+        if (_this->reader == NULL) {
+            // Don't leave batch mode waiting for an input that will never come
+            if (_this->batchMode) { batch::inputEnded(0); }
+            return;
+        }
         _this->running = true;
-        _this->workerThread = _this->float32Mode ? std::thread(floatWorker, _this) : std::thread(worker, _this);
+        _this->ended = false;
+        _this->workerThread = std::thread(&FileSourceModule::worker, _this);
         flog::info("FileSourceModule '{0}': Start!", _this->name);
     }
 
@@ -101,7 +145,6 @@ private:
         _this->workerThread.join();
         _this->stream.clearWriteStop();
         _this->running = false;
-        _this->reader->rewind();
         flog::info("FileSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -112,63 +155,216 @@ private:
 
     static void menuHandler(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
+        float menuWidth = ImGui::GetContentRegionAvail().x;
 
         if (_this->fileSelect.render("##file_source_" + _this->name)) {
             if (_this->fileSelect.pathIsValid()) {
-                if (_this->reader != NULL) {
-                    _this->reader->close();
-                    delete _this->reader;
-                }
-                try {
-                    _this->reader = new WavReader(_this->fileSelect.path);
-                    _this->sampleRate = _this->reader->getSampleRate();
-                    core::setInputSampleRate(_this->sampleRate);
-                    std::string filename = std::filesystem::path(_this->fileSelect.path).filename().string();
-                    _this->centerFreq = _this->getFrequency(filename);
-                    tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", _this->centerFreq);
-                    //gui::freqSelect.minFreq = _this->centerFreq - (_this->sampleRate/2);
-                    //gui::freqSelect.maxFreq = _this->centerFreq + (_this->sampleRate/2);
-                    //gui::freqSelect.limitFreq = true;
-                }
-                catch (std::exception e) {
-                    flog::error("Error: {0}", e.what());
-                }
+                _this->openFile();
                 config.acquire();
                 config.conf["path"] = _this->fileSelect.path;
                 config.release(true);
             }
         }
 
-        ImGui::Checkbox("Float32 Mode##_file_source", &_this->float32Mode);
+        if (_this->reader && _this->reader->isRaw()) {
+            ImGui::LeftLabel("Raw Samplerate");
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::InputDouble(CONCAT("##_file_source_raw_sr_", _this->name), &_this->rawSampleRate, 0, 0, "%.0f", ImGuiInputTextFlags_EnterReturnsTrue)) {
+                _this->openFile();
+                config.acquire();
+                config.conf["rawSampleRate"] = _this->rawSampleRate;
+                config.release(true);
+            }
+        }
+
+        if (_this->reader) {
+            // Seeking is done by the worker, the slider shows the pending position until it is applied
+            double sampleRate = _this->reader->getSampleRate();
+            int64_t pending = _this->seekRequest;
+            uint64_t pos = (pending >= 0) ? pending : _this->playPosition.load();
+            float posSec = (double)pos / sampleRate;
+            float lenSec = (double)_this->reader->getSampleCount() / sampleRate;
+            std::string timeStr = formatTime(posSec) + " / " + formatTime(lenSec);
+            ImGui::SetNextItemWidth(menuWidth);
+            if (ImGui::SliderFloat(CONCAT("##_file_source_seek_", _this->name), &posSec, 0, lenSec, timeStr.c_str())) {
+                _this->seekRequest = std::clamp<double>(posSec, 0, lenSec) * sampleRate;
+            }
+        }
+
+        if (ImGui::Checkbox(CONCAT("Loop##_file_source_loop_", _this->name), &_this->loop)) {
+            config.acquire();
+            config.conf["loop"] = _this->loop;
+            config.release(true);
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox(CONCAT("Fast##_file_source_fast_", _this->name), &_this->fastMode)) {
+            config.acquire();
+            config.conf["fastMode"] = _this->fastMode;
+            config.release(true);
+        }
+        if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Read the file as fast as the DSP can process it instead of in real time"); }
+        ImGui::SameLine();
+        if (ImGui::Checkbox(CONCAT("Float32 Mode##_file_source_f32_", _this->name), &_this->float32Mode)) {
+            _this->openFile();
+            config.acquire();
+            config.conf["float32Mode"] = _this->float32Mode;
+            config.release(true);
+        }
+        if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Interpret 32bit integer WAV files as float (older SDR++ recordings)"); }
     }
 
-    static void worker(void* ctx) {
-        FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = _this->reader->getSampleRate();
-        int blockSize = sampleRate / 200.0f;
-        int16_t* inBuf = new int16_t[blockSize * 2];
+    void openFile() {
+        if (!fileSelect.pathIsValid()) { return; }
 
-        while (true) {
-            _this->reader->readSamples(inBuf, blockSize * 2 * sizeof(int16_t));
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, inBuf, 32768.0f, blockSize * 2);
-            if (!_this->stream.swap(blockSize)) { break; };
+        // The worker must not touch the old reader while it's being replaced
+        bool wasRunning = running;
+        if (wasRunning) { stop(this); }
+        if (reader) {
+            delete reader;
+            reader = NULL;
         }
 
-        delete[] inBuf;
+        try {
+            reader = new IQFileReader(fileSelect.path, rawSampleRate, float32Mode);
+        }
+        catch (const std::exception& e) {
+            flog::error("FileSourceModule '{0}': Could not open '{1}': {2}", name, fileSelect.path, e.what());
+            return;
+        }
+
+        seekRequest = -1;
+        playPosition = 0;
+        sampleRate = reader->getSampleRate();
+        core::setInputSampleRate(sampleRate);
+        // Recordings with metadata know their frequency, otherwise it can only be guessed from the name
+        std::string filename = std::filesystem::path(fileSelect.path).filename().string();
+        centerFreq = reader->hasCaptures() ? reader->getFrequency(0) : getFrequency(filename);
+        tuneGen++;
+        if (!sigpath::sourceManager.setSecondaryFrequency("File", centerFreq)) {
+            tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", centerFreq);
+        }
+        //gui::freqSelect.minFreq = centerFreq - (sampleRate/2);
+        //gui::freqSelect.maxFreq = centerFreq + (sampleRate/2);
+        //gui::freqSelect.limitFreq = true;
+
+        if (wasRunning) { start(this); }
     }
 
-    static void floatWorker(void* ctx) {
-        FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = _this->reader->getSampleRate();
-        int blockSize = sampleRate / 200.0f;
-        dsp::complex_t* inBuf = new dsp::complex_t[blockSize];
+    void worker() {
+        int blockSize = std::clamp<int>(sampleRate / 200.0, 1, STREAM_BUFFER_SIZE);
+        auto anchor = std::chrono::steady_clock::now();
+        uint64_t sentSinceAnchor = 0;
+        uint64_t totalSent = 0;
+
+        uint32_t epoch = 0;
 
         while (true) {
-            _this->reader->readSamples(_this->stream.writeBuf, blockSize * sizeof(dsp::complex_t));
-            if (!_this->stream.swap(blockSize)) { break; };
+            int64_t seek = seekRequest.exchange(-1);
+            if (seek >= 0) {
+                reader->seek(seek);
+                anchor = std::chrono::steady_clock::now();
+                sentSinceAnchor = 0;
+                epoch++;
+            }
+
+            // Rewind here rather than after a short read so that a block never spans two captures
+            if (loop && reader->hasCaptures() && reader->getPosition() >= reader->getSampleCount()) {
+                reader->seek(0);
+                epoch++;
+            }
+
+            // Blocks never span two captures so that the retune lands on the exact sample
+            uint64_t start = reader->getPosition();
+            int wanted = blockSize;
+            if (reader->hasCaptures()) {
+                wanted = std::clamp<uint64_t>(reader->getCaptureEnd(start) - start, 1, blockSize);
+                double freq = reader->getFrequency(start);
+                if (freq != centerFreq) {
+                    centerFreq = freq;
+
+                    // Tuning touches the waterfall, leave it to the GUI thread. The block's metadata already
+                    // carries the new frequency, which is all batch mode needs.
+                    // Retunes posted before the file was replaced are stale and skipped. A secondary source
+                    // only updates its own front end, which can be done from here.
+                    if (!sigpath::sourceManager.setSecondaryFrequency("File", freq) && !batchMode) {
+                        uint32_t gen = tuneGen;
+                        gui::mainWindow.postTask([=]() {
+                            if (gen != tuneGen) { return; }
+                            tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", freq);
+                        });
+                    }
+                }
+            }
+
+            int count = reader->read(stream.writeBuf, wanted);
+            if (count < wanted && loop) {
+                reader->seek(0);
+                epoch++;
+                count += reader->read(&stream.writeBuf[count], wanted - count);
+            }
+            if (!count) { break; }
+            playPosition = reader->getPosition();
+
+            // Describe the samples with the recording's own metadata instead of the host clock
+            if (reader->hasCaptures()) {
+                dsp::StreamMeta& meta = stream.writeMeta;
+                int64_t time = reader->getTime(start);
+                meta.valid = true;
+                meta.hardwareTime = (time >= 0);
+                meta.epoch = epoch;
+                meta.sampleIndex = start;
+                meta.time = (time >= 0) ? time : std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                meta.frequency = reader->getFrequency(start);
+                meta.sampleRate = sampleRate;
+            }
+            if (!stream.swap(count)) { return; }
+            totalSent += count;
+
+            if (fastMode) { continue; }
+
+            // Pace against the wall clock using the total sent since the last anchor so that
+            // the scheduler's sleep granularity doesn't accumulate into a drift
+            sentSinceAnchor += count;
+            auto target = anchor + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((double)sentSinceAnchor / sampleRate));
+            auto now = std::chrono::steady_clock::now();
+            if (now - target > MAX_PACING_LAG) {
+                anchor = now;
+                sentSinceAnchor = 0;
+            }
+            else {
+                std::this_thread::sleep_until(target);
+            }
         }
 
-        delete[] inBuf;
+        ended = true;
+        if (batchMode) {
+            batch::inputEnded(totalSent);
+            return;
+        }
+
+        // Stop playback so that the play button shows it and pressing it again restarts the file
+        uint32_t gen = tuneGen;
+        gui::mainWindow.postTask([=]() {
+            if (gen != tuneGen || !ended) { return; }
+            if (sigpath::sourceManager.isSecondaryRunning("File")) {
+                sigpath::sourceManager.stopSecondary("File");
+            }
+            else if (selected) {
+                gui::mainWindow.setPlayState(false);
+            }
+        });
+    }
+
+    static std::string formatTime(double seconds) {
+        int total = seconds;
+        char buf[32];
+        if (total >= 3600) {
+            sprintf(buf, "%d:%02d:%02d", total / 3600, (total / 60) % 60, total % 60);
+        }
+        else {
+            sprintf(buf, "%02d:%02d", total / 60, total % 60);
+        }
+        return buf;
     }
 
     double getFrequency(std::string filename) {
@@ -184,20 +380,34 @@ private:
     std::string name;
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
-    WavReader* reader = NULL;
+    IQFileReader* reader = NULL;
     bool running = false;
+    std::atomic<bool> ended = false;
+    bool selected = false;
     bool enabled = true;
-    float sampleRate = 1000000;
+    double sampleRate = 1000000;
     std::thread workerThread;
 
     double centerFreq = 100000000;
+    std::atomic<uint32_t> tuneGen = 0;
 
+    double rawSampleRate = 2400000;
+    bool loop = true;
+    bool fastMode = false;
     bool float32Mode = false;
+    bool batchMode = false;
+
+    std::atomic<int64_t> seekRequest = -1;
+    std::atomic<uint64_t> playPosition = 0;
 };
 
 MOD_EXPORT void _INIT_() {
     json def = json({});
     def["path"] = "";
+    def["rawSampleRate"] = 2400000.0;
+    def["loop"] = true;
+    def["fastMode"] = false;
+    def["float32Mode"] = false;
     config.setPath(core::args["root"].s() + "/file_source_config.json");
     config.load(def);
     config.enableAutoSave();
@@ -2,6 +2,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <signal_path/source_ring.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
@@ -97,6 +98,8 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
+        ring.init(name, &stream, &stats);
 
         refresh();
 
@@ -263,6 +266,7 @@ private:
         hackrf_set_lna_gain(_this->openDev, _this->lna);
         hackrf_set_vga_gain(_this->openDev, _this->vga);
 
+        _this->ring.start(_this->sampleRate, _this->freq);
         hackrf_start_rx(_this->openDev, callback, _this);
 
         _this->running = true;
@@ -273,13 +277,12 @@ private:
         HackRFSourceModule* _this = (HackRFSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
-        _this->stream.stopWriter();
         // TODO: Stream stop
         hackrf_error err = (hackrf_error)hackrf_close(_this->openDev);
         if (err != HACKRF_SUCCESS) {
             flog::error("Could not close HackRF {0}: {1}", _this->selectedSerial, hackrf_error_name(err));
         }
-        _this->stream.clearWriteStop();
+        _this->ring.stop();
         flog::info("HackRFSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -289,6 +292,7 @@ private:
             hackrf_set_freq(_this->openDev, freq);
         }
         _this->freq = freq;
+        _this->ring.setFrequency(freq);
         flog::info("HackRFSourceModule '{0}': Tune: {1}!", _this->name, freq);
     }
 
@@ -378,8 +382,16 @@ private:
 
     static int callback(hackrf_transfer* transfer) {
         HackRFSourceModule* _this = (HackRFSourceModule*)transfer->rx_ctx;
-        volk_8i_s32f_convert_32f((float*)_this->stream.writeBuf, (int8_t*)transfer->buffer, 128.0f, transfer->valid_length);
-        if (!_this->stream.swap(transfer->valid_length / 2)) { return -1; }
+        _this->ring.write(transfer->valid_length / 2, [transfer](dsp::complex_t* dst, int offset, int n) {
+            volk_8i_s32f_convert_32f((float*)dst, (int8_t*)&transfer->buffer[offset * 2], 128.0f, n * 2);
+        });
+
+        // A short transfer means the device or libhackrf couldn't keep up
+        if (transfer->valid_length < transfer->buffer_length) {
+            int lost = (transfer->buffer_length - transfer->valid_length) / 2;
+            _this->stats.addDropped(lost);
+            _this->ring.skip(lost);
+        }
         return 0;
     }
 
@@ -389,6 +401,8 @@ private:
     dsp::stream<dsp::complex_t> stream;
     int sampleRate;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
+    SourceRing ring;
     bool running = false;
     double freq;
     std::string selectedSerial = "";
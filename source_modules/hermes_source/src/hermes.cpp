@@ -1,5 +1,6 @@
 #include "hermes.h"
 #include <utils/flog.h>
+#include <algorithm>
 
 namespace hermes {
     Client::Client(std::shared_ptr<net::Socket> sock) {
@@ -13,12 +14,25 @@ namespace hermes {
         sock->close();
 
         // Wait for worker to exit
-        out.stopWriter();
+        for (auto& rx : rxs) {
+            if (rx.out) { rx.out->stopWriter(); }
+        }
         if (workerThread.joinable()) { workerThread.join(); }
-        out.clearWriteStop();
+        for (auto& rx : rxs) {
+            if (rx.out) { rx.out->clearWriteStop(); }
+        }
     }
 
     void Client::start() {
+        {
+            std::lock_guard<std::mutex> lck(outMtx);
+            rxSeqValid = false;
+            for (auto& rx : rxs) {
+                rx.fill = 0;
+                rx.clock.reset(sampleRate);
+            }
+        }
+
         // Start metis stream
         for (int i = 0; i < HERMES_METIS_REPEAT; i++) {
             sendMetisControl((MetisControl)(METIS_CTRL_IQ | METIS_CTRL_NO_WD));
@@ -32,15 +46,52 @@ namespace hermes {
     }
 
     void Client::setSamplerate(HermesLiteSamplerate samplerate) {
-        writeReg(0, (uint32_t)samplerate << 24);
+        srCode = samplerate;
+        writeConfig();
+        std::lock_guard<std::mutex> lck(outMtx);
+        sampleRate = 48000.0 * (double)(1 << samplerate);
+        for (auto& rx : rxs) { rx.clock.reset(sampleRate); }
+    }
+
+    void Client::setReceiverCount(int count) {
+        {
+            std::lock_guard<std::mutex> lck(outMtx);
+            rxCount = std::clamp<int>(count, 1, HERMES_MAX_RX);
+        }
+        writeConfig();
     }
 
     void Client::setFrequency(double freq) {
-        this->freq = freq;
+        setRxFrequency(0, freq);
+    }
+
+    void Client::setRxFrequency(int rx, double freq) {
+        if (rx < 0 || rx >= HERMES_MAX_RX) { return; }
+        rxs[rx].freq = freq;
+        rxs[rx].clock.setFrequency(freq);
+        writeReg(HL_REG_RX1_NCO_FREQ + rx, freq);
+        if (rx) { return; }
         writeReg(HL_REG_TX1_NCO_FREQ, freq);
         autoFilters(freq);
     }
 
+    void Client::setOutput(int rx, dsp::stream<dsp::complex_t>* out, SourceStats* stats) {
+        if (rx < 0 || rx >= HERMES_MAX_RX) { return; }
+
+        // Abort any swap the worker is blocked on for the old stream, once the receiver's swap lock is
+        // taken the worker can't start a new one on it
+        dsp::stream<dsp::complex_t>* old = rxs[rx].out;
+        if (old) { old->stopWriter(); }
+        std::lock_guard<std::mutex> slck(rxs[rx].swapMtx);
+        std::lock_guard<std::mutex> lck(outMtx);
+        if (old) { old->clearWriteStop(); }
+
+        rxs[rx].out = out;
+        rxs[rx].stats = stats;
+        rxs[rx].fill = 0;
+        rxs[rx].clock.reset(sampleRate);
+    }
+
     void Client::setGain(int gain) {
         writeReg(HL_REG_RX_LNA, gain | (1 << 6));
     }
@@ -154,6 +205,46 @@ namespace hermes {
 #endif
     }
 
+    void Client::writeConfig() {
+        // Duplex lets each receiver use its own NCO instead of following the TX frequency
+        uint32_t conf = (uint32_t)srCode << 24;
+        conf |= METIS_CONF_DUPLEX;
+        conf |= (uint32_t)(rxCount - 1) << METIS_CONF_RX_COUNT_POS;
+        writeReg(0, conf);
+    }
+
+    void Client::pushBlock(Receiver& rx, std::unique_lock<std::mutex>& lck) {
+        if (!rx.out || !rx.fill) { return; }
+        dsp::stream<dsp::complex_t>* out = rx.out;
+        SourceStats* stats = rx.stats;
+        int count = rx.fill;
+        out->writeMeta = rx.clock.stamp(count);
+        rx.fill = 0;
+
+        // Release the controls while waiting for the DSP, the block is dropped if the output changed meanwhile
+        lck.unlock();
+        {
+            std::lock_guard<std::mutex> slck(rx.swapMtx);
+            if (rx.out == out) {
+                if (stats) { stats->swap(out, count); }
+                else { out->swap(count); }
+            }
+        }
+        lck.lock();
+    }
+
+    void Client::skip(int count, std::unique_lock<std::mutex>& lck) {
+        for (int i = 0; i < rxCount; i++) {
+            Receiver& rx = rxs[i];
+            if (!rx.out) { continue; }
+
+            // Push what was received before the gap so that the indices of the next block stay exact
+            pushBlock(rx, lck);
+            rx.clock.skip(count);
+            if (rx.stats) { rx.stats->addDropped(count); }
+        }
+    }
+
     void Client::worker() {
         uint8_t rbuf[2048];
         MetisUSBPacket* pkt = (MetisUSBPacket*)rbuf;
@@ -167,6 +258,22 @@ namespace hermes {
                 continue;
             }
 
+            std::unique_lock<std::mutex> lck(outMtx);
+
+            // Each sample slot holds the IQ of every receiver followed by a mic sample
+            int count = rxCount;
+            int slotSize = (count * 6) + 2;
+            int frameSamples = HERMES_FRAME_IQ_BYTES / slotSize;
+            int blockSize = std::max<int>(sampleRate * HERMES_BLOCK_DURATION, frameSamples);
+
+            // Skip the indices of the samples carried by lost packets
+            uint32_t seq = htonl(pkt->seq);
+            if (rxSeqValid && (int32_t)(seq - rxSeq - 1) > 0) {
+                skip((seq - rxSeq - 1) * 2 * frameSamples, lck);
+            }
+            rxSeq = seq;
+            rxSeqValid = true;
+
             // Parse frames
             for (int frn = 0; frn < 2; frn++) {
                 uint8_t* frame = pkt->frame[frn];
@@ -174,6 +281,7 @@ namespace hermes {
 
                 // Make sure this is a valid frame by checking the sync
                 if (hdr->sync[0] != 0x7F || hdr->sync[1] != 0x7F || hdr->sync[2] != 0x7F) {
+                    skip(frameSamples, lck);
                     continue;
                 }
 
@@ -183,24 +291,30 @@ namespace hermes {
                     flog::warn("Got response! Reg={0}, Seq={1}", reg, (uint32_t)htonl(pkt->seq));
                 }
 
-                // Decode and send IQ to stream
-                uint8_t* iq = &frame[8];
-                for (int i = 0; i < 63; i++) {
-                    // Convert to 32bit
-                    int32_t si = ((uint32_t)iq[(i*8) + 0] << 16) | ((uint32_t)iq[(i*8) + 1] << 8) | (uint32_t)iq[(i*8) + 2];
-                    int32_t sq = ((uint32_t)iq[(i*8) + 3] << 16) | ((uint32_t)iq[(i*8) + 4] << 8) | (uint32_t)iq[(i*8) + 5];
-                    
-                    // Sign extend
-                    si = (si << 8) >> 8;
-                    sq = (sq << 8) >> 8;
-
-                    // Convert to float (IQ swapped for some reason)
-                    out.writeBuf[i].im = (float)si / (float)0x1000000;
-                    out.writeBuf[i].re = (float)sq / (float)0x1000000;
+                // Decode the IQ of each receiver straight into the write buffer of its stream
+                for (int r = 0; r < count; r++) {
+                    Receiver& rx = rxs[r];
+                    if (!rx.out) { continue; }
+                    uint8_t* iq = &frame[8 + (r * 6)];
+                    dsp::complex_t* out = &rx.out->writeBuf[rx.fill];
+                    for (int i = 0; i < frameSamples; i++) {
+                        // Convert to 32bit
+                        uint8_t* s = &iq[i * slotSize];
+                        int32_t si = ((uint32_t)s[0] << 16) | ((uint32_t)s[1] << 8) | (uint32_t)s[2];
+                        int32_t sq = ((uint32_t)s[3] << 16) | ((uint32_t)s[4] << 8) | (uint32_t)s[5];
+
+                        // Sign extend
+                        si = (si << 8) >> 8;
+                        sq = (sq << 8) >> 8;
+
+                        // Convert to float (IQ swapped for some reason)
+                        out[i].im = (float)si / (float)0x1000000;
+                        out[i].re = (float)sq / (float)0x1000000;
+                    }
+                    rx.fill += frameSamples;
+                    if (rx.fill >= blockSize) { pushBlock(rx, lck); }
                 }
-                out.swap(63);
-                // TODO: Buffer the data to avoid having a very high DSP frame rate
-            }            
+            }
         }
     }
 
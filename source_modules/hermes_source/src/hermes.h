@@ -2,7 +2,9 @@
 #include <utils/net.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_stats.h>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <thread>
@@ -12,6 +14,10 @@
 #define HERMES_METIS_SIGNATURE  0xEFFE
 #define HERMES_HPSDR_USB_SYNC   0x7F
 #define HERMES_I2C_DELAY        50
+#define HERMES_FRAME_IQ_BYTES   504
+#define HERMES_MAX_RX           4
+// Samples are accumulated into blocks of this duration instead of being pushed one USB frame at a time
+#define HERMES_BLOCK_DURATION   0.005
 
 namespace hermes {
     enum MetisPacketType {
@@ -20,6 +26,11 @@ namespace hermes {
         METIS_PKT_CONTROL   = 0x04
     };
 
+    enum MetisConfig {
+        METIS_CONF_DUPLEX       = (1 << 2),
+        METIS_CONF_RX_COUNT_POS = 3
+    };
+
     enum MetisControl {
         METIS_CTRL_NONE     = 0,
         METIS_CTRL_IQ       = (1 << 0),
@@ -138,7 +149,15 @@ namespace hermes {
         void setGain(int gain);
         void autoFilters(double freq);
 
-        dsp::stream<dsp::complex_t> out;
+        // Number of hardware receivers (DDCs) streamed by the radio, only change it while stopped
+        void setReceiverCount(int count);
+
+        // Tune a receiver, receiver 0 also drives the TX NCO and the filters
+        void setRxFrequency(int rx, double freq);
+
+        // Samples of the receiver are decoded straight into the stream, NULL to stop decoding them.
+        // Any swap the worker is blocked on for the previous stream is aborted.
+        void setOutput(int rx, dsp::stream<dsp::complex_t>* out, SourceStats* stats = NULL);
 
     //private:
         void sendMetisUSB(uint8_t endpoint, void* frame0, void* frame1 = NULL);
@@ -149,11 +168,38 @@ namespace hermes {
 
         void writeI2C(I2CPort port, uint8_t addr, uint8_t reg, uint8_t data);
 
-        
+        void writeConfig();
 
         void worker();
 
-        double freq = 0;
+        struct Receiver {
+            dsp::stream<dsp::complex_t>* out = NULL;
+            SourceStats* stats = NULL;
+            double freq = 0;
+
+            // Samples already decoded into the write buffer of the stream
+            int fill = 0;
+
+            // Metadata of the received buffers, the packet sequence numbers are used to account for lost samples
+            dsp::StreamClock clock;
+
+            // Held by the worker while it swaps the stream, outMtx is released meanwhile
+            std::mutex swapMtx;
+        };
+
+        // Push the samples accumulated so far, the lock on outMtx is released during the swap
+        void pushBlock(Receiver& rx, std::unique_lock<std::mutex>& lck);
+
+        // Account for samples that were never received
+        void skip(int count, std::unique_lock<std::mutex>& lck);
+
+        Receiver rxs[HERMES_MAX_RX];
+        std::mutex outMtx;
+        HermesLiteSamplerate srCode = HL_SAMP_RATE_48KHZ;
+        int rxCount = 1;
+        double sampleRate = 48000.0;
+        uint32_t rxSeq = 0;
+        bool rxSeqValid = false;
 
         std::thread workerThread;
         std::shared_ptr<net::Socket> sock;
@@ -8,7 +8,6 @@
 #include <config.h>
 #include <gui/smgui.h>
 #include <gui/widgets/stepped_slider.h>
-#include <dsp/routing/stream_link.h>
 #include <utils/optionlist.h>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
@@ -36,25 +35,40 @@ public:
 
         srId = samplerates.keyId(384000);
 
-        lnk.init(NULL, &stream);
-
         sampleRate = 384000.0;
 
-        handler.ctx = this;
-        handler.selectHandler = menuSelected;
-        handler.deselectHandler = menuDeselected;
-        handler.menuHandler = menuHandler;
-        handler.startHandler = start;
-        handler.stopHandler = stop;
-        handler.tuneHandler = tune;
-        handler.stream = &stream;
+        // Each hardware receiver is a source of its own, the first one keeps the name of the module's only source
+        for (int i = 0; i < HERMES_MAX_RX; i++) {
+            Receiver& rx = receivers[i];
+            rx.module = this;
+            rx.id = i;
+            rx.name = i ? ("Hermes RX" + std::to_string(i + 1)) : "Hermes";
+            rx.handler.ctx = &rx;
+            rx.handler.selectHandler = menuSelected;
+            rx.handler.deselectHandler = menuDeselected;
+            rx.handler.menuHandler = menuHandler;
+            rx.handler.startHandler = start;
+            rx.handler.stopHandler = stop;
+            rx.handler.tuneHandler = tune;
+            rx.handler.stream = &rx.stream;
+            rx.handler.stats = &rx.stats;
+        }
 
-        sigpath::sourceManager.registerSource("Hermes", &handler);
+        config.acquire();
+        if (config.conf.contains("receivers")) {
+            rxCount = std::clamp<int>(config.conf["receivers"], 1, HERMES_MAX_RX);
+        }
+        config.release();
+        for (int i = 0; i < rxCount; i++) {
+            sigpath::sourceManager.registerSource(receivers[i].name, &receivers[i].handler);
+        }
     }
 
     ~HermesSourceModule() {
-        stop(this);
-        sigpath::sourceManager.unregisterSource("Hermes");
+        for (int i = 0; i < HERMES_MAX_RX; i++) { stop(&receivers[i]); }
+        for (int i = 0; i < rxCount; i++) {
+            sigpath::sourceManager.unregisterSource(receivers[i].name);
+        }
     }
 
     void postInit() {}
@@ -74,6 +88,44 @@ public:
     // TODO: Implement select functions
 
 private:
+    struct Receiver {
+        HermesSourceModule* module;
+        int id;
+        std::string name;
+        SourceManager::SourceHandler handler;
+        dsp::stream<dsp::complex_t> stream;
+        SourceStats stats;
+        double freq = 0;
+        bool running = false;
+
+        // Samplerate last announced to the front end the receiver feeds
+        double announcedSampleRate = 0;
+    };
+
+    bool anyRunning() {
+        for (int i = 0; i < rxCount; i++) {
+            if (receivers[i].running) { return true; }
+        }
+        return false;
+    }
+
+    // Register or unregister the sources of the receivers, only done while none is running
+    void setReceiverCount(int count) {
+        count = std::clamp<int>(count, 1, HERMES_MAX_RX);
+        for (int i = rxCount; i < count; i++) {
+            sigpath::sourceManager.registerSource(receivers[i].name, &receivers[i].handler);
+        }
+        for (int i = rxCount - 1; i >= count; i--) {
+            sigpath::sourceManager.unregisterSource(receivers[i].name);
+        }
+        rxCount = count;
+    }
+
+    void announceSampleRate(Receiver* rx) {
+        rx->announcedSampleRate = sampleRate;
+        core::setInputSampleRate(sampleRate, rx->name);
+    }
+
     void refresh() {
         char mac[128];
         char buf[128];
@@ -118,11 +170,11 @@ private:
 
         // Update host samplerate
         sampleRate = samplerates.key(srId);
-        core::setInputSampleRate(sampleRate);
     }
 
     static void menuSelected(void* ctx) {
-        HermesSourceModule* _this = (HermesSourceModule*)ctx;
+        Receiver* rx = (Receiver*)ctx;
+        HermesSourceModule* _this = rx->module;
 
         if (_this->firstSelect) {
             _this->firstSelect = false;
@@ -137,68 +189,86 @@ private:
             _this->selectMac(_this->selectedMac);
         }
 
-        core::setInputSampleRate(_this->sampleRate);
-        flog::info("HermesSourceModule '{0}': Menu Select!", _this->name);
+        _this->announceSampleRate(rx);
+        flog::info("HermesSourceModule '{0}': Menu Select!", rx->name);
     }
 
     static void menuDeselected(void* ctx) {
-        HermesSourceModule* _this = (HermesSourceModule*)ctx;
-        flog::info("HermesSourceModule '{0}': Menu Deselect!", _this->name);
+        Receiver* rx = (Receiver*)ctx;
+        flog::info("HermesSourceModule '{0}': Menu Deselect!", rx->name);
     }
 
     static void start(void* ctx) {
-        HermesSourceModule* _this = (HermesSourceModule*)ctx;
-        if (_this->running || _this->selectedMac.empty()) { return; }
-        
-        // TODO: Implement start
-        _this->dev = hermes::open(_this->devices[_this->devId].addr);
-
-        // TODO: STOP USING A LINK, FIND A BETTER WAY
-        _this->lnk.setInput(&_this->dev->out);
-        _this->lnk.start();
-        _this->dev->start();
-
-        // TODO: Check if the USB commands are accepted before start
-        _this->dev->setSamplerate(_this->samplerates[_this->srId]);
-        _this->dev->setFrequency(_this->freq);
-        _this->dev->setGain(_this->gain);
-
-        _this->running = true;
-        flog::info("HermesSourceModule '{0}': Start!", _this->name);
+        Receiver* rx = (Receiver*)ctx;
+        HermesSourceModule* _this = rx->module;
+        if (rx->running || _this->selectedMac.empty()) { return; }
+
+        // The samplerate is shared by all receivers and may have changed since this one was selected
+        if (rx->announcedSampleRate != _this->sampleRate) { _this->announceSampleRate(rx); }
+
+        // The radio is streaming as long as one of its receivers is running
+        if (!_this->dev) {
+            _this->dev = hermes::open(_this->devices[_this->devId].addr);
+
+            // TODO: Check if the USB commands are accepted before start
+            _this->dev->setReceiverCount(_this->rxCount);
+            _this->dev->setSamplerate(_this->samplerates[_this->srId]);
+            _this->dev->setGain(_this->gain);
+            _this->dev->start();
+        }
+
+        _this->dev->setRxFrequency(rx->id, rx->freq);
+        _this->dev->setOutput(rx->id, &rx->stream, &rx->stats);
+
+        rx->running = true;
+        flog::info("HermesSourceModule '{0}': Start!", rx->name);
     }
 
     static void stop(void* ctx) {
-        HermesSourceModule* _this = (HermesSourceModule*)ctx;
-        if (!_this->running) { return; }
-        _this->running = false;
-        
-        // TODO: Implement stop
-        _this->dev->stop();
-        _this->dev->close();
-        _this->lnk.stop();
-
-        flog::info("HermesSourceModule '{0}': Stop!", _this->name);
+        Receiver* rx = (Receiver*)ctx;
+        HermesSourceModule* _this = rx->module;
+        if (!rx->running) { return; }
+        rx->running = false;
+
+        _this->dev->setOutput(rx->id, NULL);
+
+        // Stop the radio along with its last running receiver
+        if (!_this->anyRunning()) {
+            _this->dev->stop();
+            _this->dev->close();
+            _this->dev.reset();
+        }
+
+        flog::info("HermesSourceModule '{0}': Stop!", rx->name);
     }
 
     static void tune(double freq, void* ctx) {
-        HermesSourceModule* _this = (HermesSourceModule*)ctx;
-        if (_this->running) {
-            // TODO: Check if dev exists
-            _this->dev->setFrequency(freq);
+        Receiver* rx = (Receiver*)ctx;
+        HermesSourceModule* _this = rx->module;
+        if (rx->running) {
+            _this->dev->setRxFrequency(rx->id, freq);
         }
-        _this->freq = freq;
-        flog::info("HermesSourceModule '{0}': Tune: {1}!", _this->name, freq);
+        rx->freq = freq;
+        flog::info("HermesSourceModule '{0}': Tune: {1}!", rx->name, freq);
     }
 
     static void menuHandler(void* ctx) {
-        HermesSourceModule* _this = (HermesSourceModule*)ctx;
+        Receiver* rx = (Receiver*)ctx;
+        HermesSourceModule* _this = rx->module;
 
-        if (_this->running) { SmGui::BeginDisabled(); }
+        // The device settings are shared by all receivers, only the first one shows them
+        if (rx->id) {
+            SmGui::Text(CONCAT("Settings are shared with ", _this->receivers[0].name));
+            return;
+        }
+
+        if (_this->anyRunning()) { SmGui::BeginDisabled(); }
 
         SmGui::FillWidth();
         SmGui::ForceSync();
         if (SmGui::Combo(CONCAT("##_hermes_dev_sel_", _this->name), &_this->devId, _this->devices.txt)) {
             _this->selectMac(_this->devices.key(_this->devId));
+            _this->announceSampleRate(rx);
             if (!_this->selectedMac.empty()) {
                 config.acquire();
                 config.conf["device"] = _this->devices.key(_this->devId);
@@ -208,7 +278,7 @@ private:
 
         if (SmGui::Combo(CONCAT("##_hermes_sr_sel_", _this->name), &_this->srId, _this->samplerates.txt)) {
             _this->sampleRate = _this->samplerates.key(_this->srId);
-            core::setInputSampleRate(_this->sampleRate);
+            _this->announceSampleRate(rx);
             if (!_this->selectedMac.empty()) {
                 config.acquire();
                 config.conf["devices"][_this->selectedMac]["samplerate"] = _this->samplerates.key(_this->srId);
@@ -225,16 +295,28 @@ private:
             std::string mac = config.conf["device"];
             config.release();
             _this->selectMac(mac);
+            _this->announceSampleRate(rx);
+        }
+
+        // Every hardware receiver lowers the number of samples per packet, so only stream the ones in use
+        SmGui::LeftLabel("Receivers");
+        SmGui::FillWidth();
+        int count = _this->rxCount;
+        if (SmGui::SliderInt(CONCAT("##_hermes_rx_count_", _this->name), &count, 1, HERMES_MAX_RX)) {
+            _this->setReceiverCount(count);
+            config.acquire();
+            config.conf["receivers"] = _this->rxCount;
+            config.release(true);
         }
 
-        if (_this->running) { SmGui::EndDisabled(); }
+        if (_this->anyRunning()) { SmGui::EndDisabled(); }
 
         // TODO: Device parameters
 
         SmGui::LeftLabel("LNA Gain");
         SmGui::FillWidth();
         if (SmGui::SliderInt("##hermes_source_lna_gain", &_this->gain, 0, 60)) {
-            if (_this->running) {
+            if (_this->dev) {
                 _this->dev->setGain(_this->gain);
             }
             if (!_this->selectedMac.empty()) {
@@ -247,17 +329,14 @@ private:
 
     std::string name;
     bool enabled = true;
-    dsp::stream<dsp::complex_t> stream;
-    dsp::routing::StreamLink<dsp::complex_t> lnk;
     double sampleRate;
-    SourceManager::SourceHandler handler;
-    bool running = false;
+    Receiver receivers[HERMES_MAX_RX];
+    int rxCount = 1;
     std::string selectedMac = "";
 
     OptionList<std::string, hermes::Info> devices;
     OptionList<int, hermes::HermesLiteSamplerate> samplerates;
 
-    double freq;
     int devId = 0;
     int srId = 0;
     int gain = 0;
@@ -272,6 +351,7 @@ MOD_EXPORT void _INIT_() {
     json def = json({});
     def["devices"] = json({});
     def["device"] = "";
+    def["receivers"] = 1;
     config.setPath(core::args["root"].s() + "/hermes_config.json");
     config.load(def);
     config.enableAutoSave();
@@ -68,6 +68,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
         sigpath::sourceManager.registerSource("PlutoSDR", &handler);
     }
 
@@ -264,7 +265,7 @@ private:
 
             volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, buf, 32768.0f, blockSize * 2);
 
-            if (!_this->stream.swap(blockSize)) { break; };
+            if (!_this->stats.swap(&_this->stream, blockSize)) { break; };
         }
 
         iio_buffer_destroy(rxbuf);
@@ -275,6 +276,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     float sampleRate;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
     std::thread workerThread;
     struct iio_context* ctx = NULL;
     struct iio_device* phy = NULL;
@@ -2,11 +2,13 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <signal_path/source_ring.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
 #include <gui/smgui.h>
 #include <rtl-sdr.h>
+#include <dsp/convert/u8_to_complex.h>
 
 #ifdef __ANDROID__
 #include <android_backend.h>
@@ -71,6 +73,8 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
+        ring.init(name, &stream, &stats);
 
         strcpy(dbTxt, "--");
 
@@ -198,6 +202,7 @@ public:
             config.conf["devices"][selectedDevName]["rtlAgc"] = rtlAgc;
             config.conf["devices"][selectedDevName]["tunerAgc"] = tunerAgc;
             config.conf["devices"][selectedDevName]["gain"] = gainId;
+            config.conf["devices"][selectedDevName]["dcOffset"] = dcOffset;
         }
         if (gainId >= gainList.size()) { gainId = gainList.size() - 1; }
         updateGainTxt();
@@ -243,6 +248,12 @@ public:
             updateGainTxt();
         }
 
+        dcOffset = U8_IQ_DEFAULT_OFFSET;
+        if (config.conf["devices"][selectedDevName].contains("dcOffset")) {
+            dcOffset = config.conf["devices"][selectedDevName]["dcOffset"];
+        }
+        converter.setOffset(dcOffset);
+
         config.release(created);
 
         rtlsdr_close(openDev);
@@ -314,6 +325,7 @@ private:
 
         _this->asyncCount = (int)roundf(_this->sampleRate / (200 * 512)) * 512;
 
+        _this->ring.start(_this->sampleRate, _this->freq);
         _this->workerThread = std::thread(&RTLSDRSourceModule::worker, _this);
 
         _this->running = true;
@@ -324,10 +336,9 @@ private:
         RTLSDRSourceModule* _this = (RTLSDRSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
-        _this->stream.stopWriter();
         rtlsdr_cancel_async(_this->openDev);
         if (_this->workerThread.joinable()) { _this->workerThread.join(); }
-        _this->stream.clearWriteStop();
+        _this->ring.stop();
         rtlsdr_close(_this->openDev);
         flog::info("RTLSDRSourceModule '{0}': Stop!", _this->name);
     }
@@ -346,6 +357,7 @@ private:
             }
         }
         _this->freq = freq;
+        _this->ring.setFrequency(freq);
         flog::info("RTLSDRSourceModule '{0}': Tune: {1}!", _this->name, freq);
     }
 
@@ -426,6 +438,17 @@ private:
             }
         }
 
+        SmGui::LeftLabel("DC Offset");
+        SmGui::FillWidth();
+        if (SmGui::SliderFloat(CONCAT("##_rtlsdr_dc_offset_", _this->name), &_this->dcOffset, 126.5f, 128.5f, SmGui::FMT_STR_FLOAT_TWO_DECIMAL)) {
+            _this->converter.setOffset(_this->dcOffset);
+            if (_this->selectedDevName != "") {
+                config.acquire();
+                config.conf["devices"][_this->selectedDevName]["dcOffset"] = _this->dcOffset;
+                config.release(true);
+            }
+        }
+
         if (_this->tunerAgc || _this->gainList.size() == 0) { SmGui::BeginDisabled(); }
 
         SmGui::LeftLabel("Gain");
@@ -521,12 +544,9 @@ private:
 
     static void asyncHandler(unsigned char* buf, uint32_t len, void* ctx) {
         RTLSDRSourceModule* _this = (RTLSDRSourceModule*)ctx;
-        int sampCount = len / 2;
-        for (int i = 0; i < sampCount; i++) {
-            _this->stream.writeBuf[i].re = (float)(buf[i * 2] - 127) / 128.0f;
-            _this->stream.writeBuf[i].im = (float)(buf[(i * 2) + 1] - 127) / 128.0f;
-        }
-        if (!_this->stream.swap(sampCount)) { return; }
+        _this->ring.write(len / 2, [_this, buf](dsp::complex_t* dst, int offset, int n) {
+            _this->converter.process(n, &buf[offset * 2], dst);
+        });
     }
 
     void updateGainTxt() {
@@ -539,6 +559,8 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
+    SourceRing ring;
     bool running = false;
     double freq;
     std::string selectedDevName = "";
@@ -565,6 +587,10 @@ private:
 
     int directSamplingMode = 0;
 
+    // Raw value converted to zero, tweaked per device to cancel the DC offset of its ADC
+    float dcOffset = U8_IQ_DEFAULT_OFFSET;
+    dsp::convert::U8ToComplex converter;
+
     // Handler stuff
     int asyncCount = 0;
 
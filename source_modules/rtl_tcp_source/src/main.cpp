@@ -76,6 +76,9 @@ public:
         if (config.conf.contains("offsetTuning")) {
             offsetTuning = config.conf["offsetTuning"];
         }
+        if (config.conf.contains("dcOffset")) {
+            dcOffset = config.conf["dcOffset"];
+        }
         config.release();
 
         // Update samplerate
@@ -141,6 +144,7 @@ private:
         _this->client->setFrequency(_this->freq);
         _this->client->setSampleRate(_this->sampleRate);
         _this->client->setPPM(_this->ppm);
+        _this->client->setDCOffset(_this->dcOffset);
         _this->client->setDirectSampling(_this->directSamplingId);
         _this->client->setAGCMode(_this->rtlAGC);
         _this->client->setBiasTee(_this->biasTee);
@@ -226,6 +230,17 @@ private:
             config.release(true);
         }
 
+        SmGui::LeftLabel("DC Offset");
+        SmGui::FillWidth();
+        if (SmGui::SliderFloat(CONCAT("##_rtltcp_dc_offset_", _this->name), &_this->dcOffset, 126.5f, 128.5f, SmGui::FMT_STR_FLOAT_TWO_DECIMAL)) {
+            if (_this->running) {
+                _this->client->setDCOffset(_this->dcOffset);
+            }
+            config.acquire();
+            config.conf["dcOffset"] = _this->dcOffset;
+            config.release(true);
+        }
+
         if (_this->tunerAGC) { SmGui::BeginDisabled(); }
         SmGui::LeftLabel("Gain");
         SmGui::FillWidth();
@@ -281,6 +296,12 @@ private:
             config.conf["tunerAGC"] = _this->tunerAGC;
             config.release(true);
         }
+
+        if (_this->running) {
+            char buf[128];
+            sprintf(buf, "Buffer: %d%%, Overruns: %d, Underruns: %d", (int)(_this->client->getRingFill() * 100.0f), (int)_this->client->getOverruns(), (int)_this->client->getUnderruns());
+            SmGui::Text(buf);
+        }
     }
 
     std::string name;
@@ -298,6 +319,7 @@ private:
     int srId = 0;
     int directSamplingId = 0;
     int ppm = 0;
+    float dcOffset = U8_IQ_DEFAULT_OFFSET;
     int gain = 0;
     bool biasTee = false;
     bool offsetTuning = false;
@@ -1,12 +1,15 @@
 #include "rtl_tcp_client.h"
+#include <dsp/convert/u8_to_complex.h>
 
 namespace rtltcp {
     Client::Client(std::shared_ptr<net::Socket> sock, dsp::stream<dsp::complex_t>* stream) {
         this->sock = sock;
         this->stream = stream;
+        ring.init(RTL_TCP_RING_SIZE);
 
-        // Start worker
+        // Start the socket reader and the conversion worker
         workerThread = std::thread(&Client::worker, this);
+        pushThread = std::thread(&Client::pushWorker, this);
     }
 
     Client::~Client() {
@@ -19,11 +22,16 @@ namespace rtltcp {
 
     void Client::close() {
         sock->close();
+        ring.stopReader();
         stream->stopWriter();
         if (workerThread.joinable()) {
             workerThread.join();
         }
+        if (pushThread.joinable()) {
+            pushThread.join();
+        }
         stream->clearWriteStop();
+        ring.clearReadStop();
     }
 
     void Client::setFrequency(double freq) {
@@ -47,6 +55,10 @@ namespace rtltcp {
         sendCommand(5, (uint32_t)ppm);
     }
 
+    void Client::setDCOffset(float offset) {
+        converter.setOffset(offset);
+    }
+
     void Client::setAGCMode(int mode) {
         sendCommand(8, mode);
     }
@@ -67,6 +79,18 @@ namespace rtltcp {
         sendCommand(14, enabled);
     }
 
+    uint64_t Client::getOverruns() {
+        return ring.getOverruns();
+    }
+
+    uint64_t Client::getUnderruns() {
+        return ring.getUnderruns();
+    }
+
+    float Client::getRingFill() {
+        return ring.getFill();
+    }
+
     void Client::sendCommand(uint8_t command, uint32_t param) {
         Command cmd = { command, htonl(param) };
         sock->send((uint8_t*)&cmd, sizeof(Command));
@@ -76,16 +100,25 @@ namespace rtltcp {
         uint8_t* buffer = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE*2);
 
         while (true) {
-            // Read data
+            // Read data, it is queued even if the DSP is busy so that the socket never stalls
             int count = sock->recv(buffer, bufferSize * 2, true);
             if (count <= 0) { break; }
+            ring.write(buffer, count);
+        }
+
+        dsp::buffer::free(buffer);
+    }
+
+    void Client::pushWorker() {
+        uint8_t* buffer = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE*2);
+
+        while (true) {
+            int count = ring.read(buffer, STREAM_BUFFER_SIZE*2);
+            if (count < 0) { break; }
 
             // Convert to complex float
             int scount = count/2;
-            for (int i = 0; i < scount; i++) {
-                stream->writeBuf[i].re = ((double)buffer[i * 2] - 128.0) / 128.0;
-                stream->writeBuf[i].im = ((double)buffer[(i * 2) + 1] - 128.0) / 128.0;
-            }
+            converter.process(scount, buffer, stream->writeBuf);
 
             // Swap buffer
             if (!stream->swap(scount)) { break; }
@@ -2,8 +2,13 @@
 #include <utils/net.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <dsp/buffer/prefetch_ring.h>
+#include <dsp/convert/u8_to_complex.h>
 #include <thread>
 
+// Size of the ring between the socket and the conversion, about 1.3s at 3.2MS/s
+#define RTL_TCP_RING_SIZE   (8 * 1024 * 1024)
+
 namespace rtltcp {
 #pragma pack(push, 1)
         struct Command {
@@ -31,13 +36,24 @@ namespace rtltcp {
         void setGainIndex(int index);
         void setBiasTee(bool enabled);
 
+        // Raw sample value converted to zero, only affects the local conversion
+        void setDCOffset(float offset);
+
+        uint64_t getOverruns();
+        uint64_t getUnderruns();
+        float getRingFill();
+
     private:
         void sendCommand(uint8_t command, uint32_t param);
         void worker();
+        void pushWorker();
 
         std::shared_ptr<net::Socket> sock;
         std::thread workerThread;
+        std::thread pushThread;
         dsp::stream<dsp::complex_t>* stream;
+        dsp::buffer::PrefetchRing ring;
+        dsp::convert::U8ToComplex converter;
         int bufferSize = 2400000 / 200;
     };
 
@@ -571,6 +571,9 @@ private:
         // Configure device
         _this->bufferIndex = 0;
         _this->bufferSize = (float)_this->sampleRate / 200.0f;
+        _this->sampleNumValid = false;
+        _this->clock.reset(_this->sampleRate);
+        _this->clock.setFrequency(_this->freq);
 
         // RSP1A Options
         if (_this->openDev.hwVer == SDRPLAY_RSP1A_ID) {
@@ -676,6 +679,7 @@ private:
             sdrplay_api_Update(_this->openDev.dev, _this->openDev.tuner, sdrplay_api_Update_Tuner_Frf, sdrplay_api_Update_Ext1_None);
         }
         _this->freq = freq;
+        _this->clock.setFrequency(freq);
         flog::info("SDRPlaySourceModule '{0}': Tune: {1}!", _this->name, freq);
     }
 
@@ -1113,12 +1117,28 @@ private:
         SDRPlaySourceModule* _this = (SDRPlaySourceModule*)cbContext;
         // TODO: Optimise using volk and math
         if (!_this->running) { return; }
+
+        // The API numbers the samples, a jump means some were lost. End the current buffer there so that
+        // the sample indices of the following ones stay exact.
+        int gap = (int)(params->firstSampleNum - _this->nextSampleNum);
+        _this->nextSampleNum = params->firstSampleNum + numSamples;
+        if (_this->sampleNumValid && !reset && gap > 0) {
+            if (_this->bufferIndex) {
+                _this->stream.writeMeta = _this->clock.stamp(_this->bufferIndex);
+                _this->stream.swap(_this->bufferIndex);
+                _this->bufferIndex = 0;
+            }
+            _this->clock.skip(gap);
+        }
+        _this->sampleNumValid = true;
+
         for (int i = 0; i < numSamples; i++) {
             int id = _this->bufferIndex++;
             _this->stream.writeBuf[id].re = (float)xi[i] / 32768.0f;
             _this->stream.writeBuf[id].im = (float)xq[i] / 32768.0f;
 
             if (_this->bufferIndex >= _this->bufferSize) {
+                _this->stream.writeMeta = _this->clock.stamp(_this->bufferSize);
                 _this->stream.swap(_this->bufferSize);
                 _this->bufferIndex = 0;
             }
@@ -1173,6 +1193,10 @@ private:
     int bufferSize = 0;
     int bufferIndex = 0;
 
+    dsp::StreamClock clock;
+    unsigned int nextSampleNum = 0;
+    bool sampleNumValid = false;
+
     int ifModeId = 0;
 
     // RSP1A Options
@@ -33,9 +33,14 @@ public:
 
         // Initialize lists
         sampleTypeList.define("Int8", dsp::compression::PCM_TYPE_I8);
+        sampleTypeList.define("Int8 BFP", dsp::compression::PCM_TYPE_BFP_I8);
         sampleTypeList.define("Int16", dsp::compression::PCM_TYPE_I16);
         sampleTypeList.define("Float32", dsp::compression::PCM_TYPE_F32);
         sampleTypeId = sampleTypeList.valueId(dsp::compression::PCM_TYPE_I16);
+        for (int i = 1; i <= 64; i *= 2) {
+            maxDecimList.define(std::to_string(i), (i > 1) ? ("1:" + std::to_string(i)) : "None", i);
+        }
+        maxDecimId = maxDecimList.valueId(1);
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -179,6 +184,39 @@ private:
 
 
         if (connected) {
+            if (ImGui::Checkbox("Adaptive##sdrpp_srv_source_adaptive", &_this->adaptive)) {
+                _this->client->setAdaptive(_this->adaptive, _this->maxDecimList[_this->maxDecimId]);
+
+                // Manual settings are restored when leaving adaptive mode
+                if (!_this->adaptive) {
+                    _this->client->setSampleType(_this->sampleTypeList[_this->sampleTypeId]);
+                    _this->client->setCompression(_this->compression);
+                }
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["adaptive"] = _this->adaptive;
+                config.release(true);
+            }
+
+            if (_this->adaptive) {
+                ImGui::LeftLabel("Max decimation");
+                ImGui::FillWidth();
+                if (ImGui::Combo("##sdrpp_srv_source_max_decim", &_this->maxDecimId, _this->maxDecimList.txt)) {
+                    _this->client->setAdaptive(true, _this->maxDecimList[_this->maxDecimId]);
+
+                    // Save config
+                    config.acquire();
+                    config.conf["servers"][_this->devConfName]["maxDecimation"] = _this->maxDecimList.key(_this->maxDecimId);
+                    config.release(true);
+                }
+
+                server::StreamSettings settings = _this->client->getStreamSettings();
+                std::string sampType = _this->sampleTypeList.valueExists((dsp::compression::PCMType)settings.sampleType) ? _this->sampleTypeList.name(_this->sampleTypeList.valueId((dsp::compression::PCMType)settings.sampleType)) : "Unknown";
+                ImGui::Text("Active: %s, zstd %d, 1:%d", sampType.c_str(), (int)settings.compressionLevel, (int)settings.decimation);
+            }
+
+            if (_this->adaptive) { style::beginDisabled(); }
             ImGui::LeftLabel("Sample type");
             ImGui::FillWidth();
             if (ImGui::Combo("##sdrpp_srv_source_samp_type", &_this->sampleTypeId, _this->sampleTypeList.txt)) {
@@ -198,12 +236,42 @@ private:
                 config.conf["servers"][_this->devConfName]["compression"] = _this->compression;
                 config.release(true);
             }
+            if (_this->adaptive) { style::endDisabled(); }
 
             bool dummy = true;
             style::beginDisabled();
             ImGui::Checkbox("Full IQ", &dummy);
             style::endDisabled();
 
+            if (_this->udp) { style::beginDisabled(); }
+            ImGui::LeftLabel("UDP Port");
+            ImGui::FillWidth();
+            if (ImGui::InputInt("##sdrpp_srv_source_udp_port", &_this->udpPort, 0, 0)) {
+                _this->udpPort = std::clamp<int>(_this->udpPort, 1, 65535);
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["udpPort"] = _this->udpPort;
+                config.release(true);
+            }
+            if (_this->udp) { style::endDisabled(); }
+
+            if (ImGui::Checkbox("UDP Baseband##sdrpp_srv_source_udp", &_this->udp)) {
+                _this->udp = _this->client->setUDP(_this->udp, _this->udpPort);
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["udp"] = _this->udp;
+                config.release(true);
+            }
+
+            if (_this->udp) {
+                uint32_t packets = _this->client->udpPackets;
+                uint32_t lost = _this->client->udpLostPackets;
+                float loss = (packets + lost) ? (100.0f * (float)lost / (float)(packets + lost)) : 0.0f;
+                ImGui::Text("UDP Loss: %.2f%% (%u packets)", loss, lost);
+            }
+
             // Calculate datarate
             _this->frametimeCounter += ImGui::GetIO().DeltaTime;
             if (_this->frametimeCounter >= 0.2f) {
@@ -215,6 +283,9 @@ private:
             ImGui::TextUnformatted("Status:");
             ImGui::SameLine();
             ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Connected (%.3f Mbit/s)", _this->datarate);
+            if (_this->running && !_this->udp) {
+                ImGui::Text("Buffer: %d%%, Overruns: %d, Underruns: %d", (int)(_this->client->getRingFill() * 100.0f), (int)_this->client->getOverruns(), (int)_this->client->getUnderruns());
+            }
 
             ImGui::CollapsingHeader("Source [REMOTE]", ImGuiTreeNodeFlags_DefaultOpen);
 
@@ -230,7 +301,7 @@ private:
     void tryConnect() {
         try {
             if (client) { client.reset(); }
-            client = server::connect(hostname, port, &stream);
+            client = server::connect(hostname, port, &stream, "SDR++ Server");
             deviceInit();
         }
         catch (std::exception e) {
@@ -254,10 +325,30 @@ private:
         if (config.conf["servers"][devConfName].contains("compression")) {
             compression = config.conf["servers"][devConfName]["compression"];
         }
+        adaptive = false;
+        if (config.conf["servers"][devConfName].contains("adaptive")) {
+            adaptive = config.conf["servers"][devConfName]["adaptive"];
+        }
+        maxDecimId = maxDecimList.valueId(1);
+        if (config.conf["servers"][devConfName].contains("maxDecimation")) {
+            std::string key = config.conf["servers"][devConfName]["maxDecimation"];
+            if (maxDecimList.keyExists(key)) { maxDecimId = maxDecimList.keyId(key); }
+        }
+
+        udp = false;
+        if (config.conf["servers"][devConfName].contains("udp")) {
+            udp = config.conf["servers"][devConfName]["udp"];
+        }
+        udpPort = 5260;
+        if (config.conf["servers"][devConfName].contains("udpPort")) {
+            udpPort = config.conf["servers"][devConfName]["udpPort"];
+        }
 
         // Set settings
         client->setSampleType(sampleTypeList[sampleTypeId]);
         client->setCompression(compression);
+        if (adaptive) { client->setAdaptive(true, maxDecimList[maxDecimId]); }
+        if (udp) { udp = client->setUDP(true, udpPort); }
     }
 
     std::string name;
@@ -281,6 +372,13 @@ private:
     int sampleTypeId;
     bool compression = false;
 
+    OptionList<std::string, int> maxDecimList;
+    int maxDecimId;
+    bool adaptive = false;
+
+    bool udp = false;
+    int udpPort = 5260;
+
     server::Client client;
 };
 
@@ -7,13 +7,16 @@
 using namespace std::chrono_literals;
 
 namespace server {
-    ClientClass::ClientClass(net::Conn conn, dsp::stream<dsp::complex_t>* out) {
+    ClientClass::ClientClass(net::Conn conn, dsp::stream<dsp::complex_t>* out, std::string sourceName) {
         client = std::move(conn);
         output = out;
+        this->sourceName = sourceName;
 
         // Allocate buffers
         rbuffer = new uint8_t[SERVER_MAX_PACKET_SIZE];
         sbuffer = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        ubuffer = new uint8_t[SERVER_UDP_MAX_PACKET_SIZE];
+        uscratch = new int16_t[SERVER_UDP_MAX_PACKET_SIZE];
 
         // Initialize headers
         r_pkt_hdr = (PacketHeader*)rbuffer;
@@ -36,6 +39,8 @@ namespace server {
         link.init(&decomp.out, output);
         decomp.start();
         link.start();
+        ring.init(SERVER_RING_SIZE);
+        pushThread = std::thread(&ClientClass::pushWorker, this);
 
         // Start readers
         client->readAsync(sizeof(PacketHeader), rbuffer, tcpHandler, this);
@@ -44,6 +49,10 @@ namespace server {
         int res = getUI();
         if (res == -1) { throw std::runtime_error("Timed out"); }
         else if (res == -2) { throw std::runtime_error("Server busy"); }
+
+        // Let the server know which stream filters can be undone. Older servers reply with an error, which is harmless.
+        *(uint32_t*)s_cmd_data = CAPABILITY_SHUFFLE;
+        sendCommand(COMMAND_SET_CAPABILITIES, sizeof(uint32_t));
     }
 
     ClientClass::~ClientClass() {
@@ -51,6 +60,8 @@ namespace server {
         ZSTD_freeDCtx(dctx);
         delete[] rbuffer;
         delete[] sbuffer;
+        delete[] ubuffer;
+        delete[] uscratch;
     }
 
     void ClientClass::showMenu() {
@@ -119,6 +130,51 @@ namespace server {
         sendCommand(COMMAND_SET_COMPRESSION, 1);
     }
 
+    void ClientClass::setAdaptive(bool enabled, int maxDecimation) {
+        AdaptiveConfig* conf = (AdaptiveConfig*)s_cmd_data;
+        conf->enabled = enabled;
+        conf->maxDecimation = maxDecimation;
+        sendCommand(COMMAND_SET_ADAPTIVE, sizeof(AdaptiveConfig));
+    }
+
+    StreamSettings ClientClass::getStreamSettings() {
+        return streamSettings;
+    }
+
+    bool ClientClass::setUDP(bool enabled, int port) {
+        if (!client || !client->isOpen()) { return false; }
+        closeUDP();
+
+        // Open the local socket before asking the server to send to it
+        if (enabled) {
+            try {
+                udpClient = net::openUDP("0.0.0.0", port, client->getRemoteHost(), port, true);
+                udpClient->setRecvBufferSize(SERVER_UDP_RECV_BUFFER_SIZE);
+            }
+            catch (std::exception& e) {
+                flog::error("Could not open UDP socket: {0}", e.what());
+                enabled = false;
+            }
+        }
+        // Only one path may write to the output, the TCP one is stopped while datagrams are received
+        if (enabled) {
+            link.stop();
+            udpPackets = 0;
+            udpLostPackets = 0;
+            udpOutCount = 0;
+            udpWorkerThread = std::thread(&ClientClass::udpWorker, this);
+        }
+        else {
+            link.start();
+        }
+
+        UDPConfig* conf = (UDPConfig*)s_cmd_data;
+        conf->enabled = enabled;
+        conf->port = port;
+        sendCommand(COMMAND_SET_UDP, sizeof(UDPConfig));
+        return enabled;
+    }
+
     void ClientClass::start() {
         if (!client || !client->isOpen()) { return; }
         sendCommand(COMMAND_START, 0);
@@ -128,14 +184,18 @@ namespace server {
     void ClientClass::stop() {
         if (!client || !client->isOpen()) { return; }
         sendCommand(COMMAND_STOP, 0);
+        ring.pause();
         getUI();
     }
 
     void ClientClass::close() {
+        closeUDP();
         decomp.stop();
         link.stop();
         decompIn.stopWriter();
+        ring.stopReader();
         client->close();
+        if (pushThread.joinable()) { pushThread.join(); }
         decompIn.clearWriteStop();
     }
 
@@ -143,6 +203,18 @@ namespace server {
         return client->isOpen();
     }
 
+    uint64_t ClientClass::getOverruns() {
+        return ring.getOverruns();
+    }
+
+    uint64_t ClientClass::getUnderruns() {
+        return ring.getUnderruns();
+    }
+
+    float ClientClass::getRingFill() {
+        return ring.getFill();
+    }
+
     void ClientClass::tcpHandler(int count, uint8_t* buf, void* ctx) {
         ClientClass* _this = (ClientClass*)ctx;
         
@@ -163,7 +235,10 @@ namespace server {
             // TODO: Move to command handler
             if (_this->r_cmd_hdr->cmd == COMMAND_SET_SAMPLERATE && _this->r_pkt_hdr->size == sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(double)) {
                 _this->currentSampleRate = *(double*)_this->r_cmd_data;
-                core::setInputSampleRate(_this->currentSampleRate);
+                core::setInputSampleRate(_this->currentSampleRate, _this->sourceName);
+            }
+            else if (_this->r_cmd_hdr->cmd == COMMAND_SET_STREAM_SETTINGS && _this->r_pkt_hdr->size == sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(StreamSettings)) {
+                _this->streamSettings = *(StreamSettings*)_this->r_cmd_data;
             }
             else if (_this->r_cmd_hdr->cmd == COMMAND_DISCONNECT) {
                 flog::error("Asked to disconnect by the server");
@@ -198,13 +273,10 @@ namespace server {
                 delete waiter;
             }
         }
-        else if (_this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND) {
-            memcpy(_this->decompIn.writeBuf, &buf[sizeof(PacketHeader)], _this->r_pkt_hdr->size - sizeof(PacketHeader));
-            _this->decompIn.swap(_this->r_pkt_hdr->size - sizeof(PacketHeader));
-        }
-        else if (_this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
-            size_t outCount = ZSTD_decompressDCtx(_this->dctx, _this->decompIn.writeBuf, STREAM_BUFFER_SIZE, _this->r_pkt_data, _this->r_pkt_hdr->size - sizeof(PacketHeader));
-            if (outCount) { _this->decompIn.swap(outCount); };
+        else if (_this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND || _this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
+            // Queue the packet so that commands keep being handled and the socket keeps being read if the DSP stalls
+            uint8_t type = _this->r_pkt_hdr->type;
+            _this->ring.write(&type, sizeof(uint8_t), _this->r_pkt_data, _this->r_pkt_hdr->size - sizeof(PacketHeader));
         }
         else if (_this->r_pkt_hdr->type == PACKET_TYPE_ERROR) {
             flog::error("SDR++ Server Error: {0}", buf[sizeof(PacketHeader)]);
@@ -217,6 +289,89 @@ namespace server {
         _this->client->readAsync(sizeof(PacketHeader), _this->rbuffer, tcpHandler, _this);
     }
 
+    void ClientClass::pushWorker() {
+        uint8_t* buf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        uint8_t* data = &buf[sizeof(uint8_t)];
+
+        while (true) {
+            int len = ring.read(buf, SERVER_MAX_PACKET_SIZE);
+            if (len < 0) { break; }
+            int dataLen = len - sizeof(uint8_t);
+
+            if (buf[0] == PACKET_TYPE_BASEBAND) {
+                memcpy(decompIn.writeBuf, data, dataLen);
+                if (!decompIn.swap(dataLen)) { break; }
+            }
+            else {
+                size_t outCount = ZSTD_decompressDCtx(dctx, decompIn.writeBuf, STREAM_BUFFER_SIZE, data, dataLen);
+                if (outCount && !decompIn.swap(outCount)) { break; }
+            }
+        }
+
+        delete[] buf;
+    }
+
+    void ClientClass::udpWorker() {
+        bool first = true;
+        uint32_t nextSeq = 0;
+        uint64_t nextSampleIndex = 0;
+
+        while (true) {
+            int len = udpClient->read(SERVER_UDP_MAX_PACKET_SIZE, ubuffer);
+            if (len < 0) { break; }
+            if (len <= sizeof(UDPHeader) + 8) { continue; }
+            UDPHeader* hdr = (UDPHeader*)ubuffer;
+
+            // Drop late datagrams, reordered ones have already been concealed
+            if (!first && (int32_t)(hdr->sequence - nextSeq) < 0) { continue; }
+            udpPackets++;
+
+            // Conceal lost datagrams with silence. Large jumps are resyncs and aren't filled
+            if (!first && hdr->sequence != nextSeq) {
+                udpLostPackets += hdr->sequence - nextSeq;
+                int64_t gap = hdr->sampleIndex - nextSampleIndex;
+                if (gap > 0 && gap <= (int64_t)(currentSampleRate * SERVER_UDP_MAX_CONCEALMENT)) {
+                    while (gap > 0) {
+                        int fill = std::min<int64_t>(gap, STREAM_BUFFER_SIZE - udpOutCount);
+                        memset(&output->writeBuf[udpOutCount], 0, fill * sizeof(dsp::complex_t));
+                        gap -= fill;
+                        if (!pushUDPSamples(fill, udpOutCount + fill >= STREAM_BUFFER_SIZE)) { return; }
+                    }
+                }
+            }
+            first = false;
+
+            // Make sure the datagram fits before decoding it in place in the output buffer
+            int maxSamples = (len - sizeof(UDPHeader)) / 2;
+            if (udpOutCount + maxSamples > STREAM_BUFFER_SIZE && !pushUDPSamples(0, true)) { return; }
+            int count = dsp::compression::SampleStreamDecompressor::process(len - sizeof(UDPHeader), &ubuffer[sizeof(UDPHeader)], &output->writeBuf[udpOutCount], uscratch);
+            nextSeq = hdr->sequence + 1;
+            nextSampleIndex = hdr->sampleIndex + count;
+            if (!pushUDPSamples(count, false)) { return; }
+        }
+    }
+
+    bool ClientClass::pushUDPSamples(int count, bool force) {
+        // Datagrams are small, accumulate them into blocks of about 5ms to keep the swap rate sane
+        udpOutCount += count;
+        int blockSize = std::clamp<int>(currentSampleRate / 200.0, 1, STREAM_BUFFER_SIZE / 2);
+        if (!udpOutCount || (udpOutCount < blockSize && !force)) { return true; }
+        bool ok = output->swap(udpOutCount);
+        udpOutCount = 0;
+        return ok;
+    }
+
+    void ClientClass::closeUDP() {
+        if (!udpClient) { return; }
+
+        // The worker could be stuck waiting on the output
+        udpClient->close();
+        output->stopWriter();
+        if (udpWorkerThread.joinable()) { udpWorkerThread.join(); }
+        output->clearWriteStop();
+        udpClient.reset();
+    }
+
     int ClientClass::getUI() {
         auto waiter = awaitCommandAck(COMMAND_GET_UI);
         sendCommand(COMMAND_GET_UI, 0);
@@ -261,9 +416,9 @@ namespace server {
         _this->output->swap(count);
     }
 
-    Client connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out) {
+    Client connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out, std::string sourceName) {
         net::Conn conn = net::connect(host, port);
         if (!conn) { return NULL; }
-        return Client(new ClientClass(std::move(conn), out));
+        return Client(new ClientClass(std::move(conn), out, sourceName));
     }
 }
@@ -11,6 +11,7 @@
 #include <dsp/compression/sample_stream_decompressor.h>
 #include <dsp/sink.h>
 #include <dsp/routing/stream_link.h>
+#include <dsp/buffer/prefetch_ring.h>
 #include <zstd.h>
 
 #define RFSPACE_MAX_SIZE                8192
@@ -19,6 +20,12 @@
 
 #define PROTOCOL_TIMEOUT_MS             10000
 
+#define SERVER_UDP_RECV_BUFFER_SIZE     (8 * 1024 * 1024)
+#define SERVER_UDP_MAX_CONCEALMENT      0.5
+
+// Size of the ring between the socket and the decompression
+#define SERVER_RING_SIZE                (16 * 1024 * 1024)
+
 namespace server {
     class PacketWaiter {
     public:
@@ -77,7 +84,7 @@ namespace server {
 
     class ClientClass {
     public:
-        ClientClass(net::Conn conn, dsp::stream<dsp::complex_t>* out);
+        ClientClass(net::Conn conn, dsp::stream<dsp::complex_t>* out, std::string sourceName);
         ~ClientClass();
 
         void showMenu();
@@ -87,6 +94,9 @@ namespace server {
         
         void setSampleType(dsp::compression::PCMType type);
         void setCompression(bool enabled);
+        void setAdaptive(bool enabled, int maxDecimation);
+        StreamSettings getStreamSettings();
+        bool setUDP(bool enabled, int port);
 
         void start();
         void stop();
@@ -94,11 +104,21 @@ namespace server {
         void close();
         bool isOpen();
 
+        uint64_t getOverruns();
+        uint64_t getUnderruns();
+        float getRingFill();
+
         int bytes = 0;
         bool serverBusy = false;
+        std::atomic<uint32_t> udpPackets = 0;
+        std::atomic<uint32_t> udpLostPackets = 0;
 
     private:
         static void tcpHandler(int count, uint8_t* buf, void* ctx);
+        void pushWorker();
+        void udpWorker();
+        void closeUDP();
+        bool pushUDPSamples(int count, bool force);
 
         int getUI();
 
@@ -137,10 +157,23 @@ namespace server {
 
         ZSTD_DCtx* dctx;
 
+        // Baseband packets are queued by the socket reader and decompressed on their own thread
+        dsp::buffer::PrefetchRing ring;
+        std::thread pushThread;
+
+        net::Conn udpClient;
+        std::thread udpWorkerThread;
+        uint8_t* ubuffer = NULL;
+        int16_t* uscratch = NULL;
+        int udpOutCount = 0;
+
+        // Name the source was registered with, the samplerate is announced from the network thread
+        std::string sourceName;
         double currentSampleRate = 1000000.0;
+        StreamSettings streamSettings = { dsp::compression::PCM_TYPE_I16, 0, 1 };
     };
 
     typedef std::unique_ptr<ClientClass> Client;
 
-    Client connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out);
+    Client connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out, std::string sourceName);
 }
@@ -49,6 +49,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
         sigpath::sourceManager.registerSource("SoapySDR", &handler);
     }
 
@@ -484,10 +485,11 @@ private:
 
         while (_this->running) {
             int res = _this->dev->readStream(_this->devStream, (void**)&_this->stream.writeBuf, blockSize, flags, timeMs);
+            if (res == SOAPY_SDR_OVERFLOW) { _this->stats.addOverrun(); }
             if (res < 1) {
                 continue;
             }
-            if (!_this->stream.swap(res)) { return; }
+            if (!_this->stats.swap(&_this->stream, res)) { return; }
         }
     }
 
@@ -496,6 +498,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     SoapySDR::Stream* devStream;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
     SoapySDR::KwargsList devList;
     SoapySDR::Kwargs devArgs;
     SoapySDR::Device* dev;
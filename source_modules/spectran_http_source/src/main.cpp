@@ -176,12 +176,16 @@ private:
     void onFreqChanged(double newFreq) {
         if (lastReportedFreq == newFreq) { return; }
         lastReportedFreq = newFreq;
-        tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", newFreq);
+
+        // Called from the client's worker, as a secondary source only its own front end follows the device
+        if (!sigpath::sourceManager.setSecondaryFrequency("Spectran HTTP", newFreq)) {
+            gui::mainWindow.postTask([=]() { tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", newFreq); });
+        }
         gotReport = true;
     }
 
     void onSamplerateChanged(double newSr) {
-        core::setInputSampleRate(newSr);
+        core::setInputSampleRate(newSr, "Spectran HTTP");
     }
 
     std::string name;
@@ -232,6 +232,12 @@ private:
             SmGui::Text("Status:");
             SmGui::SameLine();
             ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Connected (%s)", deviceTypesStr[_this->client->devInfo.DeviceType]);
+
+            if (_this->running) {
+                char buf[128];
+                sprintf(buf, "Buffer: %d%%, Overruns: %d, Underruns: %d", (int)(_this->client->getRingFill() * 100.0f), (int)_this->client->getOverruns(), (int)_this->client->getUnderruns());
+                SmGui::Text(buf);
+            }
         }
         else {
             SmGui::Text("Status:");
@@ -1,5 +1,6 @@
 #include <spyserver_client.h>
 #include <volk/volk.h>
+#include <dsp/convert/u8_to_complex.h>
 #include <cstring>
 
 using namespace std::chrono_literals;
@@ -13,6 +14,9 @@ namespace spyserver {
 
         output->clearWriteStop();
 
+        ring.init(SPYSERVER_RING_SIZE);
+        pushThread = std::thread(&SpyServerClientClass::pushWorker, this);
+
         sendHandshake("SDR++");
 
         client->readAsync(sizeof(SpyServerMessageHeader), (uint8_t*)&receivedHeader, dataHandler, this);
@@ -30,6 +34,7 @@ namespace spyserver {
     }
 
     void SpyServerClientClass::stopStream() {
+        ring.pause();
         output->stopWriter();
         setSetting(SPYSERVER_SETTING_STREAMING_ENABLED, false);
     }
@@ -37,6 +42,8 @@ namespace spyserver {
     void SpyServerClientClass::close() {
         output->stopWriter();
         client->close();
+        ring.stopReader();
+        if (pushThread.joinable()) { pushThread.join(); }
     }
 
     bool SpyServerClientClass::isOpen() {
@@ -59,6 +66,18 @@ namespace spyserver {
         }
     }
 
+    uint64_t SpyServerClientClass::getOverruns() {
+        return ring.getOverruns();
+    }
+
+    uint64_t SpyServerClientClass::getUnderruns() {
+        return ring.getUnderruns();
+    }
+
+    float SpyServerClientClass::getRingFill() {
+        return ring.getFill();
+    }
+
     bool SpyServerClientClass::waitForDevInfo(int timeoutMS) {
         std::unique_lock lck(deviceInfoMtx);
         auto now = std::chrono::system_clock::now();
@@ -132,36 +151,52 @@ namespace spyserver {
             }
             _this->deviceInfoCnd.notify_all();
         }
-        else if (mtype == SPYSERVER_MSG_TYPE_UINT8_IQ) {
-            int sampCount = _this->receivedHeader.BodySize / (sizeof(uint8_t) * 2);
-            float gain = pow(10, (double)mflags / 20.0);
-            float scale = 1.0f / (gain * 128.0f);
-            for (int i = 0; i < sampCount; i++) {
-                _this->output->writeBuf[i].re = ((float)_this->readBuf[(2 * i)] - 128.0f) * scale;
-                _this->output->writeBuf[i].im = ((float)_this->readBuf[(2 * i) + 1] - 128.0f) * scale;
-            }
-            _this->output->swap(sampCount);
-        }
-        else if (mtype == SPYSERVER_MSG_TYPE_INT16_IQ) {
-            int sampCount = _this->receivedHeader.BodySize / (sizeof(int16_t) * 2);
-            float gain = pow(10, (double)mflags / 20.0);
-            volk_16i_s32f_convert_32f((float*)_this->output->writeBuf, (int16_t*)_this->readBuf, 32768.0 * gain, sampCount * 2);
-            _this->output->swap(sampCount);
+        else if (mtype == SPYSERVER_MSG_TYPE_UINT8_IQ || mtype == SPYSERVER_MSG_TYPE_INT16_IQ || mtype == SPYSERVER_MSG_TYPE_FLOAT_IQ) {
+            // Queue the samples instead of converting them here so that a DSP stall doesn't stop the socket from being read
+            IQRecordHeader rhdr = { mtype, mflags };
+            _this->ring.write(&rhdr, sizeof(IQRecordHeader), _this->readBuf, _this->receivedHeader.BodySize);
         }
         else if (mtype == SPYSERVER_MSG_TYPE_INT24_IQ) {
             printf("ERROR: IQ format not supported\n");
             return;
         }
-        else if (mtype == SPYSERVER_MSG_TYPE_FLOAT_IQ) {
-            int sampCount = _this->receivedHeader.BodySize / sizeof(dsp::complex_t);
-            float gain = pow(10, (double)mflags / 20.0);
-            volk_32f_s32f_multiply_32f((float*)_this->output->writeBuf, (float*)_this->readBuf, gain, sampCount * 2);
-            _this->output->swap(sampCount);
-        }
 
         _this->client->readAsync(sizeof(SpyServerMessageHeader), (uint8_t*)&_this->receivedHeader, dataHandler, _this);
     }
 
+    void SpyServerClientClass::pushWorker() {
+        uint8_t* buf = dsp::buffer::alloc<uint8_t>(sizeof(IQRecordHeader) + SPYSERVER_MAX_MESSAGE_BODY_SIZE);
+        IQRecordHeader* rhdr = (IQRecordHeader*)buf;
+        uint8_t* body = &buf[sizeof(IQRecordHeader)];
+
+        while (true) {
+            int len = ring.read(buf, sizeof(IQRecordHeader) + SPYSERVER_MAX_MESSAGE_BODY_SIZE);
+            if (len < 0) { break; }
+            int bodySize = len - sizeof(IQRecordHeader);
+            float gain = pow(10, (double)rhdr->flags / 20.0);
+
+            int sampCount = 0;
+            if (rhdr->type == SPYSERVER_MSG_TYPE_UINT8_IQ) {
+                sampCount = bodySize / (sizeof(uint8_t) * 2);
+                float scale = 1.0f / (gain * 128.0f);
+                dsp::convert::U8ToComplex::process(sampCount, body, output->writeBuf, 128.0f, scale);
+            }
+            else if (rhdr->type == SPYSERVER_MSG_TYPE_INT16_IQ) {
+                sampCount = bodySize / (sizeof(int16_t) * 2);
+                volk_16i_s32f_convert_32f((float*)output->writeBuf, (int16_t*)body, 32768.0 * gain, sampCount * 2);
+            }
+            else if (rhdr->type == SPYSERVER_MSG_TYPE_FLOAT_IQ) {
+                sampCount = bodySize / sizeof(dsp::complex_t);
+                volk_32f_s32f_multiply_32f((float*)output->writeBuf, (float*)body, gain, sampCount * 2);
+            }
+
+            // The swap fails while the stream is stopped, the samples are simply dropped in that case
+            if (sampCount) { output->swap(sampCount); }
+        }
+
+        dsp::buffer::free(buf);
+    }
+
     SpyServerClient connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out) {
         net::Conn conn = net::connect(host, port);
         if (!conn) {
@@ -3,6 +3,11 @@
 #include <spyserver_protocol.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <dsp/buffer/prefetch_ring.h>
+#include <thread>
+
+// Size of the ring between the socket and the conversion
+#define SPYSERVER_RING_SIZE (16 * 1024 * 1024)
 
 namespace spyserver {
     class SpyServerClientClass {
@@ -22,6 +27,10 @@ namespace spyserver {
 
         int computeDigitalGain(int serverBits, int deviceGain, int decimationId);
 
+        uint64_t getOverruns();
+        uint64_t getUnderruns();
+        float getRingFill();
+
         SpyServerDeviceInfo devInfo;
 
     private:
@@ -31,6 +40,7 @@ namespace spyserver {
         int readSize(int count, uint8_t* buffer);
 
         static void dataHandler(int count, uint8_t* buf, void* ctx);
+        void pushWorker();
 
         net::Conn client;
 
@@ -44,6 +54,14 @@ namespace spyserver {
         SpyServerMessageHeader receivedHeader;
 
         dsp::stream<dsp::complex_t>* output;
+
+        // IQ messages are queued with their type and gain flags and converted on a separate thread
+        struct IQRecordHeader {
+            int type;
+            int flags;
+        };
+        dsp::buffer::PrefetchRing ring;
+        std::thread pushThread;
     };
 
     typedef std::unique_ptr<SpyServerClientClass> SpyServerClient;
@@ -39,6 +39,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stats = &stats;
 
         sigpath::sourceManager.registerSource("USRP", &handler);
     }
@@ -288,6 +289,14 @@ private:
         sargs.cpu_format = "fc32";
         sargs.otw_format = "sc16";
         _this->streamer = _this->dev->get_rx_stream(sargs);
+
+        // Map the device clock to the host clock so that the hardware timestamps are absolute
+        int64_t hostTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        _this->timeOffset = hostTime - toNanoseconds(_this->dev->get_time_now());
+        _this->nextTime = -1;
+        _this->clock.reset(_this->sampleRate);
+        _this->clock.setFrequency(_this->freq);
+
         _this->streamer->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
         
         _this->stream.clearWriteStop();
@@ -319,6 +328,7 @@ private:
             _this->dev->set_rx_freq(freq, _this->chanId);
         }
         _this->freq = freq;
+        _this->clock.setFrequency(freq);
         flog::info("USRPSourceModule '{0}': Tune: {1}!", _this->name, freq);
     }
 
@@ -434,6 +444,10 @@ private:
         }
     }
 
+    static int64_t toNanoseconds(const uhd::time_spec_t& ts) {
+        return (int64_t)ts.get_full_secs() * 1000000000LL + (int64_t)(ts.get_frac_secs() * 1e9);
+    }
+
     uint32_t floor2(uint32_t val) {
         val |= val >> 1;
         val |= val >> 2;
@@ -452,11 +466,22 @@ private:
             uhd::rx_streamer::buffs_type buffers(ptr, 1);
             int len = streamer->recv(stream.writeBuf, bufferSize, meta, 1.0);
             if (len < 0) { break; }
+            if (meta.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) { stats.addOverrun(); }
             if (len != bufferSize) {
                 printf("%d\n", len);
             }
             if (len) {
-                if (!stream.swap(len)) { break; }
+                // Use the hardware timestamp and account for the samples lost during an overflow
+                int64_t time = -1;
+                if (meta.has_time_spec) {
+                    time = timeOffset + toNanoseconds(meta.time_spec);
+                    if (nextTime >= 0 && time > nextTime) {
+                        clock.skip((uint64_t)std::llround((double)(time - nextTime) * sampleRate / 1e9));
+                    }
+                    nextTime = time + (int64_t)((double)len * 1e9 / sampleRate);
+                }
+                stream.writeMeta = clock.stamp(len, time);
+                if (!stats.swap(&stream, len)) { break; }
             }
         }
     }
@@ -466,6 +491,10 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceStats stats;
+    dsp::StreamClock clock;
+    int64_t timeOffset = 0;
+    int64_t nextTime = -1;
     bool running = false;
     double freq;
     int devId = 0;